@@ -5,7 +5,11 @@
 #include "irq_if.h"
 
 #include <tlm_utils/simple_target_socket.h>
+#include <functional>
 #include <systemc>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "util/memory_map.h"
 
@@ -32,6 +36,12 @@ struct CLINT : public clint_if, public sc_core::sc_module {
 	// sw a1, mtimecmp+4  # No smaller than new value.
 	// sw a0, mtimecmp    # New value.
 	//
+	// The M, S and VS compare levels of all CPUs are tracked individually: a
+	// write only marks its (core, level) pair for re-evaluation and the future
+	// deadlines live in a min-heap with one entry per pair, whose earliest entry
+	// arms *irq_event*, hence a timer event only touches the cores whose
+	// comparand changed or expired.
+	//
 
 	static_assert(NumberOfCores < 4096, "out of bound");  // stay within the allocated address range
 
@@ -55,24 +65,47 @@ struct CLINT : public clint_if, public sc_core::sc_module {
 	RegisterRange regs_ssip{0xC000, 4 * NumberOfCores};
 	ArrayView<uint32_t> ssip{regs_ssip};
 
-	std::vector<RegisterRange *> register_ranges{&regs_mtime, &regs_mtimecmp, &regs_msip, &regs_ssip};
+	vp::mm::RegisterMap register_map{"CLINT"};
 
 	std::array<clint_interrupt_target *, NumberOfCores> target_harts{};
 
+	static constexpr unsigned NUM_LEVELS = 3;
+	static constexpr PrivilegeLevel compare_levels[NUM_LEVELS] = {MachineMode, SupervisorMode, VirtualSupervisorMode};
+
+	// (core, level) pairs are numbered as slots *idx * NUM_LEVELS + level*
+	static constexpr unsigned NUM_SLOTS = NumberOfCores * NUM_LEVELS;
+	static constexpr unsigned NOT_ARMED = UINT32_MAX;
+
+	// min-heap of the armed slots ordered by *deadline*, a slot is moved in place when its deadline changes
+	std::vector<unsigned> deadlines;
+	std::array<unsigned, NUM_SLOTS> heap_pos;  // position of a slot in *deadlines* or NOT_ARMED
+	std::array<uint64_t, NUM_SLOTS> deadline{};
+
+	std::vector<std::pair<unsigned, unsigned>> changed;
+	std::array<std::array<bool, NUM_LEVELS>, NumberOfCores> is_changed{};
+
+	std::unordered_map<clint_interrupt_target *, unsigned> hart_index;
+
 	SC_HAS_PROCESS(CLINT);
 
 	CLINT(sc_core::sc_module_name) {
 		tsock.register_b_transport(this, &CLINT::transport);
 
+		deadlines.reserve(NUM_SLOTS);
+		heap_pos.fill(NOT_ARMED);
+
 		regs_mtimecmp.alignment = 4;
 		regs_msip.alignment = 4;
 		regs_ssip.alignment = 4;
 		regs_mtime.alignment = 4;
 
-		regs_mtime.pre_read_callback = std::bind(&CLINT::pre_read_mtime, this, std::placeholders::_1);
-		regs_mtimecmp.post_write_callback = std::bind(&CLINT::post_write_mtimecmp, this, std::placeholders::_1);
-		regs_msip.post_write_callback = std::bind(&CLINT::post_write_msip, this, std::placeholders::_1);
-		regs_ssip.post_write_callback = std::bind(&CLINT::post_write_ssip, this, std::placeholders::_1);
+		regs_mtime.pre_read_callback = vp::mm::bind<&CLINT::pre_read_mtime>(this);
+		regs_mtimecmp.post_write_callback = vp::mm::bind<&CLINT::post_write_mtimecmp>(this);
+		regs_msip.post_write_callback = vp::mm::bind<&CLINT::post_write_msip>(this);
+		regs_ssip.post_write_callback = vp::mm::bind<&CLINT::post_write_ssip>(this);
+
+		register_map.add({&regs_mtime, &regs_mtimecmp, &regs_msip, &regs_ssip});
+		register_map.build();
 
 		SC_THREAD(run);
 	}
@@ -90,15 +123,26 @@ struct CLINT : public clint_if, public sc_core::sc_module {
 
 			update_and_get_mtime();
 
-			for (unsigned i = 0; i < NumberOfCores; ++i) {
-				process_compare_level(MachineMode, i);
-				process_compare_level(SupervisorMode, i);
-				process_compare_level(VirtualSupervisorMode, i);
+			for (auto &c : changed) {
+				is_changed[c.first][c.second] = false;
+				process_compare_level(c.second, c.first);
+			}
+			changed.clear();
+
+			while (!deadlines.empty() && deadline[deadlines.front()] <= mtime) {
+				unsigned slot = deadlines.front();
+				process_compare_level(slot % NUM_LEVELS, slot / NUM_LEVELS);
+			}
+
+			if (!deadlines.empty()) {
+				auto time = sc_core::sc_time::from_value(mtime * scaler);
+				auto goal = sc_core::sc_time::from_value(deadline[deadlines.front()] * scaler);
+				irq_event.notify(goal - time);
 			}
 		}
 	}
 
-	bool pre_read_mtime(RegisterRange::ReadInfo t) {
+	bool pre_read_mtime(const RegisterRange::ReadInfo &t) {
 		sc_core::sc_time now = sc_core::sc_time_stamp() + t.delay;
 
 		mtime.write(now.value() / scaler);
@@ -106,20 +150,21 @@ struct CLINT : public clint_if, public sc_core::sc_module {
 		return true;
 	}
 
-	void post_write_mtimecmp(RegisterRange::WriteInfo t) {
+	void post_write_mtimecmp(const RegisterRange::WriteInfo &t) {
 		// std::cout << "[vp::clint] write mtimecmp[addr=" << t.addr << "]=" << mtimecmp[t.addr / 8] << ", mtime=" <<
 		// mtime << std::endl;
+		mark_changed(t.addr / 8, 0);
 		irq_event.notify(t.delay);
 	}
 
-	void post_write_msip(RegisterRange::WriteInfo t) {
+	void post_write_msip(const RegisterRange::WriteInfo &t) {
 		assert(t.addr % 4 == 0);
 		unsigned idx = t.addr / 4;
 		msip[idx] &= 0x1;
 		target_harts[idx]->trigger_software_interrupt(msip[idx] != 0, MachineMode);
 	}
 
-	void post_write_ssip(RegisterRange::WriteInfo t) {
+	void post_write_ssip(const RegisterRange::WriteInfo &t) {
 		assert(t.addr % 4 == 0);
 		unsigned idx = t.addr / 4;
 		ssip[idx] &= 0x1;
@@ -129,15 +174,98 @@ struct CLINT : public clint_if, public sc_core::sc_module {
 	void transport(tlm::tlm_generic_payload &trans, sc_core::sc_time &delay) {
 		delay += 2 * clock_cycle;
 
-		vp::mm::route("CLINT", register_ranges, trans, delay);
+		register_map.route(trans, delay);
 	}
 
-	void post_write_xtimecmp() override {
+	void post_write_xtimecmp(clint_interrupt_target *hart, PrivilegeLevel level) override {
+		auto it = hart_index.find(hart);
+		if (it == hart_index.end()) {
+			for (unsigned i = 0; i < NumberOfCores; ++i)
+				hart_index[target_harts[i]] = i;
+			it = hart_index.find(hart);
+			assert(it != hart_index.end());
+		}
+
+		for (unsigned l = 0; l < NUM_LEVELS; ++l) {
+			if (compare_levels[l] == level)
+				mark_changed(it->second, l);
+		}
 		irq_event.notify(sc_core::SC_ZERO_TIME);
 	}
 
 private:
-	void process_compare_level(PrivilegeLevel level, unsigned idx) {
+	void mark_changed(unsigned idx, unsigned l) {
+		assert(idx < NumberOfCores);
+
+		if (!is_changed[idx][l]) {
+			is_changed[idx][l] = true;
+			changed.push_back({idx, l});
+		}
+	}
+
+	/* Arm the (*idx*, *l*) slot with *cmp*, or disarm it if *cmp* is zero. */
+	void set_deadline(unsigned idx, unsigned l, uint64_t cmp) {
+		unsigned slot = idx * NUM_LEVELS + l;
+		unsigned pos = heap_pos[slot];
+
+		if (cmp == 0) {
+			if (pos == NOT_ARMED)
+				return;
+			unsigned last = deadlines.back();
+			deadlines.pop_back();
+			heap_pos[slot] = NOT_ARMED;
+			if (last == slot)
+				return;
+			deadlines[pos] = last;
+			heap_pos[last] = pos;
+			slot = last;
+		} else {
+			deadline[slot] = cmp;
+			if (pos == NOT_ARMED) {
+				pos = deadlines.size();
+				deadlines.push_back(slot);
+				heap_pos[slot] = pos;
+			}
+		}
+
+		sift_up(pos);
+		sift_down(heap_pos[slot]);
+	}
+
+	void swap_heap_entries(unsigned a, unsigned b) {
+		std::swap(deadlines[a], deadlines[b]);
+		heap_pos[deadlines[a]] = a;
+		heap_pos[deadlines[b]] = b;
+	}
+
+	void sift_up(unsigned pos) {
+		while (pos > 0) {
+			unsigned parent = (pos - 1) / 2;
+			if (deadline[deadlines[parent]] <= deadline[deadlines[pos]])
+				break;
+			swap_heap_entries(parent, pos);
+			pos = parent;
+		}
+	}
+
+	void sift_down(unsigned pos) {
+		while (true) {
+			unsigned min = pos;
+			for (unsigned child = 2 * pos + 1; child <= 2 * pos + 2 && child < deadlines.size(); ++child) {
+				if (deadline[deadlines[child]] < deadline[deadlines[min]])
+					min = child;
+			}
+			if (min == pos)
+				break;
+			swap_heap_entries(min, pos);
+			pos = min;
+		}
+	}
+
+	void process_compare_level(unsigned l, unsigned idx) {
+		PrivilegeLevel level = compare_levels[l];
+		uint64_t armed = 0;
+
 		if (is_compare_level_exists(level, idx)) {
 			uint64_t cmp = get_compare_level(level, idx);
 
@@ -148,16 +276,11 @@ private:
 			} else {
 				// std::cout << "[vp::clint] unset timer interrupt for core " << i << std::endl;
 				target_harts[idx]->trigger_timer_interrupt(false, level);
-				if (cmp > 0 && cmp < UINT64_MAX) {
-					auto time = sc_core::sc_time::from_value(mtime * scaler);
-					auto goal = sc_core::sc_time::from_value(cmp * scaler);
-					// std::cout << "[vp::clint] time=" << time << std::endl;
-					// std::cout << "[vp::clint] goal=" << goal << std::endl;
-					// std::cout << "[vp::clint] goal-time=delay=" << goal-time << std::endl;
-					irq_event.notify(goal - time);
-				}
+				if (cmp > 0 && cmp < UINT64_MAX)
+					armed = cmp;
 			}
 		}
+		set_deadline(idx, l, armed);
 	}
 
 	uint64_t get_compare_level(PrivilegeLevel level, unsigned idx) {
@@ -2,9 +2,12 @@
 
 #include <stdint.h>
 
+#include "irq_if.h"
+
 struct clint_if {
 	virtual ~clint_if() {}
 
 	virtual uint64_t update_and_get_mtime() = 0;
-	virtual void post_write_xtimecmp() = 0;
+	// the xtimecmp register of *level* of *hart* or its enable changed
+	virtual void post_write_xtimecmp(clint_interrupt_target *hart, PrivilegeLevel level) = 0;
 };
\ No newline at end of file
@@ -17,4 +17,10 @@ constexpr unsigned SATP_MODE_SV32 = 1;
 constexpr unsigned SATP_MODE_SV39 = 8;
 constexpr unsigned SATP_MODE_SV48 = 9;
 constexpr unsigned SATP_MODE_SV57 = 10;
-constexpr unsigned SATP_MODE_SV64 = 11;
\ No newline at end of file
+constexpr unsigned SATP_MODE_SV64 = 11;
+
+constexpr unsigned HGATP_MODE_BARE = 0;
+constexpr unsigned HGATP_MODE_SV32X4 = 1;
+constexpr unsigned HGATP_MODE_SV39X4 = 8;
+constexpr unsigned HGATP_MODE_SV48X4 = 9;
+constexpr unsigned HGATP_MODE_SV57X4 = 10;
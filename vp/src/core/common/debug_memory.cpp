@@ -28,12 +28,8 @@
 
 unsigned DebugMemoryInterface::_do_dbg_transaction(tlm::tlm_command cmd, uint64_t addr, uint8_t *data,
                                                    unsigned num_bytes) {
-	tlm::tlm_generic_payload trans;
-	trans.set_command(cmd);
-	trans.set_address(addr);
-	trans.set_data_ptr(data);
-	trans.set_data_length(num_bytes);
-	trans.set_response_status(tlm::TLM_OK_RESPONSE);
+	auto &trans = dbg_payload.prepare(cmd, addr, data, num_bytes);
+	trans.set_response_status(tlm::TLM_OK_RESPONSE);  // not all targets set it
 
 	unsigned nbytes = isock->transport_dbg(trans);
 	if (trans.is_response_error())
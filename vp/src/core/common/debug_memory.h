@@ -8,10 +8,12 @@
 #include <systemc>
 
 #include "core_defs.h"
+#include "payload_pool.h"
 #include "trap.h"
 
 struct DebugMemoryInterface : public sc_core::sc_module {
 	tlm_utils::simple_initiator_socket<DebugMemoryInterface> isock;
+	BlockingPayload dbg_payload;
 
 	DebugMemoryInterface(sc_core::sc_module_name) {}
 
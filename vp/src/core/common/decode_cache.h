@@ -0,0 +1,160 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <array>
+
+#include "instr.h"
+#include "util/common.h"
+
+/* Physically tagged cache of already decoded (and expanded) instructions. The cache is direct mapped and indexed
+ * by the physical fetch address. Entries are dropped on
+ *  - stores that overlap a cached instruction (see *invalidate_store*),
+ *  - FENCE.I and revoked DMI access (see *flush*).
+ * Address translation changes do not affect the (physically tagged) entries.
+ * Pages holding cached instructions are tracked in a direct mapped table, with a bit per 64 byte chunk that holds
+ * cached code, such that stores to other pages and chunks are filtered out quickly. Structures derived from the
+ * cached code of a page (e.g. basic blocks) can use *get_page_generation* to detect that code in the page might
+ * have been modified since they have been built. */
+struct DecodedInstrCache {
+	static constexpr unsigned ENTRIES = 4096;
+	static constexpr unsigned CODE_PAGES = 2048;
+	static constexpr unsigned PAGE_SHIFT = 12;
+	static constexpr unsigned CHUNK_SHIFT = 6;
+	static constexpr uint64_t NO_PAGE = uint64_t(-1);
+
+	struct entry_t {
+		uint64_t paddr = 0;
+		uint32_t generation = 0;
+		uint32_t raw = 0;  // instruction word as fetched (for tracing)
+		Instruction instr;  // decoded, compressed instructions are already expanded
+		Opcode::Mapping op = Opcode::UNDEF;
+		uint8_t length = 0;  // 2 (compressed) or 4 bytes
+	};
+
+	bool enabled = true;
+
+	DecodedInstrCache() {
+		flush();
+	}
+
+	inline entry_t *lookup(uint64_t paddr) {
+		entry_t &e = entries[index(paddr)];
+		if (likely(e.generation == generation && e.paddr == paddr))
+			return &e;
+		return nullptr;
+	}
+
+	inline void insert(uint64_t paddr, uint32_t raw, Instruction instr, Opcode::Mapping op, uint8_t length) {
+		entry_t &e = entries[index(paddr)];
+		e.paddr = paddr;
+		e.generation = generation;
+		e.raw = raw;
+		e.instr = instr;
+		e.op = op;
+		e.length = length;
+		mark_code(paddr);
+		mark_code(paddr + length - 1);
+	}
+
+	/* Called for every store to physical memory. Only stores to chunks which (possibly) hold cached instructions
+	 * need the precise check of the surrounding entries, and only change the generation of their page. */
+	inline void invalidate_store(uint64_t paddr, unsigned num_bytes) {
+		uint64_t last = paddr + num_bytes - 1;
+		bool first_hit = is_code(paddr);
+		bool last_hit = is_code(last);
+		if (likely(!first_hit && !last_hit))
+			return;
+
+		if (first_hit)
+			code_pages[page_index(paddr)].generation = ++page_generation;
+		if (last_hit)
+			code_pages[page_index(last)].generation = ++page_generation;
+
+		invalidate_entries(paddr, num_bytes);
+	}
+
+	void flush() {
+		++generation;
+		if (unlikely(generation == 0)) {
+			// wrap around, make sure no stale entry becomes valid again
+			for (auto &e : entries) e.generation = 0;
+			generation = 1;
+		}
+		// the next *get_page_generation* assigns new generations
+		for (auto &p : code_pages) {
+			p.page = NO_PAGE;
+			p.chunks = 0;
+		}
+	}
+
+	/* Changes on every flush and every store to a chunk of the page which (possibly) holds cached code. The page
+	 * is tracked from now on, if it is not yet. Generations are never reused, zero is never returned. */
+	inline uint64_t get_page_generation(uint64_t paddr) {
+		return track_page(paddr).generation;
+	}
+
+   private:
+	struct code_page_t {
+		uint64_t page = NO_PAGE;
+		uint64_t chunks = 0;  // bit i: bytes [64 * i, 64 * i + 63] of the page (possibly) hold cached code
+		uint64_t generation = 0;
+	};
+
+	std::array<entry_t, ENTRIES> entries;
+	std::array<code_page_t, CODE_PAGES> code_pages;
+	uint32_t generation = 0;
+	uint64_t page_generation = 0;
+
+	static inline unsigned index(uint64_t paddr) {
+		return (paddr >> 1) % ENTRIES;
+	}
+
+	static inline unsigned page_index(uint64_t paddr) {
+		return (paddr >> PAGE_SHIFT) % CODE_PAGES;
+	}
+
+	static inline uint64_t chunk_bit(uint64_t paddr) {
+		return uint64_t(1) << ((paddr >> CHUNK_SHIFT) & ((1u << (PAGE_SHIFT - CHUNK_SHIFT)) - 1));
+	}
+
+	inline void invalidate_entries(uint64_t paddr, uint64_t num_bytes) {
+		// an instruction starting up to 2 bytes (halfword aligned) before the range can overlap it
+		uint64_t first = (paddr - 2) & ~uint64_t(1);
+		uint64_t last = (paddr + num_bytes - 1) & ~uint64_t(1);
+		for (uint64_t a = first; a <= last; a += 2) {
+			entry_t &e = entries[index(a)];
+			if (e.generation == generation && e.paddr == a && (a + e.length) > paddr)
+				e.generation = generation - 1;
+		}
+	}
+
+	inline code_page_t &track_page(uint64_t paddr) {
+		code_page_t &p = code_pages[page_index(paddr)];
+		uint64_t page = paddr >> PAGE_SHIFT;
+		if (unlikely(p.page != page)) {
+			// stores to the previous page are not checked anymore, drop its cached instructions
+			if (p.page != NO_PAGE) {
+				for (unsigned i = 0; i < 64; ++i) {
+					if (p.chunks & (uint64_t(1) << i))
+						invalidate_entries((p.page << PAGE_SHIFT) + (uint64_t(i) << CHUNK_SHIFT),
+						                   uint64_t(1) << CHUNK_SHIFT);
+				}
+			}
+			p.page = page;
+			p.chunks = 0;
+			p.generation = ++page_generation;
+		}
+		return p;
+	}
+
+	inline void mark_code(uint64_t paddr) {
+		track_page(paddr).chunks |= chunk_bit(paddr);
+	}
+
+	inline bool is_code(uint64_t paddr) {
+		const code_page_t &p = code_pages[page_index(paddr)];
+		return p.page == (paddr >> PAGE_SHIFT) && (p.chunks & chunk_bit(paddr));
+	}
+};
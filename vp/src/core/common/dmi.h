@@ -7,18 +7,23 @@ class MemoryDMI {
 	uint64_t start;
 	uint64_t size;
 	uint64_t end;
+	bool writable;
 
-	MemoryDMI(uint8_t *mem, uint64_t start, uint64_t size) : mem(mem), start(start), size(size), end(start + size) {}
+	MemoryDMI(uint8_t *mem, uint64_t start, uint64_t size, bool writable)
+	    : mem(mem), start(start), size(size), end(start + size), writable(writable) {}
 
    public:
-	static MemoryDMI create_start_end_mapping(uint8_t *mem, uint64_t start, uint64_t end) {
+	// empty mapping, does not contain any address
+	MemoryDMI() : MemoryDMI(nullptr, 0, 0, false) {}
+
+	static MemoryDMI create_start_end_mapping(uint8_t *mem, uint64_t start, uint64_t end, bool writable = true) {
 		assert(end > start);
-		return create_start_size_mapping(mem, start, end - start);
+		return create_start_size_mapping(mem, start, end - start, writable);
 	}
 
-	static MemoryDMI create_start_size_mapping(uint8_t *mem, uint64_t start, uint64_t size) {
+	static MemoryDMI create_start_size_mapping(uint8_t *mem, uint64_t start, uint64_t size, bool writable = true) {
 		assert(start + size > start);
-		return MemoryDMI(mem, start, size);
+		return MemoryDMI(mem, start, size, writable);
 	}
 
 	uint8_t *get_raw_mem_ptr() {
@@ -64,6 +69,10 @@ class MemoryDMI {
 		return size;
 	}
 
+	bool is_writable() {
+		return writable;
+	}
+
 	bool contains(uint64_t addr) {
 		return addr >= start && addr < end;
 	}
@@ -4,6 +4,7 @@
 
 #include <cassert>
 #include <stdexcept>
+#include <vector>
 
 constexpr uint32_t LUI_MASK = 0b00000000000000000000000001111111;
 constexpr uint32_t LUI_ENCODING = 0b00000000000000000000000000110111;
@@ -156,6 +157,10 @@ constexpr uint32_t WFI_MASK = 0b11111111111111111111111111111111;
 constexpr uint32_t WFI_ENCODING = 0b00010000010100000000000001110011;
 constexpr uint32_t SFENCE_VMA_MASK = 0b11111110000000000111111111111111;
 constexpr uint32_t SFENCE_VMA_ENCODING = 0b00010010000000000000000001110011;
+constexpr uint32_t HFENCE_VVMA_MASK = 0b11111110000000000111111111111111;
+constexpr uint32_t HFENCE_VVMA_ENCODING = 0b00100010000000000000000001110011;
+constexpr uint32_t HFENCE_GVMA_MASK = 0b11111110000000000111111111111111;
+constexpr uint32_t HFENCE_GVMA_ENCODING = 0b01100010000000000000000001110011;
 
 //-- RV64IMA Extension
 constexpr uint32_t LWU_MASK = 0b00000000000000000111000001111111;
@@ -645,6 +650,10 @@ std::array<const char *, Opcode::NUMBER_OF_INSTRUCTIONS> Opcode::mappingStr = {
     "HSVB",
     "HSVH",
     "HSVW",
+
+    // Hypervisor extension: memory-management fences
+    "HFENCE_VVMA",
+    "HFENCE_GVMA",
 };
 
 Opcode::Type Opcode::getType(Opcode::Mapping mapping) {
@@ -1391,12 +1400,12 @@ Opcode::Mapping expand_compressed(Instruction &instr, Compressed::Opcode op, Arc
 	throw std::runtime_error("some compressed instruction not handled");
 }
 
-Opcode::Mapping Instruction::decode_and_expand_compressed(Architecture arch) {
+Opcode::Mapping Instruction::decode_and_expand_compressed_reference(Architecture arch) {
 	auto c_op = decode_compressed(*this, arch);
 	return expand_compressed(*this, c_op, arch);
 }
 
-Opcode::Mapping Instruction::decode_normal(Architecture arch) {
+Opcode::Mapping Instruction::decode_normal_reference(Architecture arch) {
 	using namespace Opcode;
 
 	Instruction &instr = *this;
@@ -1648,7 +1657,14 @@ Opcode::Mapping Instruction::decode_normal(Architecture arch) {
 						case F12_WFI:
 							MATCH_AND_RETURN_INSTR(WFI);
 						default:
-							MATCH_AND_RETURN_INSTR(SFENCE_VMA);
+							switch (instr.funct7()) {
+								case F7_SFENCE_VMA:
+									MATCH_AND_RETURN_INSTR(SFENCE_VMA);
+								case F7_HFENCE_VVMA:
+									MATCH_AND_RETURN_INSTR(HFENCE_VVMA);
+								case F7_HFENCE_GVMA:
+									MATCH_AND_RETURN_INSTR(HFENCE_GVMA);
+							}
 					}
 					break;
 				}
@@ -1987,6 +2003,242 @@ Opcode::Mapping Instruction::decode_normal(Architecture arch) {
 	return UNDEF;
 }
 
+/* Table driven decoder. The 32 bit instructions are described by their mask/encoding pairs above (*INSTR_DESCS*).
+ * From this description a lookup table is computed at compile time, indexed by opcode and funct3, then by funct7 and
+ * finally by rs2, until at most a single candidate instruction remains, which is then matched against its mask.
+ * Compressed instructions are expanded through a direct lookup table of all 16 bit encodings, which is built once
+ * from *decode_compressed* and *expand_compressed*. */
+namespace {
+
+struct InstrDesc {
+	Opcode::Mapping op;
+	uint32_t mask;
+	uint32_t encoding;
+	unsigned archs;  // bit mask of *Architecture* values
+};
+
+constexpr unsigned ARCH_RV32 = 1 << RV32;
+constexpr unsigned ARCH_RV64 = 1 << RV64;
+constexpr unsigned ARCH_ANY = ARCH_RV32 | ARCH_RV64;
+
+#define INSTR_DESC(name) {Opcode::name, name##_MASK, name##_ENCODING, ARCH_ANY}
+#define INSTR_DESC_ARCH(name, result, arch) {Opcode::result, name##_MASK, name##_ENCODING, ARCH_##arch}
+
+constexpr InstrDesc INSTR_DESCS[] = {
+	INSTR_DESC(LUI), INSTR_DESC(AUIPC), INSTR_DESC(JAL), INSTR_DESC(JALR), INSTR_DESC(BEQ), INSTR_DESC(BNE),
+	INSTR_DESC(BLT), INSTR_DESC(BGE), INSTR_DESC(BLTU), INSTR_DESC(BGEU), INSTR_DESC(LB), INSTR_DESC(LH),
+	INSTR_DESC(LW), INSTR_DESC(LBU), INSTR_DESC(LHU), INSTR_DESC(SB), INSTR_DESC(SH), INSTR_DESC(SW), INSTR_DESC(ADDI),
+	INSTR_DESC(SLTI), INSTR_DESC(SLTIU), INSTR_DESC(XORI), INSTR_DESC(ORI), INSTR_DESC(ANDI),
+	INSTR_DESC_ARCH(SLLI, SLLI, RV64), INSTR_DESC_ARCH(SRLI, SRLI, RV64), INSTR_DESC_ARCH(SRAI, SRAI, RV64),
+	INSTR_DESC_ARCH(SLLI_32, SLLI, RV32), INSTR_DESC_ARCH(SRLI_32, SRLI, RV32), INSTR_DESC_ARCH(SRAI_32, SRAI, RV32),
+	INSTR_DESC(ADD), INSTR_DESC(SUB), INSTR_DESC(SLL), INSTR_DESC(SLT), INSTR_DESC(SLTU), INSTR_DESC(XOR),
+	INSTR_DESC(SRL), INSTR_DESC(SRA), INSTR_DESC(OR), INSTR_DESC(AND), INSTR_DESC(FENCE), INSTR_DESC(FENCE_I),
+	INSTR_DESC(ECALL), INSTR_DESC(EBREAK), INSTR_DESC(CSRRW), INSTR_DESC(CSRRS), INSTR_DESC(CSRRC), INSTR_DESC(CSRRWI),
+	INSTR_DESC(CSRRSI), INSTR_DESC(CSRRCI), INSTR_DESC(MUL), INSTR_DESC(MULH), INSTR_DESC(MULHSU), INSTR_DESC(MULHU),
+	INSTR_DESC(DIV), INSTR_DESC(DIVU), INSTR_DESC(REM), INSTR_DESC(REMU), INSTR_DESC(LR_W), INSTR_DESC(SC_W),
+	INSTR_DESC(AMOSWAP_W), INSTR_DESC(AMOADD_W), INSTR_DESC(AMOXOR_W), INSTR_DESC(AMOAND_W), INSTR_DESC(AMOOR_W),
+	INSTR_DESC(AMOMIN_W), INSTR_DESC(AMOMAX_W), INSTR_DESC(AMOMINU_W), INSTR_DESC(AMOMAXU_W), INSTR_DESC(URET),
+	INSTR_DESC(SRET), INSTR_DESC(MRET), INSTR_DESC(WFI), INSTR_DESC(SFENCE_VMA), INSTR_DESC(LWU), INSTR_DESC(LD),
+	INSTR_DESC(SD), INSTR_DESC(ADDIW), INSTR_DESC(SLLIW), INSTR_DESC(SRLIW), INSTR_DESC(SRAIW), INSTR_DESC(ADDW),
+	INSTR_DESC(SUBW), INSTR_DESC(SLLW), INSTR_DESC(SRLW), INSTR_DESC(SRAW), INSTR_DESC(MULW), INSTR_DESC(DIVW),
+	INSTR_DESC(DIVUW), INSTR_DESC(REMW), INSTR_DESC(REMUW), INSTR_DESC(LR_D), INSTR_DESC(SC_D), INSTR_DESC(AMOSWAP_D),
+	INSTR_DESC(AMOADD_D), INSTR_DESC(AMOXOR_D), INSTR_DESC(AMOAND_D), INSTR_DESC(AMOOR_D), INSTR_DESC(AMOMIN_D),
+	INSTR_DESC(AMOMAX_D), INSTR_DESC(AMOMINU_D), INSTR_DESC(AMOMAXU_D), INSTR_DESC(FLW), INSTR_DESC(FSW),
+	INSTR_DESC(FMADD_S), INSTR_DESC(FMSUB_S), INSTR_DESC(FNMADD_S), INSTR_DESC(FNMSUB_S), INSTR_DESC(FADD_S),
+	INSTR_DESC(FSUB_S), INSTR_DESC(FMUL_S), INSTR_DESC(FDIV_S), INSTR_DESC(FSQRT_S), INSTR_DESC(FSGNJ_S),
+	INSTR_DESC(FSGNJN_S), INSTR_DESC(FSGNJX_S), INSTR_DESC(FMIN_S), INSTR_DESC(FMAX_S), INSTR_DESC(FCVT_W_S),
+	INSTR_DESC(FCVT_WU_S), INSTR_DESC(FMV_X_W), INSTR_DESC(FEQ_S), INSTR_DESC(FLT_S), INSTR_DESC(FLE_S),
+	INSTR_DESC(FCLASS_S), INSTR_DESC(FCVT_S_W), INSTR_DESC(FCVT_S_WU), INSTR_DESC(FMV_W_X), INSTR_DESC(FCVT_L_S),
+	INSTR_DESC(FCVT_LU_S), INSTR_DESC(FCVT_S_L), INSTR_DESC(FCVT_S_LU), INSTR_DESC(FLD), INSTR_DESC(FSD),
+	INSTR_DESC(FMADD_D), INSTR_DESC(FMSUB_D), INSTR_DESC(FNMSUB_D), INSTR_DESC(FNMADD_D), INSTR_DESC(FADD_D),
+	INSTR_DESC(FSUB_D), INSTR_DESC(FMUL_D), INSTR_DESC(FDIV_D), INSTR_DESC(FSQRT_D), INSTR_DESC(FSGNJ_D),
+	INSTR_DESC(FSGNJN_D), INSTR_DESC(FSGNJX_D), INSTR_DESC(FMIN_D), INSTR_DESC(FMAX_D), INSTR_DESC(FCVT_S_D),
+	INSTR_DESC(FCVT_D_S), INSTR_DESC(FEQ_D), INSTR_DESC(FLT_D), INSTR_DESC(FLE_D), INSTR_DESC(FCLASS_D),
+	INSTR_DESC(FCVT_W_D), INSTR_DESC(FCVT_WU_D), INSTR_DESC(FCVT_D_W), INSTR_DESC(FCVT_D_WU), INSTR_DESC(FCVT_L_D),
+	INSTR_DESC(FCVT_LU_D), INSTR_DESC(FMV_X_D), INSTR_DESC(FCVT_D_L), INSTR_DESC(FCVT_D_LU), INSTR_DESC(FMV_D_X),
+	INSTR_DESC(HLVB), INSTR_DESC(HLVBU), INSTR_DESC(HLVH), INSTR_DESC(HLVHU), INSTR_DESC(HLVW), INSTR_DESC(HLVXHU),
+	INSTR_DESC(HLVXWU), INSTR_DESC(HSVB), INSTR_DESC(HSVH), INSTR_DESC(HSVW), INSTR_DESC(HFENCE_VVMA),
+	INSTR_DESC(HFENCE_GVMA),
+};
+
+constexpr unsigned NUM_INSTR_DESCS = sizeof(INSTR_DESCS) / sizeof(INSTR_DESCS[0]);
+
+// instruction bits known at each lookup level
+constexpr uint32_t OPCODE_BITS = 0b00000000000000000000000001111111;
+constexpr uint32_t LEVEL1_BITS = OPCODE_BITS | 0b00000000000000000111000000000000;  // + funct3
+constexpr uint32_t LEVEL2_BITS = LEVEL1_BITS | 0b11111110000000000000000000000000;  // + funct7
+constexpr uint32_t LEVEL3_BITS = LEVEL2_BITS | 0b00000001111100000000000000000000;  // + rs2
+
+/* Table entries are either zero (no instruction), the index + 1 of the single candidate in *INSTR_DESCS* or refer
+ * to a group of the next level. */
+constexpr uint16_t NEXT_LEVEL = 0x8000;
+
+struct NormalDecodeTable {
+	static constexpr unsigned MAX_LEVEL2_GROUPS = 128;
+	static constexpr unsigned MAX_LEVEL3_GROUPS = 64;
+
+	uint16_t level1[256] = {};  // index: funct3 << 5 | opcode[6:2]
+	uint16_t level2[MAX_LEVEL2_GROUPS][128] = {};  // index: funct7
+	uint16_t level3[MAX_LEVEL3_GROUPS][32] = {};  // index: rs2
+	unsigned num_level2_groups = 0;
+	unsigned num_level3_groups = 0;
+};
+
+struct DecodeCandidates {
+	uint8_t index[NUM_INSTR_DESCS] = {};
+	unsigned size = 0;
+
+	constexpr uint16_t entry() const {
+		return size == 0 ? 0 : index[0] + 1;
+	}
+
+	/* Candidates which can match an instruction with the given *bits* at the *known* positions. */
+	constexpr DecodeCandidates filter(uint32_t known, uint32_t bits) const {
+		DecodeCandidates ans;
+		for (unsigned i = 0; i < size; ++i) {
+			const InstrDesc &d = INSTR_DESCS[index[i]];
+			uint32_t m = d.mask & known;
+			if ((d.encoding & m) == (bits & m))
+				ans.index[ans.size++] = index[i];
+		}
+		return ans;
+	}
+};
+
+constexpr NormalDecodeTable build_normal_decode_table(Architecture arch) {
+	static_assert(NUM_INSTR_DESCS < NEXT_LEVEL);
+
+	NormalDecodeTable t;
+
+	DecodeCandidates all;
+	for (unsigned i = 0; i < NUM_INSTR_DESCS; ++i) {
+		if (INSTR_DESCS[i].archs & (1 << arch))
+			all.index[all.size++] = i;
+	}
+
+	for (unsigned opcode = 0; opcode < 32; ++opcode) {
+		uint32_t bits0 = (opcode << 2) | 0b11;
+		DecodeCandidates c0 = all.filter(OPCODE_BITS, bits0);
+
+		for (unsigned funct3 = 0; funct3 < 8; ++funct3) {
+			uint32_t bits1 = bits0 | (funct3 << 12);
+			DecodeCandidates c1 = c0.filter(LEVEL1_BITS, bits1);
+			uint16_t &e1 = t.level1[(funct3 << 5) | opcode];
+			if (c1.size <= 1) {
+				e1 = c1.entry();
+				continue;
+			}
+
+			if (t.num_level2_groups == NormalDecodeTable::MAX_LEVEL2_GROUPS)
+				throw std::logic_error("instruction decode table: too many level 2 groups");
+			unsigned g2 = t.num_level2_groups++;
+			e1 = NEXT_LEVEL | g2;
+
+			for (unsigned funct7 = 0; funct7 < 128; ++funct7) {
+				uint32_t bits2 = bits1 | (funct7 << 25);
+				DecodeCandidates c2 = c1.filter(LEVEL2_BITS, bits2);
+				uint16_t &e2 = t.level2[g2][funct7];
+				if (c2.size <= 1) {
+					e2 = c2.entry();
+					continue;
+				}
+
+				if (t.num_level3_groups == NormalDecodeTable::MAX_LEVEL3_GROUPS)
+					throw std::logic_error("instruction decode table: too many level 3 groups");
+				unsigned g3 = t.num_level3_groups++;
+				e2 = NEXT_LEVEL | g3;
+
+				for (unsigned rs2 = 0; rs2 < 32; ++rs2) {
+					DecodeCandidates c3 = c2.filter(LEVEL3_BITS, bits2 | (rs2 << 20));
+					if (c3.size > 1)
+						throw std::logic_error("instruction decode table: ambiguous instruction description");
+					t.level3[g3][rs2] = c3.entry();
+				}
+			}
+		}
+	}
+
+	return t;
+}
+
+template <Architecture arch>
+constexpr NormalDecodeTable NORMAL_DECODE_TABLE = build_normal_decode_table(arch);
+
+struct CompressedDecodeEntry {
+	uint32_t instr;  // expanded instruction
+	Opcode::Mapping op;
+};
+
+template <Architecture arch>
+const CompressedDecodeEntry *get_compressed_decode_table() {
+	static const std::vector<CompressedDecodeEntry> table = [] {
+		std::vector<CompressedDecodeEntry> t(1 << 16);
+		for (uint32_t i = 0; i < t.size(); ++i) {
+			Instruction instr(i);
+			Opcode::Mapping op = Opcode::UNDEF;
+			// the uncompressed quadrant is rejected before the lookup
+			if (instr.is_compressed())
+				op = expand_compressed(instr, decode_compressed(instr, arch), arch);
+			t[i] = {instr.data(), op};
+		}
+		return t;
+	}();
+	return table.data();
+}
+
+}  // namespace
+
+template <Architecture arch>
+Opcode::Mapping Instruction::decode_normal() {
+	static_assert(arch == RV32 || arch == RV64);
+	const NormalDecodeTable &t = NORMAL_DECODE_TABLE<arch>;
+
+	uint32_t x = instr;
+	uint16_t e = t.level1[((x >> 7) & 0xe0) | ((x >> 2) & 0x1f)];
+	if (e & NEXT_LEVEL) {
+		e = t.level2[e & ~NEXT_LEVEL][x >> 25];
+		if (e & NEXT_LEVEL)
+			e = t.level3[e & ~NEXT_LEVEL][(x >> 20) & 0x1f];
+	}
+	if (e == 0)
+		return Opcode::UNDEF;
+
+	const InstrDesc &d = INSTR_DESCS[e - 1];
+	if (unlikely((x & d.mask) != d.encoding))
+		return Opcode::UNDEF;
+	return d.op;
+}
+
+template <Architecture arch>
+Opcode::Mapping Instruction::decode_and_expand_compressed() {
+	static_assert(arch == RV32 || arch == RV64);
+	if (unlikely(quadrant() == 3))
+		throw std::runtime_error("compressed instruction expected, but uncompressed found");
+
+	const CompressedDecodeEntry &e = get_compressed_decode_table<arch>()[instr & 0xffff];
+	// undefined instructions are not expanded
+	if (e.op != Opcode::UNDEF)
+		instr = e.instr;
+	return e.op;
+}
+
+template Opcode::Mapping Instruction::decode_normal<RV32>();
+template Opcode::Mapping Instruction::decode_normal<RV64>();
+template Opcode::Mapping Instruction::decode_and_expand_compressed<RV32>();
+template Opcode::Mapping Instruction::decode_and_expand_compressed<RV64>();
+
+Opcode::Mapping Instruction::decode_normal(Architecture arch) {
+	if (arch == RV32)
+		return decode_normal<RV32>();
+	return decode_normal<RV64>();
+}
+
+Opcode::Mapping Instruction::decode_and_expand_compressed(Architecture arch) {
+	if (arch == RV32)
+		return decode_and_expand_compressed<RV32>();
+	return decode_and_expand_compressed<RV64>();
+}
+
 uint32_t Instruction::get_xtinst(void) {
 	uint32_t xtinst = 0;
 
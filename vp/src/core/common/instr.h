@@ -94,6 +94,8 @@ enum Parts {
 	F12_MRET = 0b001100000010,
 	F12_WFI = 0b000100000101,
 	F7_SFENCE_VMA = 0b0001001,
+	F7_HFENCE_VVMA = 0b0010001,
+	F7_HFENCE_GVMA = 0b0110001,
 	// end:privileged-instructions
 	F3_CSRRW = 0b001,
 	F3_CSRRS = 0b010,
@@ -448,6 +450,10 @@ enum Mapping {
 	HSVH,
 	HSVW,
 
+	// Hypervisor extension: memory-management fences
+	HFENCE_VVMA,
+	HFENCE_GVMA,
+
 	NUMBER_OF_INSTRUCTIONS
 };
 
@@ -539,6 +545,18 @@ struct Instruction {
 
 	Opcode::Mapping decode_and_expand_compressed(Architecture arch);
 
+	/* Table driven decoders specialized for RV32 and RV64 (RV128 decodes as RV64), used by the above. */
+	template <Architecture arch>
+	Opcode::Mapping decode_normal();
+
+	template <Architecture arch>
+	Opcode::Mapping decode_and_expand_compressed();
+
+	/* Switch based decoders, the reference for the table driven ones (see util/instr-decoder-check). */
+	Opcode::Mapping decode_normal_reference(Architecture arch);
+
+	Opcode::Mapping decode_and_expand_compressed_reference(Architecture arch);
+
 	inline uint32_t csr() {
 		// cast to unsigned to avoid sign extension when shifting
 		return BIT_RANGE((uint32_t)instr, 31, 20) >> 20;
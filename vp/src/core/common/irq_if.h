@@ -78,4 +78,10 @@ struct interrupt_gateway {
 	virtual void gateway_trigger_interrupt(uint32_t irq_id) = 0;
 };
 
+struct imsic_mem_target {
+	virtual ~imsic_mem_target() {}
+
+	virtual void route_imsic_write(PrivilegeLevel target_imsic, unsigned guest_index, uint32_t value) = 0;
+};
+
 #endif  // RISCV_ISA_IRQ_IF_H
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <type_traits>
+#include <utility>
+
 #include "mmu_mem_if.h"
 
 constexpr unsigned PTE_PPN_SHIFT = 10;
@@ -49,16 +52,25 @@ struct pte_t {
         return value;
     }
 };
-
 struct vm_info {
     int levels;
     int idxbits;
     int ptesize;
     uint64_t ptbase;
+    int rootbits = 0;  // additional VPN bits of the root level (G-stage)
 };
 
+// true if the ISS has the hypervisor CSRs, i.e. supports two-stage address translation
+template <typename RVX_ISS, typename = void>
+struct has_hypervisor_csrs : std::false_type {};
+
+template <typename RVX_ISS>
+struct has_hypervisor_csrs<RVX_ISS, std::void_t<decltype(std::declval<RVX_ISS &>().csrs.hgatp)>> : std::true_type {};
+
 template <typename RVX_ISS>
 struct GenericMMU {
+    static constexpr bool HYPERVISOR = has_hypervisor_csrs<RVX_ISS>::value;
+
     RVX_ISS &core;
     tlm_utils::tlm_quantumkeeper &quantum_keeper;
     sc_core::sc_time clock_cycle = sc_core::sc_time(10, sc_core::SC_NS);
@@ -67,68 +79,460 @@ struct GenericMMU {
     mmu_memory_if *mem = nullptr;
     bool page_fault_on_AD = false;
 
+    // translation stages, TLB and page walk cache entries are tagged with the stage
+    enum Stage : uint8_t {
+        STAGE_HS = 0,  // single stage translation of the (H)S and U modes (satp)
+        STAGE_VS = 1,  // VS-stage (vsatp) of the VS and VU modes, followed by the G-stage
+        STAGE_G = 2,   // G-stage (hgatp), guest physical to host physical address
+    };
+
+    // permission check parameters of a translation stage
+    struct access_t {
+        MemoryAccessType type;        // type checked against the PTE permissions
+        MemoryAccessType fault_type;  // type of the original access, selects the page fault cause
+        uint64_t gva;                 // guest virtual address of the original access (reported on guest page faults)
+        bool s_mode;
+        bool sum;
+        bool mxr;
+        bool hlvx;  // HLVX: execute instead of read permission required
+    };
+
+    /* Unified TLB, shared by fetches, loads and stores of all privilege levels. It is set associative (round robin
+     * replacement) and caches pages of any size natively, i.e. a superpage only takes a single entry. Entries are
+     * tagged with the ASID, unless the mapping is global. The PTE flags are checked on every hit, a hit which fails
+     * the permission or A/D check is handled as a miss (walks the page table again). Every entry of the HS stage that
+     * is dropped before a full flush is reported to *mem* (see *mmu_memory_if::mmu_tlb_evicted*).
+     *
+     * Guest translations are tagged with the VMID additionally. A VS-stage entry caches the combined translation of
+     * both stages (guest virtual to host physical address, with the flags of both leaf PTEs), so a hit costs the same
+     * as for the HS stage. G-stage entries translate guest physical addresses, i.e. the VS-stage page table accesses
+     * and all guest accesses while vsatp is Bare. */
     struct tlb_entry_t {
-        uint64_t ppn = -1;
-        uint64_t vpn = -1;
+        uint64_t vtag = -1;  // vaddr >> page_shift, all ones if invalid
+        uint64_t pbase = 0;  // physical address of the page
+        uint16_t asid = 0;
+        uint16_t vmid = 0;
+        uint8_t page_shift = PGSHIFT;
+        uint8_t flags = 0;   // PTE flags
+        uint8_t gflags = 0;  // G-stage PTE flags of a VS-stage entry
+        uint8_t stage = STAGE_HS;
+
+        bool valid() const {
+            return vtag != uint64_t(-1);
+        }
+        bool global() const {
+            return flags & PTE_G;
+        }
+        uint64_t size() const {
+            return uint64_t(1) << page_shift;
+        }
+        bool matches(uint64_t vaddr, uint8_t s, uint32_t a, uint32_t v) const {
+            return vtag == (vaddr >> page_shift) && stage == s && vmid == v && (asid == a || global());
+        }
+    };
+
+    static constexpr unsigned TLB_SETS = 64;
+    static constexpr unsigned TLB_WAYS = 4;
+
+    tlb_entry_t tlb[TLB_SETS][TLB_WAYS];
+    uint8_t tlb_next_victim[TLB_SETS] = {};
+    uint64_t tlb_page_shifts = 0;  // bit n set: pages of size 2^n might be cached
+
+    /* Page walk cache, holds the non-leaf PTEs of recent walks, i.e. the base address of the next level page table.
+     * An entry of level i is tagged with the root page table (satp.ppn and mode) and the VPN fields of the levels
+     * above and including i, so a walk which hits for level 1 only has to load the leaf PTE. Tagging with the root
+     * keeps the entries valid across satp writes (e.g. switching between processes), they are not ASID specific.
+     * Guest entries are tagged with the stage and VMID as well (the VS-stage bases are guest physical addresses). */
+    struct pwc_entry_t {
+        uint64_t root = -1;  // page table base | levels, all ones if invalid
+        uint64_t vtag = 0;   // vaddr >> shift
+        uint64_t base = 0;   // physical address of the next level page table
+        uint8_t shift = 0;   // PGSHIFT + level * idxbits
+        uint8_t stage = STAGE_HS;
+        uint16_t vmid = 0;
     };
 
-    static constexpr unsigned TLB_ENTRIES = 256;
-    static constexpr unsigned NUM_MODES = 2;         // User and Supervisor
-    static constexpr unsigned NUM_ACCESS_TYPES = 3;  // FETCH, LOAD, STORE
+    static constexpr unsigned PWC_LEVELS = 5;  // non-leaf levels of the largest mode (Sv64)
+    static constexpr unsigned PWC_ENTRIES = 16;
+
+    pwc_entry_t pwc[PWC_LEVELS][PWC_ENTRIES];
+    bool use_pwc = true;
+    sc_core::sc_time pwc_hit_delay = sc_core::SC_ZERO_TIME;  // optional timing of a page walk cache hit
 
-    tlb_entry_t tlb[NUM_MODES][NUM_ACCESS_TYPES][TLB_ENTRIES];
+    uint64_t num_tlb_hits = 0;
+    uint64_t num_tlb_misses = 0;
+    uint64_t num_tlb_flushes = 0;
+    uint64_t num_pwc_hits = 0;
+    uint64_t num_pte_loads = 0;
 
     GenericMMU(RVX_ISS &core)
-        : core(core), quantum_keeper(core.quantum_keeper) {
-        flush_tlb();
-    }
+        : core(core), quantum_keeper(core.quantum_keeper) {}
 
     void flush_tlb() {
-        memset(&tlb[0], -1, NUM_MODES * NUM_ACCESS_TYPES * TLB_ENTRIES * sizeof(tlb_entry_t));
+        ++num_tlb_flushes;
+        for (auto &set : tlb) {
+            for (auto &e : set) e.vtag = -1;
+        }
+        tlb_page_shifts = 0;
+        flush_pwc_if([](pwc_entry_t &) { return true; });
     }
 
-    uint64_t translate_virtual_to_physical_addr(uint64_t vaddr, MemoryAccessType type) {
-        if (core.csrs.satp.fields.mode == SATP_MODE_BARE)
-            return vaddr;
+    /* SFENCE.VMA (V=0): drop the HS stage translations of *vaddr* (of all addresses if !has_vaddr) in address space
+     * *asid* (in all address spaces if !has_asid). Global mappings are kept if an address space is given. */
+    void flush_tlb(bool has_vaddr, uint64_t vaddr, bool has_asid, uint32_t asid) {
+        if (!has_vaddr && !has_asid) {
+            flush_tlb();
+            return;
+        }
+
+        ++num_tlb_flushes;
+        asid = mask_asid(asid);
+        tlb_flush_if(has_vaddr, vaddr, [&](tlb_entry_t &e) {
+            return e.stage == STAGE_HS && (!has_asid || (e.asid == asid && !e.global()));
+        });
+        flush_pwc_if(has_vaddr, vaddr, [](pwc_entry_t &e) { return e.stage == STAGE_HS; });
+    }
+
+    /* HFENCE.VVMA (or SFENCE.VMA with V=1): same as *flush_tlb* for the VS-stage translations of the current VMID. */
+    void hfence_vvma(bool has_vaddr, uint64_t vaddr, bool has_asid, uint32_t asid) {
+        if constexpr (HYPERVISOR) {
+            ++num_tlb_flushes;
+            asid = mask_asid(asid);
+            uint32_t vmid = core.csrs.hgatp.fields.vmid;
+            tlb_flush_if(has_vaddr, vaddr, [&](tlb_entry_t &e) {
+                return e.stage == STAGE_VS && e.vmid == vmid && (!has_asid || (e.asid == asid && !e.global()));
+            });
+            flush_pwc_if(has_vaddr, vaddr, [&](pwc_entry_t &e) { return e.stage == STAGE_VS && e.vmid == vmid; });
+        }
+    }
+
+    /* HFENCE.GVMA: drop the G-stage translations of the guest physical address *gaddr* (of all if !has_gaddr) of
+     * virtual machine *vmid* (of all if !has_vmid). The VS-stage entries of the affected virtual machines are dropped
+     * completely, as they do not record the guest physical addresses their translation depends on. */
+    void hfence_gvma(bool has_gaddr, uint64_t gaddr, bool has_vmid, uint32_t vmid) {
+        if constexpr (HYPERVISOR) {
+            ++num_tlb_flushes;
+            decltype(core.csrs.hgatp) hgatp;
+            hgatp.fields.vmid = vmid;
+            vmid = hgatp.fields.vmid;
+
+            auto in_vm = [&](auto &e) { return e.stage != STAGE_HS && (!has_vmid || e.vmid == vmid); };
+            tlb_flush_if(false, 0, [&](tlb_entry_t &e) {
+                return in_vm(e) && (e.stage == STAGE_VS || !has_gaddr || e.vtag == (gaddr >> e.page_shift));
+            });
+            flush_pwc_if([&](pwc_entry_t &e) { return in_vm(e) && e.stage == STAGE_G; });
+        }
+    }
+
+    uint32_t mask_asid(uint32_t asid) {
+        // bits beyond ASIDLEN are ignored
+        decltype(core.csrs.satp) satp;
+        satp.fields.asid = asid;
+        return satp.fields.asid;
+    }
+
+    // drop the TLB entries (of page *vaddr* only if has_vaddr) for which *pred* holds
+    template <typename P>
+    void tlb_flush_if(bool has_vaddr, uint64_t vaddr, P pred) {
+        auto flush = [&](tlb_entry_t &e) {
+            if (e.valid() && (!has_vaddr || e.vtag == (vaddr >> e.page_shift)) && pred(e))
+                tlb_evict(e);
+        };
+
+        if (has_vaddr) {
+            for_each_page_shift([&](unsigned shift) {
+                for (auto &e : tlb[(vaddr >> shift) % TLB_SETS]) flush(e);
+            });
+        } else {
+            for (auto &set : tlb) {
+                for (auto &e : set) flush(e);
+            }
+        }
+    }
+
+    template <typename P>
+    void flush_pwc_if(P pred) {
+        for (auto &level : pwc) {
+            for (auto &e : level) {
+                if (pred(e))
+                    e.root = -1;
+            }
+        }
+    }
 
+    /* Strictly, only leaf PTEs are ordered by a fence with address. Dropping the non-leaf PTEs on the path of *vaddr*
+     * as well keeps SW working which updates a non-leaf PTE and fences one address of its range. */
+    template <typename P>
+    void flush_pwc_if(bool has_vaddr, uint64_t vaddr, P pred) {
+        flush_pwc_if([&](pwc_entry_t &e) { return (!has_vaddr || e.vtag == (vaddr >> e.shift)) && pred(e); });
+    }
+
+    inline pwc_entry_t &pwc_slot(int level, uint64_t vtag) {
+        assert(level > 0 && level <= int(PWC_LEVELS));
+        return pwc[level - 1][vtag % PWC_ENTRIES];
+    }
+
+    template <typename F>
+    inline void for_each_page_shift(F f) {
+        for (uint64_t shifts = tlb_page_shifts; shifts; shifts &= shifts - 1)
+            f(__builtin_ctzll(shifts));
+    }
+
+    inline tlb_entry_t *tlb_lookup(uint64_t vaddr, Stage stage, uint32_t asid, uint32_t vmid) {
+        tlb_entry_t *ans = nullptr;
+        for_each_page_shift([&](unsigned shift) {
+            if (ans)
+                return;
+            for (auto &e : tlb[(vaddr >> shift) % TLB_SETS]) {
+                if (e.page_shift == shift && e.matches(vaddr, stage, asid, vmid)) {
+                    ans = &e;
+                    return;
+                }
+            }
+        });
+        return ans;
+    }
+
+    void tlb_insert(const tlb_entry_t &entry) {
+        unsigned idx = entry.vtag % TLB_SETS;
+        auto &set = tlb[idx];
+
+        // replace an (outdated) entry of the same page, else an invalid one, else round robin
+        tlb_entry_t *victim = nullptr;
+        for (auto &e : set) {
+            if (e.page_shift == entry.page_shift &&
+                e.matches(entry.vtag << entry.page_shift, entry.stage, entry.asid, entry.vmid)) {
+                victim = &e;
+                break;
+            }
+        }
+        for (unsigned i = 0; !victim && i < TLB_WAYS; ++i) {
+            if (!set[i].valid())
+                victim = &set[i];
+        }
+        if (!victim) {
+            victim = &set[tlb_next_victim[idx]];
+            tlb_next_victim[idx] = (tlb_next_victim[idx] + 1) % TLB_WAYS;
+        }
+
+        if (victim->valid())
+            tlb_evict(*victim);
+        *victim = entry;
+        tlb_page_shifts |= uint64_t(1) << entry.page_shift;
+    }
+
+    void tlb_evict(tlb_entry_t &e) {
+        // only HS stage translations can be cached outside of the MMU
+        if (e.stage == STAGE_HS)
+            mem->mmu_tlb_evicted(e.vtag << e.page_shift, e.size());
+        e.vtag = -1;
+    }
+
+    void show() {
+        std::cout << "tlb-hits = " << num_tlb_hits << std::endl;
+        std::cout << "tlb-misses = " << num_tlb_misses << std::endl;
+        std::cout << "tlb-flushes = " << num_tlb_flushes << std::endl;
+        std::cout << "pwc-hits = " << num_pwc_hits << std::endl;
+        std::cout << "pte-loads = " << num_pte_loads << std::endl;
+    }
+
+    static bool is_guest_mode(PrivilegeLevel mode) {
+        return HYPERVISOR && PrivilegeLevelToV(mode);
+    }
+
+    /* Privilege level used for the translation, machine mode if no translation is done. *privilege_override* is the
+     * privilege level of a hypervisor virtual machine load/store instruction (NoneMode otherwise). */
+    PrivilegeLevel translation_mode(MemoryAccessType type, PrivilegeLevel privilege_override = NoneMode) {
         auto mode = core.prv;
 
         if (type != FETCH) {
-            if (core.csrs.mstatus.fields.mprv)
+            if (core.csrs.mstatus.fields.mprv) {
                 mode = core.csrs.mstatus.fields.mpp;
+                if constexpr (HYPERVISOR)
+                    mode = VPPToPrivilegeLevel(core.csrs.mstatush.fields.mpv, core.csrs.mstatus.fields.mpp);
+            }
+            if (privilege_override != NoneMode)
+                mode = privilege_override;
         }
 
         if (mode == MachineMode)
-            return vaddr;
+            return MachineMode;
+
+        if constexpr (HYPERVISOR) {
+            if (is_guest_mode(mode)) {
+                if (core.csrs.vsatp.fields.mode == SATP_MODE_BARE && core.csrs.hgatp.fields.mode == HGATP_MODE_BARE)
+                    return MachineMode;
+                return mode;
+            }
+        }
+
+        if (core.csrs.satp.fields.mode == SATP_MODE_BARE)
+            return MachineMode;
+
+        return mode;
+    }
+
+    /* Timing of a translation which is known to hit the TLB (e.g. subsequent fetches from the same page), without
+     * doing the translation. */
+    void account_tlb_hit(MemoryAccessType type) {
+        if (translation_mode(type) != MachineMode)
+            quantum_keeper.inc(mmu_access_delay);
+    }
+
+    uint64_t translate_virtual_to_physical_addr(uint64_t vaddr, MemoryAccessType type,
+                                                PrivilegeLevel privilege_override = NoneMode, bool hlvx = false) {
+        uint64_t paddr;
+        SimulationTrap trap;
+        if (!try_translate(vaddr, type, paddr, trap, privilege_override, hlvx))
+            raise_trap(trap.reason, trap.mtval, trap.mtval2_htval);
+        return paddr;
+    }
+
+    /* Same as *translate_virtual_to_physical_addr*, but a page fault is reported in *trap* (returning false) instead
+     * of throwing it, see *ISS::signal_trap*. */
+    bool try_translate(uint64_t vaddr, MemoryAccessType type, uint64_t &paddr, SimulationTrap &trap,
+                       PrivilegeLevel privilege_override = NoneMode, bool hlvx = false) {
+        auto mode = translation_mode(type, privilege_override);
+
+        paddr = vaddr;
+        if (mode == MachineMode)
+            return true;
 
         // optional timing
         quantum_keeper.inc(mmu_access_delay);
 
-        // optimization only, to void page walk
-        assert(mode == 0 || mode == 1);
         assert(type == 0 || type == 1 || type == 2);
-        auto vpn = (vaddr >> PGSHIFT);
-        auto idx = vpn % TLB_ENTRIES;
-        auto &x = tlb[mode][type][idx];
-        if (x.vpn == vpn)
-            return x.ppn | (vaddr & PGMASK);
+        if (is_guest_mode(mode))
+            return try_translate_guest(vaddr, type, mode, hlvx, paddr, trap);
+
+        assert(mode == 0 || mode == 1);
+        access_t acc = {type, type, 0, mode == SupervisorMode, bool(core.csrs.mstatus.fields.sum),
+                        bool(core.csrs.mstatus.fields.mxr), false};
+        uint32_t asid = core.csrs.satp.fields.asid;
+        auto e = tlb_lookup(vaddr, STAGE_HS, asid, 0);
+        if (likely(e && is_access_allowed(e->flags, acc) && has_AD_flags(e->flags, type))) {
+            ++num_tlb_hits;
+            paddr = e->pbase | (vaddr & (e->size() - 1));
+            return true;
+        }
+        ++num_tlb_misses;
 
-        uint64_t paddr = walk(vaddr, type, mode);
+        tlb_entry_t leaf;
+        if (!walk(STAGE_HS, vaddr, acc, paddr, leaf, trap))
+            return false;
 
-        // optimization only, to void page walk
-        x.ppn = (paddr & ~PGMASK);
-        x.vpn = vpn;
+        leaf.asid = asid;
+        tlb_insert(leaf);
 
-        return paddr;
+        return true;
+    }
+
+    // two-stage translation of the guest virtual address *gva* (VS and VU mode)
+    bool try_translate_guest(uint64_t gva, MemoryAccessType type, PrivilegeLevel mode, bool hlvx, uint64_t &paddr,
+                             SimulationTrap &trap) {
+        if constexpr (HYPERVISOR) {
+            if (core.csrs.vsatp.fields.mode == SATP_MODE_BARE) {
+                tlb_entry_t gleaf;
+                return g_translate(gva, g_access(type, type, gva, hlvx), paddr, gleaf, trap);
+            }
+
+            bool mxr = core.csrs.vsstatus.fields.mxr || core.csrs.mstatus.fields.mxr;
+            access_t acc = {type, type, gva, mode == VirtualSupervisorMode, bool(core.csrs.vsstatus.fields.sum), mxr,
+                            hlvx};
+            access_t gacc = g_access(type, type, gva, hlvx);
+            uint32_t asid = core.csrs.vsatp.fields.asid;
+            uint32_t vmid = core.csrs.hgatp.fields.vmid;
+            auto e = tlb_lookup(gva, STAGE_VS, asid, vmid);
+            if (likely(e && is_access_allowed(e->flags, acc) && has_AD_flags(e->flags, type) &&
+                       is_access_allowed(e->gflags, gacc) && has_AD_flags(e->gflags, type))) {
+                ++num_tlb_hits;
+                paddr = e->pbase | (gva & (e->size() - 1));
+                return true;
+            }
+            ++num_tlb_misses;
+
+            uint64_t gpa;
+            tlb_entry_t leaf;
+            tlb_entry_t gleaf;
+            if (!walk(STAGE_VS, gva, acc, gpa, leaf, trap) || !g_translate(gpa, gacc, paddr, gleaf, trap))
+                return false;
+
+            // the combined page is the smaller one of both stages
+            leaf.page_shift = std::min(leaf.page_shift, gleaf.page_shift);
+            leaf.vtag = gva >> leaf.page_shift;
+            leaf.pbase = paddr & ~(leaf.size() - 1);
+            leaf.gflags = gleaf.flags;
+            leaf.asid = asid;
+            leaf.vmid = vmid;
+            tlb_insert(leaf);
+            return true;
+        } else {
+            throw std::runtime_error("[mmu] two-stage translation not supported");
+        }
+    }
+
+    access_t g_access(MemoryAccessType type, MemoryAccessType fault_type, uint64_t gva, bool hlvx) {
+        // all G-stage accesses are checked as U-mode accesses
+        return {type, fault_type, gva, false, false, bool(core.csrs.mstatus.fields.mxr), hlvx};
+    }
+
+    /* G-stage translation of the guest physical address *gpa*, sets *gleaf* to the used TLB entry (all permissions
+     * granted if hgatp is Bare). Reports guest page faults in *trap*. */
+    bool g_translate(uint64_t gpa, const access_t &acc, uint64_t &paddr, tlb_entry_t &gleaf, SimulationTrap &trap) {
+        if constexpr (HYPERVISOR) {
+            if (core.csrs.hgatp.fields.mode == HGATP_MODE_BARE) {
+                paddr = gpa;
+                gleaf.page_shift = 63;
+                gleaf.flags = PTE_V | PTE_R | PTE_W | PTE_X | PTE_U | PTE_A | PTE_D;
+                return true;
+            }
+
+            uint32_t vmid = core.csrs.hgatp.fields.vmid;
+            auto e = tlb_lookup(gpa, STAGE_G, 0, vmid);
+            if (likely(e && is_access_allowed(e->flags, acc) && has_AD_flags(e->flags, acc.type))) {
+                gleaf = *e;
+                paddr = e->pbase | (gpa & (e->size() - 1));
+                return true;
+            }
+
+            if (!walk(STAGE_G, gpa, acc, paddr, gleaf, trap))
+                return false;
+
+            gleaf.vmid = vmid;
+            tlb_insert(gleaf);
+            return true;
+        } else {
+            throw std::runtime_error("[mmu] two-stage translation not supported");
+        }
+    }
+
+    static uint32_t page_fault_cause(MemoryAccessType type) {
+        switch (type) {
+            case FETCH:
+                return EXC_INSTR_PAGE_FAULT;
+            case LOAD:
+                return EXC_LOAD_PAGE_FAULT;
+            case STORE:
+                return EXC_STORE_AMO_PAGE_FAULT;
+            default:
+                throw std::runtime_error("[mmu] unknown access type " + std::to_string(type));
+        }
+    }
+
+    static uint32_t guest_page_fault_cause(MemoryAccessType type) {
+        switch (type) {
+            case FETCH:
+                return EXC_INSTR_GUEST_PAGE_FAULT;
+            case LOAD:
+                return EXC_LOAD_GUEST_PAGE_FAULT;
+            case STORE:
+                return EXC_STORE_AMO_GUEST_PAGE_FAULT;
+            default:
+                throw std::runtime_error("[mmu] unknown access type " + std::to_string(type));
+        }
     }
 
-    vm_info decode_vm_info(PrivilegeLevel prv) {
-        // TODO: check if assert is correct. Previous condition assert(prv <= SupervisorMode) won't
-        // work with new PrivilegeLevel definitions, though it's not clear if we can allow virtual
-        // modes here.
-        assert(prv != MachineMode);
-        uint64_t ptbase = (uint64_t)core.csrs.satp.fields.ppn << PGSHIFT;
-        unsigned mode = core.csrs.satp.fields.mode;
+    static vm_info decode_satp_mode(unsigned mode, uint64_t ptbase) {
         switch (mode) {
             case SATP_MODE_SV32:
                 return {2, 10, 4, ptbase};
@@ -145,38 +549,118 @@ struct GenericMMU {
         }
     }
 
-    bool check_vaddr_extension(uint64_t vaddr, const vm_info &vm) {
+    vm_info decode_vm_info(Stage stage) {
+        if constexpr (HYPERVISOR) {
+            if (stage == STAGE_VS)
+                return decode_satp_mode(core.csrs.vsatp.fields.mode, (uint64_t)core.csrs.vsatp.fields.ppn << PGSHIFT);
+
+            if (stage == STAGE_G) {
+                // the xN modes are encoded like the corresponding satp modes, but the root page table is four times
+                // larger (16 KiB aligned) and indexed by two additional bits
+                uint64_t ptbase = ((uint64_t)core.csrs.hgatp.fields.ppn & ~uint64_t(0b11)) << PGSHIFT;
+                unsigned mode = core.csrs.hgatp.fields.mode;
+                vm_info vm = decode_satp_mode(mode, ptbase);
+                vm.rootbits = 2;
+                return vm;
+            }
+        }
+
+        assert(stage == STAGE_HS);
+        return decode_satp_mode(core.csrs.satp.fields.mode, (uint64_t)core.csrs.satp.fields.ppn << PGSHIFT);
+    }
+
+    bool check_vaddr_extension(uint64_t vaddr, const vm_info &vm, Stage stage) {
         int highbit = vm.idxbits * vm.levels + PGSHIFT - 1;
         assert(highbit > 0);
+        if (stage == STAGE_G) {
+            // guest physical addresses are zero extended
+            int bits = highbit + 1 + vm.rootbits;
+            return bits >= 64 || (vaddr >> bits) == 0;
+        }
         uint64_t ext_mask = (uint64_t(1) << (core.xlen - highbit)) - 1;
         uint64_t bits = (vaddr >> highbit) & ext_mask;
         bool ok = (bits == 0) || (bits == ext_mask);
         return ok;
     }
 
-    uint64_t walk(uint64_t vaddr, MemoryAccessType type, PrivilegeLevel mode) {
-        bool s_mode = mode == SupervisorMode;
-        bool sum = core.csrs.mstatus.fields.sum;
-        bool mxr = core.csrs.mstatus.fields.mxr;
+    // permission check of a leaf PTE, without the A/D flags
+    static bool is_access_allowed(uint64_t pte, const access_t &acc) {
+        bool r = pte & PTE_R;
+        bool w = pte & PTE_W;
+        bool x = pte & PTE_X;
+
+        assert(acc.type == FETCH || acc.type == LOAD || acc.type == STORE);
+        if ((acc.type == FETCH) && !x)
+            return false;
+        if ((acc.type == LOAD) && !(acc.hlvx ? x : (r || (acc.mxr && x))))
+            return false;
+        if ((acc.type == STORE) && !(r && w))
+            return false;
+
+        if (pte & PTE_U)
+            return !acc.s_mode || ((acc.type != FETCH) && acc.sum);
+        return acc.s_mode;
+    }
 
-        vm_info vm = decode_vm_info(mode);
+    static bool has_AD_flags(uint64_t pte, MemoryAccessType type) {
+        uint64_t ad = PTE_A | ((type == STORE) * PTE_D);
+        return (pte & ad) == ad;
+    }
+
+    /* Walks the page table of *stage*, returns false on a page fault (reported in *trap*). *leaf* is set to the TLB
+     * entry of the translation otherwise (without ASID/VMID). The page table accesses of the VS-stage are translated
+     * by the G-stage. */
+    bool walk(Stage stage, uint64_t vaddr, const access_t &acc, uint64_t &paddr, tlb_entry_t &leaf,
+              SimulationTrap &trap) {
+        vm_info vm = decode_vm_info(stage);
+        uint32_t vmid = 0;
+        if constexpr (HYPERVISOR) {
+            if (stage != STAGE_HS)
+                vmid = core.csrs.hgatp.fields.vmid;
+        }
 
-        if (!check_vaddr_extension(vaddr, vm))
+        if (!check_vaddr_extension(vaddr, vm, stage))
             vm.levels = 0;  // skip loop and raise page fault
 
+        uint64_t root = vm.ptbase | vm.levels;
         uint64_t base = vm.ptbase;
-        for (int i = vm.levels - 1; i >= 0; --i) {
+        int start = vm.levels - 1;
+
+        // optimization only, continue the walk below the lowest cached non-leaf PTE
+        if (use_pwc) {
+            for (int i = 1; i < vm.levels; ++i) {
+                unsigned shift = PGSHIFT + i * vm.idxbits;
+                auto &e = pwc_slot(i, vaddr >> shift);
+                if (e.root == root && e.vtag == (vaddr >> shift) && e.stage == stage && e.vmid == vmid) {
+                    ++num_pwc_hits;
+                    quantum_keeper.inc(pwc_hit_delay);
+                    base = e.base;
+                    start = i - 1;
+                    break;
+                }
+            }
+        }
+
+        for (int i = start; i >= 0; --i) {
             // obtain VPN field for current level, NOTE: all VPN fields have the same length for each separate VM
-            // implementation
+            // implementation (except for the wider root of the G-stage)
             int ptshift = i * vm.idxbits;
-            unsigned vpn_field = (vaddr >> (PGSHIFT + ptshift)) & ((1 << vm.idxbits) - 1);
+            int idxbits = vm.idxbits + (i == vm.levels - 1 ? vm.rootbits : 0);
+            unsigned vpn_field = (vaddr >> (PGSHIFT + ptshift)) & ((1 << idxbits) - 1);
 
             auto pte_paddr = base + vpn_field * vm.ptesize;
             // TODO: PMP checks for pte_paddr with (LOAD, PRV_S)
 
+            // the VS-stage page tables are located in guest physical memory
+            tlb_entry_t gleaf;
+            if (stage == STAGE_VS && !g_translate(pte_paddr, g_access(LOAD, acc.fault_type, acc.gva, false),
+                                                  pte_paddr, gleaf, trap))
+                return false;
+
             assert(vm.ptesize == 4 || vm.ptesize == 8);
             assert(mem);
             pte_t pte;
+            ++num_pte_loads;
             if (vm.ptesize == 4)
                 pte.value = mem->mmu_load_pte32(pte_paddr);
             else
@@ -191,42 +675,35 @@ struct GenericMMU {
 
             if (!pte.R() && !pte.X()) {
                 base = ppn << PGSHIFT;
+                if (use_pwc && i > 0) {
+                    unsigned shift = PGSHIFT + ptshift;
+                    pwc_slot(i, vaddr >> shift) = {root, vaddr >> shift, base, uint8_t(shift), stage, uint16_t(vmid)};
+                }
                 continue;
             }
 
-            assert(type == FETCH || type == LOAD || type == STORE);
-            if ((type == FETCH) && !pte.X()) {
-                // std::cout << "[mmu] (type == FETCH) && !pte.X()" << std::endl;
-                break;
-            }
-            if ((type == LOAD) && !pte.R() && !(mxr && pte.X())) {
-                // std::cout << "[mmu] (type == LOAD) && !pte.R() && !(mxr && pte.X())" << std::endl;
+            if (!is_access_allowed(pte, acc))
                 break;
-            }
-            if ((type == STORE) && !(pte.R() && pte.W())) {
-                // std::cout << "[mmu] (type == STORE) && !(pte.R() && pte.W())" << std::endl;
-                break;
-            }
-
-            if (pte.U()) {
-                if (s_mode && ((type == FETCH) || !sum))
-                    break;
-            } else {
-                if (!s_mode)
-                    break;
-            }
 
             // NOTE: all PPN (except the highest one) have the same bitwidth as the VPNs, hence ptshift can be used
             if ((ppn & ((uint64_t(1) << ptshift) - 1)) != 0)
                 break;  // misaligned superpage
 
-            uint64_t ad = PTE_A | ((type == STORE) * PTE_D);
-            if ((pte & ad) != ad) {
+            uint64_t ad = PTE_A | ((acc.type == STORE) * PTE_D);
+            if (!has_AD_flags(pte, acc.type)) {
                 if (page_fault_on_AD) {
                     break;  // let SW deal with this
                 } else {
                     // TODO: PMP checks for pte_paddr with (STORE, PRV_S)
 
+                    // the update of a VS-stage PTE is a store to guest physical memory
+                    if (stage == STAGE_VS) {
+                        uint64_t pte_gpa = base + vpn_field * vm.ptesize;
+                        if (!g_translate(pte_gpa, g_access(STORE, acc.fault_type, acc.gva, false), pte_paddr, gleaf,
+                                         trap))
+                            return false;
+                    }
+
                     // NOTE: the store has to be atomic with the above load of the PTE, i.e. lock the bus if required
                     // NOTE: only need to update A / D flags, hence it is enough to store 32 bit (8 bit might be enough
                     // too)
@@ -238,24 +715,20 @@ struct GenericMMU {
             uint64_t mask = ((uint64_t(1) << ptshift) - 1);
             uint64_t vpn = vaddr >> PGSHIFT;
             uint64_t pgoff = vaddr & (PGSIZE - 1);
-            uint64_t paddr = (((ppn & ~mask) | (vpn & mask)) << PGSHIFT) | pgoff;
-            return paddr;
-        }
-
-        switch (type) {
-            case FETCH:
-                raise_trap(EXC_INSTR_PAGE_FAULT, vaddr);
-                break;
-            case LOAD:
-                raise_trap(EXC_LOAD_PAGE_FAULT, vaddr);
-                break;
-            case STORE:
-                raise_trap(EXC_STORE_AMO_PAGE_FAULT, vaddr);
-                break;
-            default:
-                break;
+            paddr = (((ppn & ~mask) | (vpn & mask)) << PGSHIFT) | pgoff;
+
+            leaf.page_shift = PGSHIFT + ptshift;
+            leaf.vtag = vaddr >> leaf.page_shift;
+            leaf.pbase = paddr & ~(leaf.size() - 1);
+            leaf.flags = pte | ad;
+            leaf.stage = stage;
+            return true;
         }
 
-        throw std::runtime_error("[mmu] unknown access type " + std::to_string(type));
+        if (stage == STAGE_G)
+            trap = {guest_page_fault_cause(acc.fault_type), acc.gva, vaddr >> 2};
+        else
+            trap = {page_fault_cause(acc.fault_type), vaddr, 0};
+        return false;
     }
 };
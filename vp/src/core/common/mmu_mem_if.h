@@ -11,6 +11,10 @@ struct mmu_memory_if {
     virtual uint64_t mmu_load_pte64(uint64_t addr) = 0;
     virtual uint64_t mmu_load_pte32(uint64_t addr) = 0;
     virtual void mmu_store_pte32(uint64_t addr, uint32_t value) = 0;
+
+    /* Called when the MMU drops the TLB entry of the page [vaddr, vaddr + size), because it is replaced or selectively
+     * flushed (but not on a full flush). Caches derived from the TLB content have to drop the page as well. */
+    virtual void mmu_tlb_evicted(uint64_t vaddr, uint64_t size) {}
 };
 
 #endif //RISCV_VP_MMU_MEM_IF_H
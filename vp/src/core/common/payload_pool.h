@@ -0,0 +1,108 @@
+#pragma once
+
+#include <tlm>
+
+#include <assert.h>
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "irq_if.h"
+
+/* Initiator of a transaction, attached to every payload of the pool: the hart and the privilege level it ran in when
+ * issuing the access. Targets can use it for tracing or protection checks, initiators that are not a hart leave
+ * *hart_id* at NO_HART. */
+struct InitiatorExtension : public tlm::tlm_extension<InitiatorExtension> {
+	static constexpr uint64_t NO_HART = uint64_t(-1);
+
+	uint64_t hart_id = NO_HART;
+	PrivilegeLevel privilege = MachineMode;
+
+	tlm::tlm_extension_base *clone() const override {
+		return new InitiatorExtension(*this);
+	}
+
+	void copy_from(const tlm::tlm_extension_base &ext) override {
+		*this = static_cast<const InitiatorExtension &>(ext);
+	}
+};
+
+/* Memory manager for the payloads of all initiators: released payloads are kept for reuse instead of being deleted,
+ * together with their extensions, which are only set up when a payload is created. The simulation runs in a single
+ * OS thread, hence no locking. */
+class PayloadPool : public tlm::tlm_mm_interface {
+	std::vector<std::unique_ptr<tlm::tlm_generic_payload>> payloads;
+	std::vector<tlm::tlm_generic_payload *> free_list;
+
+   public:
+	static PayloadPool &instance() {
+		static PayloadPool pool;
+		return pool;
+	}
+
+	/* A payload with reference count zero, use acquire/release to hand it back to the pool. */
+	tlm::tlm_generic_payload *allocate() {
+		if (!free_list.empty()) {
+			auto trans = free_list.back();
+			free_list.pop_back();
+			return trans;
+		}
+
+		payloads.emplace_back(new tlm::tlm_generic_payload(this));
+		auto trans = payloads.back().get();
+		trans->set_extension(new InitiatorExtension());
+		return trans;
+	}
+
+	void free(tlm::tlm_generic_payload *trans) override {
+		trans->reset();  // only drops auto extensions, the initiator extension stays
+		*trans->get_extension<InitiatorExtension>() = InitiatorExtension();
+		free_list.push_back(trans);
+	}
+};
+
+/* Payload of an initiator issuing one blocking (or debug/DMI) transaction at a time. It is taken from the pool once
+ * and reused for every access, *prepare* sets all attributes a target may have changed in the previous one. */
+class BlockingPayload {
+	tlm::tlm_generic_payload *trans;
+	InitiatorExtension *ext;
+
+   public:
+	explicit BlockingPayload(uint64_t hart_id = InitiatorExtension::NO_HART)
+	    : trans(PayloadPool::instance().allocate()), ext(trans->get_extension<InitiatorExtension>()) {
+		assert(ext);
+		trans->acquire();
+		ext->hart_id = hart_id;
+	}
+
+	~BlockingPayload() {
+		trans->release();
+	}
+
+	BlockingPayload(const BlockingPayload &) = delete;
+	BlockingPayload &operator=(const BlockingPayload &) = delete;
+
+	void set_hart_id(uint64_t hart_id) {
+		ext->hart_id = hart_id;
+	}
+
+	InitiatorExtension &initiator() {
+		return *ext;
+	}
+
+	/* Reset for a new transaction, the response status starts as TLM_INCOMPLETE_RESPONSE like for a new payload. */
+	inline tlm::tlm_generic_payload &prepare(tlm::tlm_command cmd, uint64_t addr, uint8_t *data, unsigned num_bytes,
+	                                         PrivilegeLevel privilege = MachineMode) {
+		trans->set_command(cmd);
+		trans->set_address(addr);
+		trans->set_data_ptr(data);
+		trans->set_data_length(num_bytes);
+		trans->set_streaming_width(num_bytes);
+		trans->set_byte_enable_ptr(nullptr);
+		trans->set_byte_enable_length(0);
+		trans->set_dmi_allowed(false);
+		trans->set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+		ext->privilege = privilege;
+		return *trans;
+	}
+};
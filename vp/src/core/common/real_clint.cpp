@@ -43,21 +43,22 @@ RealCLINT::RealCLINT(sc_core::sc_module_name, std::vector<clint_interrupt_target
 	  mtime(regs_mtime),
 
 	  harts(_harts) {
-	for (size_t i = 0; i < harts.size(); i++) {
+	for (size_t i = 0; i < harts.size() * NUM_LEVELS; i++) {
 		Timer *timer = new Timer(timercb, &event);
 		timers.push_back(timer);
 	}
 
-	register_ranges.insert(register_ranges.end(), {&regs_mtimecmp, &regs_msip, &regs_ssip, &regs_mtime});
-	for (auto reg : register_ranges)
+	register_map.add({&regs_mtimecmp, &regs_msip, &regs_ssip, &regs_mtime});
+	register_map.build();
+	for (auto reg : register_map.get_ranges())
 		reg->alignment = 4;
 
-	regs_mtimecmp.post_write_callback = std::bind(&RealCLINT::post_write_mtimecmp, this, std::placeholders::_1);
-	regs_msip.post_write_callback = std::bind(&RealCLINT::post_write_msip, this, std::placeholders::_1);
-	regs_ssip.post_write_callback = std::bind(&RealCLINT::post_write_ssip, this, std::placeholders::_1);
+	regs_mtimecmp.post_write_callback = vp::mm::bind<&RealCLINT::post_write_mtimecmp>(this);
+	regs_msip.post_write_callback = vp::mm::bind<&RealCLINT::post_write_msip>(this);
+	regs_ssip.post_write_callback = vp::mm::bind<&RealCLINT::post_write_ssip>(this);
 
-	regs_mtime.pre_read_callback = std::bind(&RealCLINT::pre_read_mtime, this, std::placeholders::_1);
-	regs_mtime.post_write_callback = std::bind(&RealCLINT::post_write_mtime, this, std::placeholders::_1);
+	regs_mtime.pre_read_callback = vp::mm::bind<&RealCLINT::pre_read_mtime>(this);
+	regs_mtime.post_write_callback = vp::mm::bind<&RealCLINT::post_write_mtime>(this);
 
 	first_mtime = std::chrono::high_resolution_clock::now();
 	tsock.register_b_transport(this, &RealCLINT::transport);
@@ -93,21 +94,34 @@ RealCLINT::usecs RealCLINT::ticks_to_usec(uint64_t ticks) {
 	return usecs(ticks * DIVIDEND);
 }
 
-void RealCLINT::post_write_mtimecmp(RegisterRange::WriteInfo info) {
-	assert(info.addr % 4 == 0);
-	unsigned hart = info.addr / MTIMECMP_SIZE;
+Timer *RealCLINT::get_timer(unsigned hart, unsigned level) {
+	return timers.at(hart * NUM_LEVELS + level);
+}
 
-	uint64_t cmp = mtimecmp.at(hart);
-	uint64_t time = update_and_get_mtime();
+uint64_t RealCLINT::get_compare_level(unsigned hart, unsigned level) {
+	if (compare_levels[level] == MachineMode)
+		return mtimecmp.at(hart);
+	return harts.at(hart)->get_xtimecmp_level_csr(compare_levels[level]);
+}
 
-	Timer *timer = timers.at(hart);
+void RealCLINT::update_compare_level(unsigned hart, unsigned level) {
+	PrivilegeLevel priv = compare_levels[level];
+	Timer *timer = get_timer(hart, level);
 	timer->pause();
 
+	if (!harts.at(hart)->is_timer_compare_level_exists(priv)) {
+		harts.at(hart)->trigger_timer_interrupt(false, priv);
+		return;
+	}
+
+	uint64_t cmp = get_compare_level(hart, level);
+	uint64_t time = update_and_get_mtime();
+
 	if (time >= cmp) {
-		harts.at(hart)->trigger_timer_interrupt(true, MachineMode);
+		harts.at(hart)->trigger_timer_interrupt(true, priv);
 		return;
 	}
-	harts.at(hart)->trigger_timer_interrupt(false, MachineMode);
+	harts.at(hart)->trigger_timer_interrupt(false, priv);
 
 	uint64_t goal_ticks = cmp - time;
 	usecs duration = ticks_to_usec(goal_ticks);
@@ -115,7 +129,25 @@ void RealCLINT::post_write_mtimecmp(RegisterRange::WriteInfo info) {
 	timer->start(duration);
 }
 
-void RealCLINT::post_write_msip(RegisterRange::WriteInfo info) {
+void RealCLINT::post_write_mtimecmp(const RegisterRange::WriteInfo &info) {
+	assert(info.addr % 4 == 0);
+	unsigned hart = info.addr / MTIMECMP_SIZE;
+
+	update_compare_level(hart, 0);
+}
+
+void RealCLINT::post_write_xtimecmp(clint_interrupt_target *hart, PrivilegeLevel level) {
+	for (size_t i = 0; i < harts.size(); i++) {
+		if (harts.at(i) != hart)
+			continue;
+		for (unsigned l = 0; l < NUM_LEVELS; l++) {
+			if (compare_levels[l] == level)
+				update_compare_level(i, l);
+		}
+	}
+}
+
+void RealCLINT::post_write_msip(const RegisterRange::WriteInfo &info) {
 	assert(info.addr % 4 == 0);
 	unsigned hart = info.addr / MSIP_SIZE;
 
@@ -123,7 +155,7 @@ void RealCLINT::post_write_msip(RegisterRange::WriteInfo info) {
 	harts.at(hart)->trigger_software_interrupt(msip.at(hart) != 0, MachineMode);
 }
 
-void RealCLINT::post_write_ssip(RegisterRange::WriteInfo info) {
+void RealCLINT::post_write_ssip(const RegisterRange::WriteInfo &info) {
 	assert(info.addr % 4 == 0);
 	unsigned hart = info.addr / SSIP_SIZE;
 
@@ -131,7 +163,7 @@ void RealCLINT::post_write_ssip(RegisterRange::WriteInfo info) {
 	harts.at(hart)->trigger_software_interrupt(ssip.at(hart) != 0, SupervisorMode);
 }
 
-void RealCLINT::post_write_mtime(RegisterRange::WriteInfo info) {
+void RealCLINT::post_write_mtime(const RegisterRange::WriteInfo &info) {
 	/* TODO:
 	 *  1. Adjust first_mtime to reflect new mtime register value.
 	 *  2. Notify asyncEvent to check if a timmer intr must be raised.
@@ -139,7 +171,7 @@ void RealCLINT::post_write_mtime(RegisterRange::WriteInfo info) {
 	(void)info;
 }
 
-bool RealCLINT::pre_read_mtime(RegisterRange::ReadInfo info) {
+bool RealCLINT::pre_read_mtime(const RegisterRange::ReadInfo &info) {
 	(void)info;
 
 	update_and_get_mtime();
@@ -150,12 +182,16 @@ void RealCLINT::interrupt(void) {
 	update_and_get_mtime();
 
 	for (size_t i = 0; i < harts.size(); i++) {
-		auto cmp = mtimecmp.at(i);
-		if (mtime >= cmp)
-			harts.at(i)->trigger_timer_interrupt(true, MachineMode);
+		for (unsigned l = 0; l < NUM_LEVELS; l++) {
+			if (!harts.at(i)->is_timer_compare_level_exists(compare_levels[l]))
+				continue;
+			auto cmp = get_compare_level(i, l);
+			if (mtime >= cmp)
+				harts.at(i)->trigger_timer_interrupt(true, compare_levels[l]);
+		}
 	}
 }
 
 void RealCLINT::transport(tlm::tlm_generic_payload &trans, sc_core::sc_time &delay) {
-	vp::mm::route("RealCLINT", register_ranges, trans, delay);
+	register_map.route(trans, delay);
 }
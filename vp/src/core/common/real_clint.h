@@ -28,6 +28,7 @@ public:
 
 	tlm_utils::simple_target_socket<RealCLINT> tsock;
 	uint64_t update_and_get_mtime(void) override;
+	void post_write_xtimecmp(clint_interrupt_target *hart, PrivilegeLevel level) override;
 
 	SC_HAS_PROCESS(RealCLINT);
 public:
@@ -44,23 +45,30 @@ public:
 	ArrayView<uint64_t> mtimecmp;
 	IntegerView<uint64_t> mtime;
 
-	std::vector<RegisterRange*> register_ranges;
+	vp::mm::RegisterMap register_map{"RealCLINT"};
 	std::vector<clint_interrupt_target*> &harts;
 
+	static constexpr unsigned NUM_LEVELS = 3;
+	static constexpr PrivilegeLevel compare_levels[NUM_LEVELS] = {MachineMode, SupervisorMode, VirtualSupervisorMode};
+
 	AsyncEvent event;
-	std::vector<Timer*> timers;
+	std::vector<Timer*> timers; // one per hart and compare level, see *get_timer*
 
 	time_point first_mtime;
 
-	void post_write_mtimecmp(RegisterRange::WriteInfo info);
-	void post_write_msip(RegisterRange::WriteInfo info);
-	void post_write_ssip(RegisterRange::WriteInfo info);
-	void post_write_mtime(RegisterRange::WriteInfo info);
-	bool pre_read_mtime(RegisterRange::ReadInfo info);
+	void post_write_mtimecmp(const RegisterRange::WriteInfo &info);
+	void post_write_msip(const RegisterRange::WriteInfo &info);
+	void post_write_ssip(const RegisterRange::WriteInfo &info);
+	void post_write_mtime(const RegisterRange::WriteInfo &info);
+	bool pre_read_mtime(const RegisterRange::ReadInfo &info);
 
 	uint64_t usec_to_ticks(usecs usec);
 	usecs ticks_to_usec(uint64_t ticks);
 
+	Timer *get_timer(unsigned hart, unsigned level);
+	uint64_t get_compare_level(unsigned hart, unsigned level);
+	void update_compare_level(unsigned hart, unsigned level);
+
 	void interrupt(void);
 	void transport(tlm::tlm_generic_payload &trans, sc_core::sc_time &delay);
 };
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include "smpu_mem_if.h"
 
 using namespace rv32;
@@ -24,6 +27,47 @@ class GenericSMPU {
         RET_ATTRIBUTES_ERROR = -1
     };
 
+    enum {
+        /* Values >= 0 are the index of the only matching region */
+        SMPU_SEGMENT_NO_MATCH = -1,
+        SMPU_SEGMENT_MULTIPLE_MATCHES = -2
+    };
+
+    /* The regions of one SMPU table compiled into sorted segments which cover the whole 32-bit address space. All
+     * addresses of a segment lie in the same set of enabled regions, hence an access within one segment can neither
+     * partially match a region nor cross the border of a translated one and its result only depends on the segment.
+     * The table is rebuilt lazily when the region mask changes or after an smpuaddr/smpuconf write (see
+     * *clear_smpu_cache*). Accesses crossing a segment border take the linear scan of *find_matching_entry*. */
+    struct smpu_region_str {
+        bool translated;
+        uint32_t mask;      /* translated: the bits taken from the virtual address */
+        uint64_t paddr;     /* translated: the physical base including the PAX bits */
+        int attr[2];        /* converted attributes for SUM (level 1) or hstatus.VSUM (level 2) = 0 and 1 */
+    };
+
+    struct smpu_segment_str {
+        uint32_t start, end; /* [start, end] */
+        int region;
+    };
+
+    struct smpu_table_str {
+        bool valid = false;
+        bool usable = false; /* false if a protected region wraps around, linear scan only */
+        uint32_t smpumask = 0;
+        smpu_region_str regions[SMPU_NREGIONS];
+        std::vector<smpu_segment_str> segments;
+        smpu_segment_str last_hit[MAX_MEM_ACCESS_TYPES]; /* the segment of the last access per type */
+    };
+
+    enum {
+        SMPU_TABLE_S = 0,
+        SMPU_TABLE_H,
+        SMPU_TABLE_VS, /* one per guest */
+        SMPU_TABLES_SZ = SMPU_TABLE_VS + iss_config::MAX_GUEST
+    };
+
+    smpu_table_str smpu_tables[SMPU_TABLES_SZ];
+
     int inline convert_attr(int attr, PrivilegeLevel mode)
     {
         bool sum_bit;
@@ -33,6 +77,11 @@ class GenericSMPU {
         else
             sum_bit = core.csrs.mstatus.fields.sum;
 
+        return convert_attr_s(attr, sum_bit);
+    }
+
+    static int convert_attr_s(int attr, bool sum_bit)
+    {
         /* Special case #0 */
         if (!(attr & SMPU_R_FLAG) && (attr & SMPU_W_FLAG) && !(attr & SMPU_X_FLAG)) {
             /* RWX=010 */
@@ -73,7 +122,11 @@ class GenericSMPU {
 
     int inline convert_attr_hs(int attr)
     {
-        bool sum_bit = core.csrs.hstatus.fields.vsum;
+        return convert_attr_hs(attr, core.csrs.hstatus.fields.vsum);
+    }
+
+    static int convert_attr_hs(int attr, bool sum_bit)
+    {
         bool uflag = attr & SMPU_U_FLAG;
 
         attr &= SMPU_R_FLAG | SMPU_W_FLAG | SMPU_X_FLAG;
@@ -231,6 +284,119 @@ class GenericSMPU {
         return ret_attr;
     }
 
+    void build_table(smpu_table_str &table, struct icsr_smpuaddr *smpuaddr, struct icsr_smpuconf *smpuconf,
+                uint32_t smpumask, SmpuLevel level)
+    {
+        uint64_t start_addr[SMPU_NREGIONS], end_addr[SMPU_NREGIONS]; /* [start, end] */
+        std::vector<uint64_t> bounds = {0, 1ULL << 32};
+        int ii;
+
+        table.valid = true;
+        table.usable = true;
+        table.smpumask = smpumask;
+        table.segments.clear();
+        for (auto &hit : table.last_hit)
+            hit = {1, 0, SMPU_SEGMENT_NO_MATCH}; /* empty */
+
+        for (ii = 0; ii < SMPU_NREGIONS; ii++) {
+            smpu_region_str &region = table.regions[ii];
+            int attr = smpuconf[ii].get_attr();
+
+            if ((smpumask & (1 << ii)) == 0)
+                continue;
+
+            region.translated = smpuaddr[ii].is_translated_region();
+            if (region.translated) {
+                uint32_t n = smpuaddr[ii].get_n();
+
+                region.mask = (1U << n) - 1;
+                region.paddr = (smpuconf[ii].get_paddr() & ~region.mask) | ((uint64_t)smpuconf[ii].get_pax() << 32ULL);
+                start_addr[ii] = smpuaddr[ii].checked_read() & ~region.mask;
+                end_addr[ii] = start_addr[ii] + region.mask;
+            } else {
+                start_addr[ii] = smpuaddr[ii].get_addr();
+                end_addr[ii] = start_addr[ii] + smpuconf[ii].get_size();
+                if (end_addr[ii] > UINT32_MAX) {
+                    /* the linear scan compares against the wrapped end address */
+                    table.usable = false;
+                    return;
+                }
+            }
+
+            for (int sum = 0; sum < 2; sum++)
+                region.attr[sum] = level == SMPU_LEVEL_1 ? convert_attr_s(attr, sum) : convert_attr_hs(attr, sum);
+
+            /* RWX=000 regions never match but still cause misaligned exceptions at their borders */
+            bounds.push_back(start_addr[ii]);
+            bounds.push_back(end_addr[ii] + 1);
+        }
+
+        std::sort(bounds.begin(), bounds.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+        for (size_t jj = 0; jj + 1 < bounds.size(); jj++) {
+            smpu_segment_str segment = {(uint32_t)bounds[jj], (uint32_t)(bounds[jj + 1] - 1), SMPU_SEGMENT_NO_MATCH};
+
+            for (ii = 0; ii < SMPU_NREGIONS; ii++) {
+                if ((smpumask & (1 << ii)) == 0 || (smpuconf[ii].get_attr() & (SMPU_R_FLAG | SMPU_W_FLAG | SMPU_X_FLAG)) == 0)
+                    continue;
+                if (segment.start < start_addr[ii] || segment.end > end_addr[ii])
+                    continue;
+
+                if (segment.region != SMPU_SEGMENT_NO_MATCH) {
+                    segment.region = SMPU_SEGMENT_MULTIPLE_MATCHES;
+                    break;
+                }
+                segment.region = ii;
+            }
+            table.segments.push_back(segment);
+        }
+    }
+
+    /* Same result as *find_matching_entry* using the compiled *table* */
+    int inline lookup_matching_entry(smpu_table_str &table, uint64_t *addr, uint32_t sz, MemoryAccessType type,
+                struct icsr_smpuaddr *smpuaddr, struct icsr_smpuconf *smpuconf,
+                uint32_t smpumask, SmpuLevel level, PrivilegeLevel mode)
+    {
+        uint32_t start_op = *addr;
+        uint32_t end_op = *addr + sz - 1;
+        bool sum_bit;
+
+        if (!table.valid || table.smpumask != smpumask)
+            build_table(table, smpuaddr, smpuconf, smpumask, level);
+
+        if (!table.usable || end_op < start_op)
+            return find_matching_entry(addr, sz, type, smpuaddr, smpuconf, smpumask, level, mode);
+
+        smpu_segment_str &hit = table.last_hit[type];
+        if (start_op < hit.start || end_op > hit.end) {
+            auto segment = std::upper_bound(table.segments.begin(), table.segments.end(), start_op,
+                [](uint32_t addr, const smpu_segment_str &s) { return addr < s.start; }) - 1;
+
+            if (end_op > segment->end)
+                return find_matching_entry(addr, sz, type, smpuaddr, smpuconf, smpumask, level, mode);
+            hit = *segment;
+        }
+
+        if (hit.region == SMPU_SEGMENT_NO_MATCH)
+            return RET_ATTRIBUTES_ZERO;
+        if (hit.region == SMPU_SEGMENT_MULTIPLE_MATCHES)
+            return RET_ATTRIBUTES_ERROR;
+
+        const smpu_region_str &region = table.regions[hit.region];
+        if (region.translated)
+            *addr = (*addr & region.mask) | region.paddr; /* Changing VA->PA */
+
+        if (level == SMPU_LEVEL_2)
+            sum_bit = core.csrs.hstatus.fields.vsum;
+        else if (mode == VirtualSupervisorMode || mode == VirtualUserMode)
+            sum_bit = core.csrs.vsstatus.fields.sum;
+        else
+            sum_bit = core.csrs.mstatus.fields.sum;
+
+        return region.attr[sum_bit];
+    }
+
     bool inline is_access_allowed_for_su(int attr, MemoryAccessType type,
         PrivilegeLevel mode, bool is_hlvx_access, SmpuLevel level)
     {
@@ -303,6 +469,12 @@ public:
 
     GenericSMPU(RVX_ISS &core): core(core), quantum_keeper(core.quantum_keeper){}
 
+    /* Drop the compiled region tables after an smpuaddr/smpuconf or hmpuaddr/hmpuconf write of any guest */
+    void clear_smpu_cache(void) {
+        for (auto &table : smpu_tables)
+            table.valid = false;
+    }
+
     bool do_phy_address_check(PrivilegeLevel mode, uint64_t *pa_va_ddr, uint32_t sz,
         MemoryAccessType type, SmpuLevel level = SMPU_LEVEL_1, bool is_hlvx_access = false)
     {
@@ -330,7 +502,8 @@ public:
                     raise_exception(level, type, virt_addr); /* VU-mode memory access is denied for any memory operation address */
             }
 
-            attr = find_matching_entry(pa_va_ddr, sz, type, core.icsrs_vs.bank[current_guest].smpuaddr,
+            attr = lookup_matching_entry(smpu_tables[SMPU_TABLE_VS + current_guest], pa_va_ddr, sz, type,
+                core.icsrs_vs.bank[current_guest].smpuaddr,
                 core.icsrs_vs.bank[current_guest].smpuconf, core.csrs.vsmpumask.reg, level, mode);
         } else if (level == SMPU_LEVEL_2 && (mode == SupervisorMode || mode == UserMode)) {
             /* Level 2 doesn't control S-mode and U-mode operations */
@@ -348,7 +521,8 @@ public:
                     raise_exception(level, type, virt_addr); /* VU-mode memory access is denied for any memory operation address */
             }
 
-            attr = find_matching_entry(pa_va_ddr, sz, type, core.icsrs_s.hmpuaddr, core.icsrs_s.hmpuconf,
+            attr = lookup_matching_entry(smpu_tables[SMPU_TABLE_H], pa_va_ddr, sz, type,
+                    core.icsrs_s.hmpuaddr, core.icsrs_s.hmpuconf,
                     core.csrs.hmpumask.reg, level, mode);
         } else if (level == SMPU_LEVEL_1) {
             /* The satp.MODE = BARE(0) enables the S-mode MPU for all S-mode and U-mode operations */
@@ -363,7 +537,7 @@ public:
                     raise_exception(level, type, virt_addr); /* U-mode memory access is denied for any memory operation address */
             }
 
-            attr = find_matching_entry(pa_va_ddr, sz, type, core.icsrs_s.smpuaddr,
+            attr = lookup_matching_entry(smpu_tables[SMPU_TABLE_S], pa_va_ddr, sz, type, core.icsrs_s.smpuaddr,
                 core.icsrs_s.smpuconf, core.csrs.smpumask.reg, level, mode);
         } else
             throw std::runtime_error("[smpu] unexpected level/mode pair");
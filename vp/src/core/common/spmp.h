@@ -1,5 +1,8 @@
 #pragma once
 
+#include <algorithm>
+#include <vector>
+
 #include "spmp_mem_if.h"
 
 struct spmpcfg {
@@ -33,115 +36,227 @@ class GenericSPMP {
 
     static constexpr int SPMP_ENTRIES = 64; /* 0, 16 or 64 */
     static constexpr int SPMP_MODES_SZ = 4; /* MachineMode = 3, SupervisorMode = 1, UserMode = 0 */
-
-    struct spmp_cache_entry_str {
-        uint64_t rgn_start_addr, rgn_end_addr;
-        bool entry_valid;
-        spmp_cache_entry_str(): rgn_start_addr(0), rgn_end_addr(0), entry_valid(false) {}
+    static constexpr int SPMP_CACHE_WAYS = 4;
+
+    /* The SPMP entries compiled into sorted, non-overlapping intervals which cover the whole address space. Each
+     * interval is owned by the lowest-numbered active entry matching it (SPMP_ENTRIES if none) and holds the access
+     * types allowed for the U and S mode, for both values of mstatus.SUM. The table is rebuilt lazily on the first
+     * check after a spmpcfg/spmpaddr/spmpswitch write (see *clear_spmp_cache*). */
+    struct spmp_interval_str {
+        uint64_t start, end; /* [start, end) */
+        int entry;
+        uint8_t allowed[2][SupervisorMode + 1]; /* [sum][mode], bit (1 << type) set if allowed */
     };
 
-    spmp_cache_entry_str spmp_cache[SPMP_MODES_SZ][MAX_MEM_ACCESS_TYPES];
+    std::vector<spmp_interval_str> spmp_intervals;
+    bool spmp_intervals_valid = false;
+
+    /* O(1) lookup for the common case: the interval of every page below the last finite interval bound (at most
+     * SPMP_PAGE_MAP_SZ pages), SPMP_PAGE_SPLIT if the page contains several intervals (binary search then). Pages
+     * above lie in the last interval. */
+    static constexpr unsigned SPMP_PAGE_SHIFT = 12;
+    static constexpr size_t SPMP_PAGE_MAP_SZ = 1 << 16;
+    static constexpr uint16_t SPMP_PAGE_SPLIT = UINT16_MAX;
+    std::vector<uint16_t> spmp_page_map;
+    uint64_t spmp_page_map_end = 0; /* first address not covered by the page map */
 
-    enum {
-        SPMP_MATCHING_YES = 1,
-        SPMP_MATCHING_NO = 0,
-        SPMP_MATCHING_PARTIAL = -1
+    /* Recently used intervals with a successful access (round robin replacement), an empty range if invalid */
+    struct spmp_cache_entry_str {
+        uint64_t rgn_start_addr, rgn_end_addr;
+        spmp_cache_entry_str(): rgn_start_addr(0), rgn_end_addr(0) {}
     };
 
-    inline int check_matching (uint64_t addr, uint64_t end, uint64_t start_addr, uint64_t end_addr)
-    {
-        if (addr >= start_addr && end < end_addr) {
-            return SPMP_MATCHING_YES;
-        } else if ((addr >= start_addr && addr < end_addr) || (end >= start_addr && end < end_addr)) {
-            /* The lowest-numbered SPMP entry that matches any byte of
-             * an access determines whether that access succeeds or fails.
-             */
-            return SPMP_MATCHING_PARTIAL;
-        }
-        return SPMP_MATCHING_NO;
-    }
+    spmp_cache_entry_str spmp_cache[SPMP_MODES_SZ][MAX_MEM_ACCESS_TYPES][SPMP_CACHE_WAYS];
+    uint8_t spmp_cache_next[SPMP_MODES_SZ][MAX_MEM_ACCESS_TYPES] = {};
+    bool spmp_cache_sum = false; /* mstatus.SUM the cache has been filled with */
 
-    int inline find_matching_entry(uint64_t addr, uint32_t sz, struct spmpcfg *cfg,
-                uint64_t *rgn_start_addr, uint64_t *rgn_end_addr)
+    /* Decodes the address range [start_addr, end_addr) of entry ii, returns false if the entry is off or matches no
+     * addresses */
+    bool decode_entry(int ii, struct spmpcfg *cfg, uint64_t *start_addr, uint64_t *end_addr)
     {
-        int ii, jj;
-        uint64_t start_addr, end_addr;
+        int jj;
         uint64_t val, mask;
-        uint64_t end;
-        int rv;
 
-        end = addr + sz - 1;
-        addr &= ~0x3ULL;
-        end  &= ~0x3ULL;
+        cfg->reg = core.csrs.spmpcfg[ii >> 2].reg;
+        cfg->reg >>= (ii & 0x3) * 8;
 
-        for (ii = 0; ii < SPMP_ENTRIES; ii++) {
-            cfg->reg = core.csrs.spmpcfg[ii >> 2].reg;
-            cfg->reg >>= (ii & 0x3) * 8;
+        if (cfg->fields.A0 == ADDRMATCH_OFF)
+            return false;
 
-            if (cfg->fields.A0 == ADDRMATCH_OFF)
-                continue;
+        val = core.csrs.spmpswitch[0].reg;
+        val |= (uint64_t)core.csrs.spmpswitch[1].reg << 32ULL;
+        if ((val & (1ULL << ii)) == 0)
+            return false;
+
+        if (cfg->fields.A0 == ADDRMATCH_TOR) {
+            if (ii != 0)
+                *start_addr = core.csrs.spmpaddr[ii - 1].reg << 2;
+            else
+                *start_addr = 0;
+
+            *end_addr = core.csrs.spmpaddr[ii].reg << 2;
+
+            /* PMP entry ii matches no addresses if start_addr >= end_addr */
+            return *start_addr < *end_addr;
+        } else if (cfg->fields.A0 == ADDRMATCH_NAPOT) {
+            val = core.csrs.spmpaddr[ii].reg;
+
+            /* Finding the least significant zero bit in the address */
+            for (jj = 0; jj < (int)(sizeof(uint32_t) * 8); jj++) {
+                if (((val >> jj) & 0x1) == 0)
+                    break;
+            }
+            mask = 1ULL << (jj + 1); /* The size of the NAPOT range: 4*(2^(jj+1)) */
+            *end_addr = mask << 2; /* Now end_addr = NAPOT range size */
+            mask -= 1; /* Form the mask of NAPOT range */
+            *start_addr = (val & ~mask) << 2; /* Calculating the start addres of the range */
+            *end_addr += *start_addr; /* Calculating the end addres of the range as start address + size */
+            return true;
+        }
 
-            val = core.csrs.spmpswitch[0].reg;
-            val |= (uint64_t)core.csrs.spmpswitch[1].reg << 32ULL;
-            if ((val & (1ULL << ii)) == 0)
+        assert(cfg->fields.A0 == ADDRMATCH_NA4);
+        *start_addr = core.csrs.spmpaddr[ii].reg << 2;
+        *end_addr = *start_addr + 4; /* NA4 is a 4byte range */
+        return true;
+    }
+
+    void build_intervals(void)
+    {
+        struct region {
+            uint64_t start, end;
+            struct spmpcfg cfg;
+            int entry;
+        };
+        std::vector<region> regions;
+        std::vector<uint64_t> bounds = {0};
+
+        for (int ii = 0; ii < SPMP_ENTRIES; ii++) {
+            region r;
+            if (!decode_entry(ii, &r.cfg, &r.start, &r.end))
                 continue;
+            r.entry = ii;
+            regions.push_back(r);
+            bounds.push_back(r.start);
+            bounds.push_back(r.end);
+        }
 
-            if (cfg->fields.A0 == ADDRMATCH_TOR) {
-                if (ii != 0)
-                    start_addr = core.csrs.spmpaddr[ii - 1].reg << 2;
-                else
-                    start_addr = 0;
+        std::sort(bounds.begin(), bounds.end());
+        bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
 
-                end_addr = core.csrs.spmpaddr[ii].reg << 2;
+        spmp_intervals.clear();
+        for (size_t i = 0; i < bounds.size(); i++) {
+            uint64_t start = bounds[i];
+            uint64_t end = i + 1 < bounds.size() ? bounds[i + 1] : UINT64_MAX;
 
-                if (start_addr >= end_addr) {
-                    /* PMP entry ii matches no addresses */
-                    continue;
+            /* regions are ordered by entry, the first one covering the interval owns it */
+            const region *owner = nullptr;
+            for (auto &r : regions) {
+                if (r.start <= start && end <= r.end) {
+                    owner = &r;
+                    break;
                 }
+            }
 
-                rv = check_matching (addr, end, start_addr, end_addr);
-                if (rv == SPMP_MATCHING_YES)
-                    break;
-                else if (rv == SPMP_MATCHING_PARTIAL)
-                    return -1;
-            } else if (cfg->fields.A0 == ADDRMATCH_NAPOT) {
-                val = core.csrs.spmpaddr[ii].reg;
-
-                /* Finding the least significant zero bit in the address */
-                for (jj = 0; jj < (int)(sizeof(uint32_t) * 8); jj++) {
-                    if (((val >> jj) & 0x1) == 0)
-                        break;
+            int entry = owner ? owner->entry : SPMP_ENTRIES;
+            if (!spmp_intervals.empty() && spmp_intervals.back().entry == entry) {
+                spmp_intervals.back().end = end;
+                continue;
+            }
+
+            spmp_interval_str iv = {start, end, entry, {}};
+            for (int sum = 0; sum < 2; sum++) {
+                for (int mode : {UserMode, SupervisorMode}) {
+                    for (int type = 0; type < MAX_MEM_ACCESS_TYPES; type++) {
+                        bool ok;
+                        if (owner)
+                            ok = is_access_allowed(owner->cfg, MemoryAccessType(type), PrivilegeLevel(mode), sum);
+                        else
+                            ok = mode == SupervisorMode; /* no match: allowed for S, denied for U */
+                        iv.allowed[sum][mode] |= ok << type;
+                    }
                 }
-                mask = 1 << (jj + 1); /* The size of the NAPOT range: 4*(2^(jj+1)) */
-                end_addr = mask << 2; /* Now end_addr = NAPOT range size */
-                mask -= 1; /* Form the mask of NAPOT range */
-                start_addr = (val & ~mask) << 2; /* Calculating the start addres of the range */
-                end_addr += start_addr; /* Calculating the end addres of the range as start address + size */
-
-                rv = check_matching (addr, end, start_addr, end_addr);
-                if (rv == SPMP_MATCHING_YES)
-                    break;
-                else if (rv == SPMP_MATCHING_PARTIAL)
-                    return -1;
-            } else if ( cfg->fields.A0 == ADDRMATCH_NA4) {
-                start_addr = core.csrs.spmpaddr[ii].reg << 2;
-                end_addr = start_addr + 4; /* NA4 is a 4byte range */
-
-                rv = check_matching (addr, end, start_addr, end_addr);
-                if (rv == SPMP_MATCHING_YES)
-                    break;
-                else if (rv == SPMP_MATCHING_PARTIAL)
-                    return -1;
             }
+            spmp_intervals.push_back(iv);
+        }
+
+        spmp_page_map.clear();
+        uint64_t last_start = spmp_intervals.back().start;
+        size_t pages = std::min<uint64_t>(((last_start - 1) >> SPMP_PAGE_SHIFT) + 1, SPMP_PAGE_MAP_SZ);
+        if (last_start == 0)
+            pages = 0;
+        size_t idx = 0;
+        for (size_t page = 0; page < pages; page++) {
+            uint64_t start = (uint64_t)page << SPMP_PAGE_SHIFT;
+            uint64_t end = start + (1ULL << SPMP_PAGE_SHIFT);
+            while (spmp_intervals[idx].end <= start)
+                idx++;
+            spmp_page_map.push_back(end <= spmp_intervals[idx].end ? idx : SPMP_PAGE_SPLIT);
         }
+        spmp_page_map_end = last_start <= ((uint64_t)pages << SPMP_PAGE_SHIFT) ? UINT64_MAX
+                                                                              : (uint64_t)pages << SPMP_PAGE_SHIFT;
+
+        spmp_intervals_valid = true;
+    }
+
+    inline const spmp_interval_str &find_interval(uint64_t addr)
+    {
+        if (addr < spmp_page_map_end) {
+            uint64_t page = addr >> SPMP_PAGE_SHIFT;
+            if (page >= spmp_page_map.size())
+                return spmp_intervals.back();
+            if (spmp_page_map[page] != SPMP_PAGE_SPLIT)
+                return spmp_intervals[spmp_page_map[page]];
+        }
+
+        auto it = std::upper_bound(spmp_intervals.begin(), spmp_intervals.end(), addr,
+                                   [](uint64_t a, const spmp_interval_str &iv) { return a < iv.start; });
+        assert(it != spmp_intervals.begin());
+        return *(it - 1);
+    }
+
+    /* Returns the interval of the entry which determines the access [addr, addr + sz) (the one containing its last
+     * word), or nullptr if an entry only matches a part of the access. */
+    inline const spmp_interval_str *find_matching_interval(uint64_t addr, uint64_t sz)
+    {
+        if (!spmp_intervals_valid)
+            build_intervals();
+
+        uint64_t end = addr + sz - 1;
+        addr &= ~0x3ULL;
+        end  &= ~0x3ULL;
+
+        const spmp_interval_str &first = find_interval(addr);
+        if (end < first.end)
+            return &first;
 
-        *rgn_start_addr = start_addr;
-        *rgn_end_addr = end_addr;
+        /* The lowest-numbered SPMP entry that matches any byte of an access determines whether that access
+         * succeeds or fails, it has to match all bytes of the access. */
+        const spmp_interval_str &last = find_interval(end);
+        if (first.entry != last.entry)
+            return nullptr;
+        return &last;
+    }
+
+    inline bool spmp_cache_lookup(PrivilegeLevel mode, MemoryAccessType type, uint64_t addr, uint64_t end)
+    {
+        auto &ways = spmp_cache[mode][type];
+        bool hit = false;
+        /* no early exit, all ways are compared without branches */
+        for (int i = 0; i < SPMP_CACHE_WAYS; i++)
+            hit |= (addr >= ways[i].rgn_start_addr) & (end < ways[i].rgn_end_addr);
+        return hit;
+    }
 
-        return ii;
+    inline void spmp_cache_insert(PrivilegeLevel mode, MemoryAccessType type, uint64_t start, uint64_t end)
+    {
+        auto &next = spmp_cache_next[mode][type];
+        auto &e = spmp_cache[mode][type][next];
+        e.rgn_start_addr = start;
+        e.rgn_end_addr = end;
+        next = (next + 1) % SPMP_CACHE_WAYS;
     }
 
-    bool inline check_rwx_permission(struct spmpcfg cfg, MemoryAccessType type)
+    static bool check_rwx_permission(struct spmpcfg cfg, MemoryAccessType type)
     {
         if (type == FETCH) {
             return cfg.fields.X0;
@@ -154,11 +269,9 @@ class GenericSPMP {
         }
     }
 
-    bool inline is_access_allowed(struct spmpcfg cfg, MemoryAccessType type)
+    static bool is_access_allowed(struct spmpcfg cfg, MemoryAccessType type, PrivilegeLevel mode, bool sum_bit)
     {
         bool s_bit = cfg.fields.S0;
-        bool sum_bit = core.csrs.mstatus.fields.sum;
-        auto mode = core.prv;
 
         if (s_bit == 0) {
             /* U-mode only rule, is enforced on User modes and denied/enforced
@@ -248,13 +361,13 @@ public:
 
     void clear_spmp_cache(void) {
         memset(spmp_cache, 0, sizeof(spmp_cache));
+        memset(spmp_cache_next, 0, sizeof(spmp_cache_next));
+        /* called before the CSR write takes effect, hence rebuilt on the next check */
+        spmp_intervals_valid = false;
     }
 
     bool do_phy_address_check(PrivilegeLevel mode, uint64_t paddr, uint32_t sz, MemoryAccessType type)
     {
-        struct spmpcfg cfg;
-        uint64_t rgn_start_addr, rgn_end_addr;
-
         if (core.csrs.satp.fields.mode) // 1 means VM enabled
             return false;               // Page-based 32-bit virtual addressing only
 
@@ -267,47 +380,60 @@ public:
         if (mode == MachineMode)
             return true;
 
-        /* Check last cached access the same as new */
-        if (spmp_cache[mode][type].entry_valid) {
-            uint64_t start_addr = paddr & ~0x3ULL;
-            uint64_t end_addr   = (paddr + sz - 1) & ~0x3ULL;
-            if (start_addr >= spmp_cache[mode][type].rgn_start_addr &&
-                        end_addr < spmp_cache[mode][type].rgn_end_addr) {
-                /* Cache hit */
-                return true;
-            }
+        bool sum = core.csrs.mstatus.fields.sum;
+        if (sum != spmp_cache_sum) {
+            memset(spmp_cache, 0, sizeof(spmp_cache));
+            spmp_cache_sum = sum;
+        }
+
+        /* Check the recently used regions */
+        uint64_t start_addr = paddr & ~0x3ULL;
+        uint64_t end_addr   = (paddr + sz - 1) & ~0x3ULL;
+        if (spmp_cache_lookup(mode, type, start_addr, end_addr)) {
+            /* Cache hit */
+            return true;
         }
 
         /* Optional timing */
         //quantum_keeper.inc(spmp_access_delay);
 
-        int nentry = find_matching_entry(paddr, sz, &cfg, &rgn_start_addr, &rgn_end_addr);
+        auto iv = find_matching_interval(paddr, sz);
 
-        if (nentry < 0) {
+        if (!iv) {
             /* The matching SPMP entry must match all bytes of an access,
                 or the access fails, irrespective of the S, R, W, and X bits */
             raise_exception(type, paddr);
         }
 
-        /* If the privilege mode of the access is S and no SPMP nentry matches, the access is allowed */
-        if (mode == SupervisorMode && nentry >= SPMP_ENTRIES)
-            return true;
-
-        /* If the privilege mode of the access is U and no SPMP nentry matches,
-         * but at least one SPMP nentry is implemented, the access is denied
-         */
-        if (mode == UserMode && nentry >= SPMP_ENTRIES)
-            raise_exception(type, paddr);
-
-        if (is_access_allowed(cfg, type)) {
-            /* Caching the last successful access */
-            spmp_cache[mode][type].rgn_start_addr = rgn_start_addr;
-            spmp_cache[mode][type].rgn_end_addr = rgn_end_addr;
-            spmp_cache[mode][type].entry_valid = true;
+        /* If no SPMP entry matches, the access is allowed for S-mode and denied for U-mode (at least one SPMP entry
+         * is implemented) */
+        if (iv->allowed[sum][mode] & (1 << type)) {
+            /* Caching the successful access */
+            if (start_addr >= iv->start)
+                spmp_cache_insert(mode, type, iv->start, iv->end);
             return true;
         }
 
         raise_exception(type, paddr);
         return false;
     }
+
+    /* True if *do_phy_address_check* passes for every access of *type* by *mode* that lies within [addr, addr + sz),
+     * i.e. a single SPMP entry (or none at all) covers the whole range. Never raises a trap and does not touch the
+     * cache of the recently used regions. */
+    bool is_range_accessible(PrivilegeLevel mode, uint64_t addr, uint32_t sz, MemoryAccessType type)
+    {
+        if (core.csrs.satp.fields.mode)
+            return false;
+
+        if (mode == VirtualSupervisorMode || mode == VirtualUserMode || mode == MachineMode)
+            return true;
+
+        auto iv = find_matching_interval(addr, sz);
+        /* the range has to be within a single interval, other entries might match in between */
+        if (!iv || addr + sz - 1 >= iv->end || (addr & ~0x3ULL) < iv->start)
+            return false;
+
+        return iv->allowed[core.csrs.mstatus.fields.sum][mode] & (1 << type);
+    }
 };
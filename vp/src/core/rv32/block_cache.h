@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+#include <vector>
+
+#include "core/common/instr.h"
+#include "util/common.h"
+
+namespace rv32 {
+
+struct ISS;
+
+/* Sequence of pre-decoded instructions executed by the block engine (see *ISS::run_block*). A block starts at an
+ * arbitrary instruction and continues over instructions which can neither change the interrupt state nor the
+ * control flow (integer computations). It ends with the first other instruction (branch, jump, load/store, CSR
+ * access, ...), which is part of the block, at the end of the page or once *MAX_OPS* instructions are collected.
+ * Blocks never cross a page, hence the fetch translation/protection check of the first instruction covers the whole
+ * block. Blocks are physically tagged and become invalid whenever the generation of their page in the decoded
+ * instruction cache changes (see *DecodedInstrCache::get_page_generation*). */
+struct BasicBlock {
+	static constexpr unsigned MAX_OPS = 32;
+
+	typedef void (*handler_t)(ISS &);
+	typedef void (*jit_code_t)(int32_t *regs, uint32_t block_pc);
+
+	struct op_t {
+		handler_t exec;
+		Instruction instr;  // compressed instructions are already expanded
+		Opcode::Mapping op;
+		uint8_t length;
+	};
+
+	uint64_t paddr = 0;
+	uint64_t end_paddr = 0;  // physical address of the fall through successor
+	uint64_t generation = 0;  // page generation the block has been built in
+	unsigned num_ops = 0;  // zero if no block can be formed at *paddr* (execute a single step instead)
+	std::array<op_t, MAX_OPS> ops;
+
+	// chaining: last seen fall through (0) and jump/branch target (1) successor block
+	BasicBlock *next[2] = {nullptr, nullptr};
+
+	// translated host code for the first *jit_ops* instructions, see *BlockJit*
+	unsigned exec_count = 0;
+	uint64_t jit_generation = 0;
+	jit_code_t jit_code = nullptr;
+	unsigned jit_ops = 0;
+	unsigned jit_bytes = 0;  // guest code size covered by *jit_code*
+	uint64_t jit_cycles = 0;  // sum of the instruction cycles of the translated instructions
+
+	inline bool is_valid(uint64_t addr, uint64_t page_generation) const {
+		return paddr == addr && generation == page_generation;
+	}
+};
+
+/* Direct mapped cache of basic blocks, indexed by the physical address of the first instruction. */
+struct BlockCache {
+	static constexpr unsigned ENTRIES = 1024;
+
+	BlockCache() : blocks(ENTRIES) {}
+
+	inline BasicBlock *lookup(uint64_t paddr, uint64_t page_generation) {
+		BasicBlock &b = blocks[index(paddr)];
+		if (likely(b.is_valid(paddr, page_generation)))
+			return &b;
+		return nullptr;
+	}
+
+	/* Slot to (re-)build the block starting at *paddr*. */
+	inline BasicBlock &slot(uint64_t paddr) {
+		return blocks[index(paddr)];
+	}
+
+   private:
+	std::vector<BasicBlock> blocks;
+
+	static inline unsigned index(uint64_t paddr) {
+		return (paddr >> 1) % ENTRIES;
+	}
+};
+
+}  // namespace rv32
@@ -3,9 +3,9 @@
 #include <assert.h>
 #include <stdint.h>
 
-#include <stdexcept>
-#include <unordered_map>
+#include <array>
 #include <stack>
+#include <stdexcept>
 
 #include "config.h"
 #include "irq-helpers.h"
@@ -62,6 +62,9 @@ constexpr uint32_t MSTATUSH_MASK = 0b00000000000000000000000011110000;
 constexpr uint32_t SATP_MASK = 0b10000000001111111111111111111111;
 constexpr uint32_t SATP_MODE = 0b10000000000000000000000000000000;
 
+// PPN[1:0] read as zero (16 KiB aligned root page table)
+constexpr uint32_t HGATP_MASK = 0b10011111111111111111111111111100;
+
 constexpr uint32_t FCSR_MASK = 0b11111111;
 
 // 64 bit timer csrs
@@ -576,8 +579,10 @@ struct csr_misa {
 		S = 1 << 18,
 	};
 
+	static constexpr uint32_t DEFAULT_EXTENSIONS = I | M | A | F | C | N | S | H;  // IMACF + NUSH  // TODO: drop N (User-Level Interrupts extension)
+
 	void init() {
-		fields.extensions = I | M | A | F | C | N | S | H;  // IMACF + NUSH  // TODO: drop N (User-Level Interrupts extension)
+		fields.extensions = DEFAULT_EXTENSIONS;
 		fields.wiri = 0;
 		fields.mxl = 1;  // RV32
 	}
@@ -589,6 +594,7 @@ constexpr unsigned F_ISA_EXT = csr_misa::F;
 constexpr unsigned D_ISA_EXT = csr_misa::D;
 constexpr unsigned C_ISA_EXT = csr_misa::C;
 constexpr unsigned H_ISA_EXT = csr_misa::H;
+constexpr unsigned S_ISA_EXT = csr_misa::S;
 
 struct csr_mvendorid {
 	union {
@@ -2065,6 +2071,24 @@ struct iprio_reg {
 	};
 };
 
+/* Dense mapping of one indirectly accessed CSR address space (selected by *xiselect*) to its registers. */
+struct icsr_mapping {
+	static constexpr unsigned NUM_ADDRS = 4096;
+
+	icsr_if *&operator[](unsigned addr) {
+		assert(addr < NUM_ADDRS);
+		return regs[addr];
+	}
+
+	// nullptr if *addr* is not mapped
+	inline icsr_if *find(unsigned addr) const {
+		return addr < NUM_ADDRS ? regs[addr] : nullptr;
+	}
+
+private:
+	std::array<icsr_if *, NUM_ADDRS> regs = {};
+};
+
 struct icsr_iprio_arr {
 	struct icsr_iprio : public icsr_if, public iprio_reg {
 
@@ -2094,7 +2118,7 @@ struct icsr_iprio_arr {
 		uint32_t first_iid;
 	};
 
-	void map(std::unordered_map<unsigned, icsr_if *> & mapping) {
+	void map(icsr_mapping & mapping) {
 		for (unsigned i = 0; i < iprio_csr_arr_size; ++i) {
 			iprio_icsr_regs[i] = icsr_iprio(this, i);
 			mapping[icsr_addr_iprio0 + i] = &iprio_icsr_regs[i];
@@ -2161,7 +2185,7 @@ struct vs_iprio_banks {
 		}
 	}
 
-	void map(std::unordered_map<unsigned, icsr_if *> (& mapping)[csr_hstatus::MAX_VGEIN_BANKS]) {
+	void map(icsr_mapping (& mapping)[csr_hstatus::MAX_VGEIN_BANKS]) {
 		for (unsigned i = 0; i < csr_hstatus::MAX_VGEIN_BANKS; i++) {
 			iprio[i].map(mapping[i]);
 		}
@@ -2302,6 +2326,25 @@ struct csr_smpumask {
 	}
 };
 
+/* Descriptor of a single CSR address, see *csr_table::get_desc*. Accesses without a hook are handled generically:
+ * reads return the *read_mask* bits of *reg* and writes update the *write_mask* bits of *reg*. Accesses with a hook
+ * (side effects, dynamic masks, additional access checks, registers without a plain backing storage) are handled by
+ * *ISS::get_csr_value* and *ISS::set_csr_value*. */
+struct csr_desc {
+	enum : uint8_t {
+		READ_HOOK = 1,
+		WRITE_HOOK = 2,
+	};
+
+	uint32_t *reg = nullptr;  // nullptr if not mapped (only valid with hooks)
+	uint32_t read_mask = 0;
+	uint32_t write_mask = 0;
+	uint16_t virt_addr = 0;  // address accessed instead in VS mode (S CSRs are redirected to the VS CSRs)
+	uint8_t type = 0;        // lowest privilege level with access, CSR address bits [9:8]
+	uint8_t hooks = READ_HOOK | WRITE_HOOK;
+	bool readonly = false;
+};
+
 struct csr_table {
 	csr_timecontrol timecontrol;
 
@@ -2422,132 +2465,203 @@ struct csr_table {
 	// user csrs (see above comment)
 	csr_fcsr fcsr;
 
-	std::unordered_map<unsigned, uint32_t *> register_mapping;
+	static constexpr unsigned NUM_ADDRS = 4096;
+
+	std::array<csr_desc, NUM_ADDRS> desc;
 
 	csr_table() {
 		using namespace csr;
 
-		register_mapping[CYCLE_ADDR] = (uint32_t *)(&cycle.reg);
-		register_mapping[CYCLEH_ADDR] = (uint32_t *)(&cycle.reg) + 1;
-		register_mapping[INSTRET_ADDR] = (uint32_t *)(&instret.reg);
-		register_mapping[INSTRETH_ADDR] = (uint32_t *)(&instret.reg) + 1;
-		register_mapping[MCYCLE_ADDR] = (uint32_t *)(&cycle.reg);
-		register_mapping[MCYCLEH_ADDR] = (uint32_t *)(&cycle.reg) + 1;
-		register_mapping[MINSTRET_ADDR] = (uint32_t *)(&instret.reg);
-		register_mapping[MINSTRETH_ADDR] = (uint32_t *)(&instret.reg) + 1;
-
-		register_mapping[MVENDORID_ADDR] = &mvendorid.reg;
-		register_mapping[MARCHID_ADDR] = &marchid.reg;
-		register_mapping[MIMPID_ADDR] = &mimpid.reg;
-		register_mapping[MHARTID_ADDR] = &mhartid.reg;
-
-		register_mapping[MSTATUS_ADDR] = &mstatus.reg;
-		register_mapping[MSTATUSH_ADDR] = &mstatush.reg;
-		register_mapping[MISA_ADDR] = &misa.reg;
-		register_mapping[MEDELEG_ADDR] = &medeleg.reg;
-		register_mapping[MTVEC_ADDR] = &mtvec.reg;
-		register_mapping[MCOUNTEREN_ADDR] = &mcounteren.reg;
-		register_mapping[MCOUNTINHIBIT_ADDR] = &mcountinhibit.reg;
-
-		register_mapping[MSCRATCH_ADDR] = &mscratch.reg;
-		register_mapping[MEPC_ADDR] = &mepc.reg;
-		register_mapping[MCAUSE_ADDR] = &mcause.reg;
-		register_mapping[MTVAL_ADDR] = &mtval.reg;
-		register_mapping[MTVAL2_ADDR] = &mtval2.reg;
-		register_mapping[MTINST_ADDR] = &mtinst.reg;
-		register_mapping[MTSP_ADDR] = &mtsp.reg;
-
-		register_mapping[MISELECT_ADDR] = &miselect.reg;
-		register_mapping[MIREG_ADDR] = &mireg.reg;
-		register_mapping[MIREG2_ADDR] = &mireg2.reg;
-		register_mapping[MIREG3_ADDR] = &mireg3.reg;
-		register_mapping[MIREG4_ADDR] = &mireg4.reg;
-		register_mapping[MIREG5_ADDR] = &mireg5.reg;
-		register_mapping[MIREG6_ADDR] = &mireg6.reg;
-
-		register_mapping[MTOPI_ADDR] = &mtopi.reg;
-		register_mapping[MTOPEI_ADDR] = &mtopei.reg;
-
-		for (unsigned i = 0; i < 16; ++i) register_mapping[PMPADDR0_ADDR + i] = &pmpaddr[i].reg;
-
-		for (unsigned i = 0; i < 4; ++i) register_mapping[PMPCFG0_ADDR + i] = &pmpcfg[i].reg;
-
-		for (unsigned i = 0; i < 64; ++i) register_mapping[SPMPADDR0_ADDR + i] = &spmpaddr[i].reg;
-
-		for (unsigned i = 0; i < 16; ++i) register_mapping[SPMPCFG0_ADDR + i] = &spmpcfg[i].reg;
-
-		for (unsigned i = 0; i < 2; ++i) register_mapping[SPMPSWITCH0_ADDR + i] = &spmpswitch[i].reg;
-
-		register_mapping[SMPUMASK_ADDR] = &smpumask.reg;
-
-		register_mapping[STVEC_ADDR] = &stvec.reg;
-		register_mapping[SCOUNTEREN_ADDR] = &scounteren.reg;
-		register_mapping[SSCRATCH_ADDR] = &sscratch.reg;
-		register_mapping[SEPC_ADDR] = &sepc.reg;
-		register_mapping[SCAUSE_ADDR] = &scause.reg;
-		register_mapping[STVAL_ADDR] = &stval.reg;
-		register_mapping[SATP_ADDR] = &satp.reg;
-		register_mapping[STSP_ADDR] = &stsp.reg;
-
-		register_mapping[SISELECT_ADDR] = &siselect.reg;
-		register_mapping[SIREG_ADDR] = &sireg.reg;
-		register_mapping[SIREG2_ADDR] = &sireg2.reg;
-		register_mapping[SIREG3_ADDR] = &sireg3.reg;
-		register_mapping[SIREG4_ADDR] = &sireg4.reg;
-		register_mapping[SIREG5_ADDR] = &sireg5.reg;
-		register_mapping[SIREG6_ADDR] = &sireg6.reg;
-
-		register_mapping[STOPI_ADDR] = &stopi.reg;
-		register_mapping[STOPEI_ADDR] = &stopei.reg;
-
-		register_mapping[HSTATUS_ADDR] = &hstatus.reg;
-		register_mapping[HEDELEG_ADDR] = &hedeleg.reg;
-		register_mapping[HCONTEXT_ADDR] = &hcontext.reg;
-		register_mapping[HTSP_ADDR] = &htsp.reg;
-		register_mapping[HGATP_ADDR] = &hgatp.reg;
-		register_mapping[HMPUMASK_ADDR] = &hmpumask.reg;
-		register_mapping[HTVAL_ADDR] = &htval.reg;
-		register_mapping[HTINST_ADDR] = &htinst.reg;
-
-		register_mapping[VSTVEC_ADDR] = &vstvec.reg;
-		register_mapping[VSEPC_ADDR] = &vsepc.reg;
-		register_mapping[VSCAUSE_ADDR] = &vscause.reg;
-		register_mapping[VSTVAL_ADDR] = &vstval.reg;
-		register_mapping[VSSCRATCH_ADDR] = &vsscratch.reg;
-		register_mapping[VSSTATUS_ADDR] = &vsstatus.reg;
-		register_mapping[VSTSP_ADDR] = &vstsp.reg;
-
-		register_mapping[VSISELECT_ADDR] = &vsiselect.reg;
-		register_mapping[VSIREG_ADDR] = &vsireg.reg;
-		register_mapping[VSIREG2_ADDR] = &vsireg2.reg;
-		register_mapping[VSIREG3_ADDR] = &vsireg3.reg;
-		register_mapping[VSIREG4_ADDR] = &vsireg4.reg;
-		register_mapping[VSIREG5_ADDR] = &vsireg5.reg;
-		register_mapping[VSIREG6_ADDR] = &vsireg6.reg;
-
-		register_mapping[VSTOPI_ADDR] = &vstopi.reg;
-		register_mapping[VSTOPEI_ADDR] = &vstopei.reg;
-
-		register_mapping[VSMPUMASK_ADDR] = &vsmpumask.reg;
-		register_mapping[VSATP_ADDR] = &vsatp.reg;
-
-		register_mapping[FCSR_ADDR] = &fcsr.reg;
+		for (unsigned addr = 0; addr < NUM_ADDRS; ++addr) {
+			csr_desc &d = desc[addr];
+			d.type = (addr & CSR_TYPE_MASK) >> CSR_TYPE_SHIFT;
+			d.readonly = ((addr & 0xC00) >> 10) == 3;
+			/* In VS mode we access VS CSRs via S addresses */
+			if (d.type == CSR_TYPE_S)
+				d.virt_addr = (addr & ~CSR_TYPE_MASK) | (CSR_TYPE_HS_VS << CSR_TYPE_SHIFT);
+			else
+				d.virt_addr = addr;
+		}
+
+		map(CYCLE_ADDR, (uint32_t *)(&cycle.reg));
+		map(CYCLEH_ADDR, (uint32_t *)(&cycle.reg) + 1);
+		map(INSTRET_ADDR, (uint32_t *)(&instret.reg));
+		map(INSTRETH_ADDR, (uint32_t *)(&instret.reg) + 1);
+		map(MCYCLE_ADDR, (uint32_t *)(&cycle.reg));
+		map(MCYCLEH_ADDR, (uint32_t *)(&cycle.reg) + 1);
+		map(MINSTRET_ADDR, (uint32_t *)(&instret.reg));
+		map(MINSTRETH_ADDR, (uint32_t *)(&instret.reg) + 1);
+
+		map(MVENDORID_ADDR, &mvendorid.reg);
+		map(MARCHID_ADDR, &marchid.reg);
+		map(MIMPID_ADDR, &mimpid.reg);
+		map(MHARTID_ADDR, &mhartid.reg);
+
+		map(MSTATUS_ADDR, &mstatus.reg, MSTATUS_MASK, MSTATUS_MASK);
+		map(SSTATUS_ADDR, &mstatus.reg, SSTATUS_MASK, SSTATUS_MASK);
+		map(MSTATUSH_ADDR, &mstatush.reg, UINT32_MAX, MSTATUSH_MASK);
+		map(MISA_ADDR, &misa.reg, UINT32_MAX, 0);  // currently, read-only, thus cannot be changed at runtime
+		map(MEDELEG_ADDR, &medeleg.reg);
+		map(MTVEC_ADDR, &mtvec.reg);
+		map(MCOUNTEREN_ADDR, &mcounteren.reg, UINT32_MAX, MCOUNTEREN_MASK);
+		map(MCOUNTINHIBIT_ADDR, &mcountinhibit.reg, UINT32_MAX, MCOUNTINHIBIT_MASK);
+
+		map(MSCRATCH_ADDR, &mscratch.reg);
+		map(MEPC_ADDR, &mepc.reg);
+		map(MCAUSE_ADDR, &mcause.reg);
+		map(MTVAL_ADDR, &mtval.reg);
+		map(MTVAL2_ADDR, &mtval2.reg);
+		map(MTINST_ADDR, &mtinst.reg);
+		map(MTSP_ADDR, &mtsp.reg);
+
+		map(MISELECT_ADDR, &miselect.reg);
+		map(MIREG_ADDR, &mireg.reg);
+		map(MIREG2_ADDR, &mireg2.reg);
+		map(MIREG3_ADDR, &mireg3.reg);
+		map(MIREG4_ADDR, &mireg4.reg);
+		map(MIREG5_ADDR, &mireg5.reg);
+		map(MIREG6_ADDR, &mireg6.reg);
+
+		map(MTOPI_ADDR, &mtopi.reg);
+		map(MTOPEI_ADDR, &mtopei.reg);
+
+		for (unsigned i = 0; i < 16; ++i) map(PMPADDR0_ADDR + i, &pmpaddr[i].reg);
+
+		for (unsigned i = 0; i < 4; ++i) map(PMPCFG0_ADDR + i, &pmpcfg[i].reg);
+
+		for (unsigned i = 0; i < 64; ++i) map(SPMPADDR0_ADDR + i, &spmpaddr[i].reg);
+
+		for (unsigned i = 0; i < 16; ++i) map(SPMPCFG0_ADDR + i, &spmpcfg[i].reg);
+
+		for (unsigned i = 0; i < 2; ++i) map(SPMPSWITCH0_ADDR + i, &spmpswitch[i].reg);
+
+		map(SMPUMASK_ADDR, &smpumask.reg);
+
+		map(STVEC_ADDR, &stvec.reg);
+		map(SCOUNTEREN_ADDR, &scounteren.reg, UINT32_MAX, MCOUNTEREN_MASK);
+		map(SSCRATCH_ADDR, &sscratch.reg);
+		map(SEPC_ADDR, &sepc.reg);
+		map(SCAUSE_ADDR, &scause.reg);
+		map(STVAL_ADDR, &stval.reg);
+		map(SATP_ADDR, &satp.reg);
+		map(STSP_ADDR, &stsp.reg);
+
+		map(SISELECT_ADDR, &siselect.reg, SISELECT_MASK, SISELECT_MASK);
+		map(SIREG_ADDR, &sireg.reg);
+		map(SIREG2_ADDR, &sireg2.reg);
+		map(SIREG3_ADDR, &sireg3.reg);
+		map(SIREG4_ADDR, &sireg4.reg);
+		map(SIREG5_ADDR, &sireg5.reg);
+		map(SIREG6_ADDR, &sireg6.reg);
+
+		map(STOPI_ADDR, &stopi.reg);
+		map(STOPEI_ADDR, &stopei.reg);
+
+		map(HSTATUS_ADDR, &hstatus.reg);
+		map(HEDELEG_ADDR, &hedeleg.reg, UINT32_MAX, HEDELEG_MASK);
+		map(HCONTEXT_ADDR, &hcontext.reg);
+		map(HTSP_ADDR, &htsp.reg);
+		map(HGATP_ADDR, &hgatp.reg);
+		map(HMPUMASK_ADDR, &hmpumask.reg);
+		map(HTVAL_ADDR, &htval.reg);
+		map(HTINST_ADDR, &htinst.reg);
+
+		map(VSTVEC_ADDR, &vstvec.reg);
+		map(VSEPC_ADDR, &vsepc.reg);
+		map(VSCAUSE_ADDR, &vscause.reg);
+		map(VSTVAL_ADDR, &vstval.reg);
+		map(VSSCRATCH_ADDR, &vsscratch.reg);
+		map(VSSTATUS_ADDR, &vsstatus.reg);
+		map(VSTSP_ADDR, &vstsp.reg);
+
+		map(VSISELECT_ADDR, &vsiselect.reg, VSISELECT_MASK, VSISELECT_MASK);
+		map(VSIREG_ADDR, &vsireg.reg);
+		map(VSIREG2_ADDR, &vsireg2.reg);
+		map(VSIREG3_ADDR, &vsireg3.reg);
+		map(VSIREG4_ADDR, &vsireg4.reg);
+		map(VSIREG5_ADDR, &vsireg5.reg);
+		map(VSIREG6_ADDR, &vsireg6.reg);
+
+		map(VSTOPI_ADDR, &vstopi.reg);
+		map(VSTOPEI_ADDR, &vstopei.reg);
+
+		map(VSMPUMASK_ADDR, &vsmpumask.reg);
+		map(VSATP_ADDR, &vsatp.reg);
+
+		map(FCSR_ADDR, &fcsr.reg, FCSR_MASK, FCSR_MASK);
+		/* Accesses handled by the ISS, all not mapped addresses are handled there too */
+		hook(CYCLE_ADDR, csr_desc::READ_HOOK);
+		hook(MCYCLE_ADDR, csr_desc::READ_HOOK);
+		hook(MCYCLEH_ADDR, csr_desc::READ_HOOK);
+		hook(VSTOPI_ADDR, csr_desc::READ_HOOK);
+
+		hook(MSTATUS_ADDR, csr_desc::WRITE_HOOK);
+		hook(SSTATUS_ADDR, csr_desc::WRITE_HOOK);
+		hook(MTVEC_ADDR, csr_desc::WRITE_HOOK);
+		hook(STVEC_ADDR, csr_desc::WRITE_HOOK);
+		hook(VSTVEC_ADDR, csr_desc::WRITE_HOOK);
+		hook(MEPC_ADDR, csr_desc::WRITE_HOOK);
+		hook(SEPC_ADDR, csr_desc::WRITE_HOOK);
+		hook(HSTATUS_ADDR, csr_desc::WRITE_HOOK);
+		hook(MTOPEI_ADDR, csr_desc::WRITE_HOOK);
+
+		hook(SATP_ADDR, csr_desc::READ_HOOK | csr_desc::WRITE_HOOK);
+		hook(VSATP_ADDR, csr_desc::READ_HOOK | csr_desc::WRITE_HOOK);
+		hook(HGATP_ADDR, csr_desc::READ_HOOK | csr_desc::WRITE_HOOK);
+		hook(STOPEI_ADDR, csr_desc::READ_HOOK | csr_desc::WRITE_HOOK);
+		hook(VSTOPEI_ADDR, csr_desc::READ_HOOK | csr_desc::WRITE_HOOK);
+		hook(VSMPUMASK_ADDR, csr_desc::READ_HOOK | csr_desc::WRITE_HOOK);
+
+		for (unsigned addr : {MIREG_ADDR, MIREG2_ADDR, MIREG3_ADDR, MIREG4_ADDR, MIREG5_ADDR, MIREG6_ADDR,
+		                      SIREG_ADDR, SIREG2_ADDR, SIREG3_ADDR, SIREG4_ADDR, SIREG5_ADDR, SIREG6_ADDR,
+		                      VSIREG_ADDR, VSIREG2_ADDR, VSIREG3_ADDR, VSIREG4_ADDR, VSIREG5_ADDR, VSIREG6_ADDR})
+			hook(addr, csr_desc::READ_HOOK | csr_desc::WRITE_HOOK);
+
+		for (unsigned i = 0; i < 64; ++i) hook(SPMPADDR0_ADDR + i, csr_desc::WRITE_HOOK);
+
+		for (unsigned i = 0; i < 16; ++i) hook(SPMPCFG0_ADDR + i, csr_desc::WRITE_HOOK);
+
+		for (unsigned i = 0; i < 2; ++i) hook(SPMPSWITCH0_ADDR + i, csr_desc::WRITE_HOOK);
+	}
+
+	inline const csr_desc &get_desc(unsigned addr) const {
+		assert(addr < NUM_ADDRS);
+		return desc[addr];
 	}
 
 	bool is_valid_csr32_addr(unsigned addr) {
-		return register_mapping.find(addr) != register_mapping.end();
+		return addr < NUM_ADDRS && desc[addr].reg;
 	}
 
 	void default_write32(unsigned addr, uint32_t value) {
-		auto it = register_mapping.find(addr);
-		ensure((it != register_mapping.end()) && "validate address before calling this function");
-		*it->second = value;
+		ensure(is_valid_csr32_addr(addr) && "validate address before calling this function");
+		*desc[addr].reg = value;
 	}
 
 	uint32_t default_read32(unsigned addr) {
-		auto it = register_mapping.find(addr);
-		ensure((it != register_mapping.end()) && "validate address before calling this function");
-		return *it->second;
+		ensure(is_valid_csr32_addr(addr) && "validate address before calling this function");
+		return *desc[addr].reg;
+	}
+
+	static inline uint32_t read32(const csr_desc &d) {
+		return *d.reg & d.read_mask;
+	}
+
+	static inline void write32(const csr_desc &d, uint32_t value) {
+		*d.reg = (*d.reg & ~d.write_mask) | (value & d.write_mask);
+	}
+
+private:
+	void map(unsigned addr, uint32_t *reg, uint32_t read_mask = UINT32_MAX, uint32_t write_mask = UINT32_MAX) {
+		csr_desc &d = desc[addr];
+		d.reg = reg;
+		d.read_mask = read_mask;
+		d.write_mask = write_mask;
+		d.hooks = 0;
+	}
+
+	void hook(unsigned addr, uint8_t hooks) {
+		desc[addr].hooks |= hooks;
 	}
 };
 
@@ -2757,9 +2871,39 @@ constexpr unsigned icsr_addr_hmpuaddr31 = 0x1BE;
 constexpr unsigned icsr_addr_hmpuconf31 = 0x1BF;
 }
 
+inline bool is_hmpuaddr(unsigned addr) {
+	return addr >= icsr::icsr_addr_hmpuaddr0 && addr <= icsr::icsr_addr_hmpuconf31;
+}
+
+/* Bit i is set if eip[i] & eie[i] of an IMSIC interrupt file is non-zero. Together with the eip/eie arrays this forms
+ * a two-level bitmap, the lowest pending and enabled EIID is found with two ctz instead of scanning all words. Updated
+ * on every write of an eip/eie word. */
+struct imsic_pending_summary {
+	static constexpr unsigned SIZE = iss_config::IMSIC_MAX_IRQS / icsr_32::BITS_PER_CSR;
+	static_assert(SIZE <= 64);
+
+	uint64_t words = 0;
+
+	void update(icsr_32 *eip, icsr_32 *eie, unsigned idx) {
+		if (eip[idx].reg & eie[idx].reg)
+			words |= BIT(idx);
+		else
+			words &= ~BIT(idx);
+	}
+
+	void update_for_addr(icsr_32 *eip, icsr_32 *eie, unsigned addr) {
+		using namespace icsr;
+
+		if (addr >= icsr_addr_eip0 && addr < icsr_addr_eip0 + SIZE)
+			update(eip, eie, addr - icsr_addr_eip0);
+		else if (addr >= icsr_addr_eie0 && addr < icsr_addr_eie0 + SIZE)
+			update(eip, eie, addr - icsr_addr_eie0);
+	}
+};
+
 // risc-v inderect CSR access extension(Smcsrind)
 struct icsr_ms_table {
-	std::unordered_map<unsigned, icsr_if *> register_mapping_icsr;
+	icsr_mapping register_mapping_icsr;
 
 	icsr_iprio_arr iprio;
 
@@ -2772,6 +2916,7 @@ struct icsr_ms_table {
 
 	icsr_32 eip[eip_eie_arr_size];
 	icsr_32 eie[eip_eie_arr_size];
+	imsic_pending_summary pending;
 
 	// SMPU extension
 	icsr_smpuaddr smpuaddr[SMPU_NREGIONS];
@@ -2855,19 +3000,20 @@ struct icsr_ms_table {
 	}
 
 	bool is_valid_addr(unsigned addr) {
-		return register_mapping_icsr.find(addr) != register_mapping_icsr.end();
+		return register_mapping_icsr.find(addr) != nullptr;
 	}
 
 	void default_write32(unsigned addr, uint32_t value) {
-		auto it = register_mapping_icsr.find(addr);
-		ensure((it != register_mapping_icsr.end()) && "validate address before calling this function");
-		it->second->checked_write(value);
+		icsr_if *reg = register_mapping_icsr.find(addr);
+		ensure(reg && "validate address before calling this function");
+		reg->checked_write(value);
+		pending.update_for_addr(eip, eie, addr);
 	}
 
 	uint32_t default_read32(unsigned addr) {
-		auto it = register_mapping_icsr.find(addr);
-		ensure((it != register_mapping_icsr.end()) && "validate address before calling this function");
-		return it->second->checked_read();
+		icsr_if *reg = register_mapping_icsr.find(addr);
+		ensure(reg && "validate address before calling this function");
+		return reg->checked_read();
 	}
 };
 
@@ -2886,13 +3032,14 @@ struct icsr_vs_table {
 
 		icsr_32 eip[eip_eie_arr_size];
 		icsr_32 eie[eip_eie_arr_size];
+		imsic_pending_summary pending;
 
 		// SMPU extension
 		icsr_smpuaddr smpuaddr[SMPU_NREGIONS];
 		icsr_smpuconf smpuconf[SMPU_NREGIONS];
 	} bank[iss_config::MAX_GUEST];
 
-	std::unordered_map<unsigned, icsr_if *> register_mapping_icsr[csr_hstatus::MAX_VGEIN_BANKS];
+	icsr_mapping register_mapping_icsr[csr_hstatus::MAX_VGEIN_BANKS];
 
 	icsr_vs_table() {
 		using namespace icsr;
@@ -2920,21 +3067,25 @@ struct icsr_vs_table {
 
 	bool is_valid_addr(unsigned addr, uint32_t vgein) {
 		assert(vgein <= iss_config::MAX_GUEST);
-		return register_mapping_icsr[vgein].find(addr) != register_mapping_icsr[vgein].end();
+		return register_mapping_icsr[vgein].find(addr) != nullptr;
 	}
 
 	void default_write32(unsigned addr, unsigned vgein, uint32_t value) {
 		assert(vgein <= iss_config::MAX_GUEST);
-		auto it = register_mapping_icsr[vgein].find(addr);
-		ensure((it != register_mapping_icsr[vgein].end()) && "validate address before calling this function");
-		it->second->checked_write(value);
+		icsr_if *reg = register_mapping_icsr[vgein].find(addr);
+		ensure(reg && "validate address before calling this function");
+		reg->checked_write(value);
+		if (vgein >= csr_hstatus::VGEIN_FIRST_GUEST) {
+			struct bank &b = get_guest_bank(vgein);
+			b.pending.update_for_addr(b.eip, b.eie, addr);
+		}
 	}
 
 	uint32_t default_read32(unsigned addr, unsigned vgein) {
 		assert(vgein <= iss_config::MAX_GUEST);
-		auto it = register_mapping_icsr[vgein].find(addr);
-		ensure((it != register_mapping_icsr[vgein].end()) && "validate address before calling this function");
-		return it->second->checked_read();
+		icsr_if *reg = register_mapping_icsr[vgein].find(addr);
+		ensure(reg && "validate address before calling this function");
+		return reg->checked_read();
 	}
 
 	struct bank & get_guest_bank(uint32_t vgein) {
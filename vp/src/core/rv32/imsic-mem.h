@@ -3,7 +3,7 @@
 #include <tlm_utils/simple_target_socket.h>
 #include <systemc>
 
-#include "imsic-if.h"
+#include "core/common/irq_if.h"
 #include "util/memory_map.h"
 
 struct ImsicMem : public sc_core::sc_module {
@@ -18,7 +18,7 @@ struct ImsicMem : public sc_core::sc_module {
 	RegisterRange regs_imsic_mmio{0x0, page_size * (1 + 1 + iss_config::MAX_GUEST)};
 	ArrayView<uint32_t> imsic_mmio{regs_imsic_mmio};
 
-	std::vector<RegisterRange *> register_ranges{&regs_imsic_mmio};
+	vp::mm::RegisterMap register_map{"ImsicMem"};
 
 	imsic_mem_target * target_hart;
 
@@ -28,11 +28,14 @@ struct ImsicMem : public sc_core::sc_module {
 		tsock.register_b_transport(this, &ImsicMem::transport);
 
 		regs_imsic_mmio.alignment = 4;
-		regs_imsic_mmio.post_write_callback = std::bind(&ImsicMem::post_write_imsic_mmio, this, std::placeholders::_1);
-		regs_imsic_mmio.pre_read_callback = std::bind(&ImsicMem::pre_read_imsic_mmio, this, std::placeholders::_1);
+		regs_imsic_mmio.post_write_callback = vp::mm::bind<&ImsicMem::post_write_imsic_mmio>(this);
+		regs_imsic_mmio.pre_read_callback = vp::mm::bind<&ImsicMem::pre_read_imsic_mmio>(this);
+
+		register_map.add(regs_imsic_mmio);
+		register_map.build();
 	}
 
-	bool pre_read_imsic_mmio(RegisterRange::ReadInfo t) {
+	bool pre_read_imsic_mmio(const RegisterRange::ReadInfo &t) {
 		assert(t.addr % 4 == 0); // TODO: replace with a bus error
 
 		// A read of seteipnum le or seteipnum be returns zero in all cases.
@@ -45,7 +48,7 @@ struct ImsicMem : public sc_core::sc_module {
 		return true;
 	}
 
-	void post_write_imsic_mmio(RegisterRange::WriteInfo t) {
+	void post_write_imsic_mmio(const RegisterRange::WriteInfo &t) {
 		assert(t.addr % 4 == 0);
 
 		if (t.addr % page_size == 0) {
@@ -72,6 +75,6 @@ struct ImsicMem : public sc_core::sc_module {
 	void transport(tlm::tlm_generic_payload &trans, sc_core::sc_time &delay) {
 		// delay += 2 * clock_cycle;
 
-		vp::mm::route("ImsicMem", register_ranges, trans, delay);
+		register_map.route(trans, delay);
 	}
 };
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "csr.h"
+
+namespace rv32 {
+
+enum class MemoryProtection {
+	Dynamic,  // selected at run time (*ISS::use_spmp*, *ISS::use_smpu* and whether an MMU is attached)
+	None,
+	MMU,
+	SPMP,
+	SMPU,
+};
+
+/* Compile time configuration the ISS (see *ISS::specialize*) and the memory interface (see
+ * *CombinedMemoryInterfaceT*) are specialized for. *Extensions* are the misa extension bits, including the
+ * hypervisor extension (H), the I/E base ISA is still selected at run time. All extension and protection checks of
+ * the instruction and memory access paths become compile time constants. */
+template <uint32_t Extensions, MemoryProtection Protection>
+struct StaticIsaConfig {
+	static constexpr bool is_dynamic = false;
+	static constexpr uint32_t extensions = Extensions;
+	static constexpr MemoryProtection protection = Protection;
+};
+
+/* Generic configuration, all checks are done at run time against misa and the protection settings of the ISS. */
+struct DynamicIsaConfig {
+	static constexpr bool is_dynamic = true;
+	static constexpr uint32_t extensions = 0;
+	static constexpr MemoryProtection protection = MemoryProtection::Dynamic;
+};
+
+// IMAFC + NUSH, see *csr_misa::init*
+typedef StaticIsaConfig<csr_misa::DEFAULT_EXTENSIONS, MemoryProtection::None> Rv32DefaultConfig;
+typedef StaticIsaConfig<csr_misa::DEFAULT_EXTENSIONS, MemoryProtection::MMU> Rv32DefaultMmuConfig;
+typedef StaticIsaConfig<csr_misa::DEFAULT_EXTENSIONS, MemoryProtection::SPMP> Rv32DefaultSpmpConfig;
+typedef StaticIsaConfig<csr_misa::DEFAULT_EXTENSIONS, MemoryProtection::SMPU> Rv32DefaultSmpuConfig;
+// IMAFDC + NUSH, as configured by the linux32 platform
+typedef StaticIsaConfig<csr_misa::DEFAULT_EXTENSIONS | csr_misa::D, MemoryProtection::MMU> Rv32LinuxConfig;
+
+/* Configuration used by a platform which is specialized for *Config*. The generic build (cmake option
+ * RV32_GENERIC_ISA_CONFIG) uses the dynamic configuration everywhere, e.g. to compare the performance. */
+#ifdef RV32_GENERIC_ISA_CONFIG
+template <typename Config>
+using PlatformIsaConfig = DynamicIsaConfig;
+#else
+template <typename Config>
+using PlatformIsaConfig = Config;
+#endif
+
+}  // namespace rv32
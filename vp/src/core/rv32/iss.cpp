@@ -12,7 +12,7 @@ using namespace rv32;
 #define RAISE_ILLEGAL_INSTRUCTION() raise_trap(EXC_ILLEGAL_INSTR, instr.data());
 
 #define REQUIRE_ISA(X)          \
-    if (!(csrs.misa.reg & X))   \
+    if (!has_isa<Config>(X))    \
         RAISE_ILLEGAL_INSTRUCTION()
 
 #define RD instr.rd()
@@ -89,15 +89,14 @@ ISS::ISS(uint32_t hart_id, bool use_E_base_isa) : imsic("ImsicMem", hart_id, thi
 		csrs.misa.select_E_base_isa();
 
 	sc_core::sc_time qt = tlm::tlm_global_quantum::instance().get();
-	cycle_time = sc_core::sc_time(10, sc_core::SC_NS);
 
 	assert(qt >= cycle_time);
 	assert(qt % cycle_time == sc_core::SC_ZERO_TIME);
 
-	for (int i = 0; i < Opcode::NUMBER_OF_INSTRUCTIONS; ++i) instr_cycles[i] = cycle_time;
+	for (int i = 0; i < Opcode::NUMBER_OF_INSTRUCTIONS; ++i) instr_cycles[i] = 1;
 
-	const sc_core::sc_time memory_access_cycles = 4 * cycle_time;
-	const sc_core::sc_time mul_div_cycles = 8 * cycle_time;
+	const uint32_t memory_access_cycles = 4;
+	const uint32_t mul_div_cycles = 8;
 
 	instr_cycles[Opcode::LB] = memory_access_cycles;
 	instr_cycles[Opcode::LBU] = memory_access_cycles;
@@ -116,8 +115,24 @@ ISS::ISS(uint32_t hart_id, bool use_E_base_isa) : imsic("ImsicMem", hart_id, thi
 	instr_cycles[Opcode::REM] = mul_div_cycles;
 	instr_cycles[Opcode::REMU] = mul_div_cycles;
 	op = Opcode::UNDEF;
+
+	run_loop = &ISS::_run<DynamicIsaConfig>;
+}
+
+template <typename Config>
+void ISS::specialize() {
+	if constexpr (!Config::is_dynamic) {
+		constexpr uint32_t base_isa = csr_misa::I | csr_misa::E;
+		csrs.misa.fields.extensions = (csrs.misa.fields.extensions & base_isa) | (Config::extensions & ~base_isa);
+		use_spmp = Config::protection == MemoryProtection::SPMP;
+		use_smpu = Config::protection == MemoryProtection::SMPU;
+	}
+	run_loop = &ISS::_run<Config>;
+	// drop all blocks, they refer to the handlers of the previous configuration
+	decode_cache.flush();
 }
 
+template <typename Config>
 void ISS::hs_inst_check_access(void) {
 	REQUIRE_ISA(H_ISA_EXT);
 
@@ -126,37 +141,83 @@ void ISS::hs_inst_check_access(void) {
 
 	if (prv == UserMode && !csrs.hstatus.fields.hu)
 		raise_trap(EXC_ILLEGAL_INSTR, instr.data());
+}
+
+// HFENCE.VVMA and HFENCE.GVMA, only valid in M-mode and HS-mode
+template <typename Config>
+void ISS::hs_fence_check_access(void) {
+	REQUIRE_ISA(H_ISA_EXT);
+
+	if (prv == VirtualSupervisorMode || prv == VirtualUserMode)
+		raise_trap(EXC_VIRTUAL_INSTRUCTION, instr.data());
 
-	// TODO: Note that hypervisor Virtual-Machine Load and Store instructions
-	// logic is valid only for SPMP/SMPU but not for MMU!
-	assert((csrs.satp.fields.mode != SATP_MODE_BARE ||
-		csrs.hgatp.fields.mode != SATP_MODE_BARE) && "instruction is not compatible with MMU");
+	if (prv == UserMode)
+		raise_trap(EXC_ILLEGAL_INSTR, instr.data());
 }
 
 inline PrivilegeLevel ISS::hs_inst_lvsv_mode(void) {
 	return csrs.hstatus.fields.spvp ? VirtualSupervisorMode : VirtualUserMode;
 }
 
-void ISS::exec_step() {
-	assert(((pc & ~pc_alignment_mask()) == 0) && "misaligned instruction");
+/* *translated_fetch_paddr* is the physical address of *pc*, if it has already been translated (block engine). */
+template <typename Config>
+void ISS::exec_step(std::optional<uint64_t> translated_fetch_paddr) {
+	assert(((pc & ~pc_alignment_mask<Config>()) == 0) && "misaligned instruction");
+
+	// the decoded instruction cache is bypassed in debug mode, as the debugger can modify memory directly
+	bool use_decode_cache = decode_cache.enabled && !debug_mode;
+	DecodedInstrCache::entry_t *cached = nullptr;
+	uint64_t fetch_paddr = 0;
+	bool cacheable = false;
+
+	assert(use_decode_cache || !translated_fetch_paddr);
 
 	try {
-		uint32_t mem_word = instr_mem->load_instr(pc);
-		instr = Instruction(mem_word);
+		if (use_decode_cache) {
+			if (translated_fetch_paddr) {
+				fetch_paddr = *translated_fetch_paddr;
+			} else if (unlikely(!instr_mem->try_translate_instr_addr(pc, fetch_paddr, pending_trap))) {
+				trap_pending = true;
+				op = Opcode::UNDEF;
+				instr = Instruction(0);
+				return;
+			}
+			cached = decode_cache.lookup(fetch_paddr);
+		}
+
+		if (cached) {
+			instr_mem->account_cached_instr_fetch();
+		} else {
+			uint32_t mem_word = use_decode_cache ? instr_mem->load_instr_paddr(fetch_paddr, cacheable)
+			                                     : instr_mem->load_instr(pc);
+			instr = Instruction(mem_word);
+		}
 	} catch (SimulationTrap &e) {
 		op = Opcode::UNDEF;
 		instr = Instruction(0);
 		throw;
 	}
 
-	if (instr.is_compressed()) {
-		op = instr.decode_and_expand_compressed(RV32);
+	if (cached) {
+		instr = cached->instr;
+		op = cached->op;
+		pc += cached->length;
+		if (cached->length == 2)
+			REQUIRE_ISA(C_ISA_EXT);
+	} else if (instr.is_compressed()) {
+		uint32_t mem_word = instr.data();
+		op = instr.decode_and_expand_compressed<RV32>();
 		pc += 2;
+		if (cacheable && op != Opcode::UNDEF)
+			decode_cache.insert(fetch_paddr, mem_word, instr, op, 2);
 		if (op != Opcode::UNDEF)
 			REQUIRE_ISA(C_ISA_EXT);
 	} else {
-		op = instr.decode_normal(RV32);
+		uint32_t mem_word = instr.data();
+		op = instr.decode_normal<RV32>();
 		pc += 4;
+		if (cacheable && op != Opcode::UNDEF)
+			decode_cache.insert(fetch_paddr, mem_word, instr, op, 4);
 	}
 
 	if (trace) {
@@ -208,12 +269,17 @@ void ISS::exec_step() {
 		puts("");
 	}
 
+	execute_op<Config>();
+}
+
+template <typename Config>
+void ISS::execute_op() {
 	switch (op) {
 		case Opcode::UNDEF:
 			if (trace)
 				std::cout << "[ISS] WARNING: unknown instruction '" << std::to_string(instr.data()) << "' at address '"
 				          << std::to_string(last_pc) << "'" << std::endl;
-			raise_trap(EXC_ILLEGAL_INSTR, instr.data());
+			signal_trap(EXC_ILLEGAL_INSTR, instr.data());
 			break;
 
 		case Opcode::ADDI:
@@ -303,126 +369,117 @@ void ISS::exec_step() {
 		case Opcode::JAL: {
 			auto link = pc;
 			pc = last_pc + instr.J_imm();
-			trap_check_pc_alignment();
+			trap_check_pc_alignment<Config>();
 			regs[instr.rd()] = link;
 		} break;
 
 		case Opcode::JALR: {
 			auto link = pc;
 			pc = (regs[instr.rs1()] + instr.I_imm()) & ~1;
-			trap_check_pc_alignment();
+			trap_check_pc_alignment<Config>();
 			regs[instr.rd()] = link;
 		} break;
 
-		case Opcode::SB: {
-			uint32_t addr = regs[instr.rs1()] + instr.S_imm();
-			mem->store_byte(addr, regs[instr.rs2()]);
-		} break;
+		case Opcode::SB:
+			execute_store<uint8_t>();
+			break;
 
-		case Opcode::SH: {
-			uint32_t addr = regs[instr.rs1()] + instr.S_imm();
-			trap_check_addr_alignment<2, false>(addr);
-			mem->store_half(addr, regs[instr.rs2()]);
-		} break;
+		case Opcode::SH:
+			execute_store<uint16_t>();
+			break;
 
-		case Opcode::SW: {
-			uint32_t addr = regs[instr.rs1()] + instr.S_imm();
-			trap_check_addr_alignment<4, false>(addr);
-			mem->store_word(addr, regs[instr.rs2()]);
-		} break;
+		case Opcode::SW:
+			execute_store<uint32_t>();
+			break;
 
-		case Opcode::LB: {
-			uint32_t addr = regs[instr.rs1()] + instr.I_imm();
-			regs[instr.rd()] = mem->load_byte(addr);
-		} break;
+		case Opcode::LB:
+			execute_load<int8_t>();
+			break;
 
-		case Opcode::LH: {
-			uint32_t addr = regs[instr.rs1()] + instr.I_imm();
-			trap_check_addr_alignment<2, true>(addr);
-			regs[instr.rd()] = mem->load_half(addr);
-		} break;
+		case Opcode::LH:
+			execute_load<int16_t>();
+			break;
 
-		case Opcode::LW: {
-			uint32_t addr = regs[instr.rs1()] + instr.I_imm();
-			trap_check_addr_alignment<4, true>(addr);
-			regs[instr.rd()] = mem->load_word(addr);
-		} break;
+		case Opcode::LW:
+			execute_load<int32_t>();
+			break;
 
-		case Opcode::LBU: {
-			uint32_t addr = regs[instr.rs1()] + instr.I_imm();
-			regs[instr.rd()] = mem->load_ubyte(addr);
-		} break;
+		case Opcode::LBU:
+			execute_load<uint8_t>();
+			break;
 
-		case Opcode::LHU: {
-			uint32_t addr = regs[instr.rs1()] + instr.I_imm();
-			trap_check_addr_alignment<2, true>(addr);
-			regs[instr.rd()] = mem->load_uhalf(addr);
-		} break;
+		case Opcode::LHU:
+			execute_load<uint16_t>();
+			break;
 
 		case Opcode::BEQ:
 			if (regs[instr.rs1()] == regs[instr.rs2()]) {
 				pc = last_pc + instr.B_imm();
-				trap_check_pc_alignment();
+				trap_check_pc_alignment<Config>();
 			}
 			break;
 
 		case Opcode::BNE:
 			if (regs[instr.rs1()] != regs[instr.rs2()]) {
 				pc = last_pc + instr.B_imm();
-				trap_check_pc_alignment();
+				trap_check_pc_alignment<Config>();
 			}
 			break;
 
 		case Opcode::BLT:
 			if (regs[instr.rs1()] < regs[instr.rs2()]) {
 				pc = last_pc + instr.B_imm();
-				trap_check_pc_alignment();
+				trap_check_pc_alignment<Config>();
 			}
 			break;
 
 		case Opcode::BGE:
 			if (regs[instr.rs1()] >= regs[instr.rs2()]) {
 				pc = last_pc + instr.B_imm();
-				trap_check_pc_alignment();
+				trap_check_pc_alignment<Config>();
 			}
 			break;
 
 		case Opcode::BLTU:
 			if ((uint32_t)regs[instr.rs1()] < (uint32_t)regs[instr.rs2()]) {
 				pc = last_pc + instr.B_imm();
-				trap_check_pc_alignment();
+				trap_check_pc_alignment<Config>();
 			}
 			break;
 
 		case Opcode::BGEU:
 			if ((uint32_t)regs[instr.rs1()] >= (uint32_t)regs[instr.rs2()]) {
 				pc = last_pc + instr.B_imm();
-				trap_check_pc_alignment();
+				trap_check_pc_alignment<Config>();
 			}
 			break;
 
-		case Opcode::FENCE:
-		case Opcode::FENCE_I: {
+		case Opcode::FENCE: {
 			// not using out of order execution so can be ignored
 		} break;
 
+		case Opcode::FENCE_I: {
+			// memory might have been modified by other harts or bus masters (e.g. DMA)
+			decode_cache.flush();
+		} break;
+
 		case Opcode::ECALL: {
 			if (sys) {
 				sys->execute_syscall(this);
 			} else {
 				switch (prv) {
 					case MachineMode:
-						raise_trap(EXC_ECALL_M_MODE, last_pc);
+						signal_trap(EXC_ECALL_M_MODE, last_pc);
 						break;
 					case VirtualSupervisorMode:
-						raise_trap(EXC_ECALL_VS_MODE, last_pc);
+						signal_trap(EXC_ECALL_VS_MODE, last_pc);
 						break;
 					case SupervisorMode:
-						raise_trap(EXC_ECALL_S_MODE, last_pc);
+						signal_trap(EXC_ECALL_S_MODE, last_pc);
 						break;
 					case VirtualUserMode:
 					case UserMode:
-						raise_trap(EXC_ECALL_U_MODE, last_pc);
+						signal_trap(EXC_ECALL_U_MODE, last_pc);
 						break;
 					default:
 						throw std::runtime_error("unknown privilege level " + std::to_string(prv));
@@ -437,7 +494,7 @@ void ISS::exec_step() {
 
 		case Opcode::CSRRW: {
 			auto addr = instr.csr();
-			if (is_invalid_csr_access(addr, true)) {
+			if (is_invalid_csr_access<Config>(addr, true)) {
 				// TODO: it can be virtual instruction exception
 				RAISE_ILLEGAL_INSTRUCTION();
 			} else {
@@ -455,7 +512,7 @@ void ISS::exec_step() {
 			auto addr = instr.csr();
 			auto rs1 = instr.rs1();
 			auto write = rs1 != RegFile::zero;
-			if (is_invalid_csr_access(addr, write)) {
+			if (is_invalid_csr_access<Config>(addr, write)) {
 				// TODO: it can be virtual instruction exception
 				RAISE_ILLEGAL_INSTRUCTION();
 			} else {
@@ -474,7 +531,7 @@ void ISS::exec_step() {
 			auto addr = instr.csr();
 			auto rs1 = instr.rs1();
 			auto write = rs1 != RegFile::zero;
-			if (is_invalid_csr_access(addr, write)) {
+			if (is_invalid_csr_access<Config>(addr, write)) {
 				// TODO: it can be virtual instruction exception
 				RAISE_ILLEGAL_INSTRUCTION();
 			} else {
@@ -491,7 +548,7 @@ void ISS::exec_step() {
 
 		case Opcode::CSRRWI: {
 			auto addr = instr.csr();
-			if (is_invalid_csr_access(addr, true)) {
+			if (is_invalid_csr_access<Config>(addr, true)) {
 				// TODO: it can be virtual instruction exception
 				RAISE_ILLEGAL_INSTRUCTION();
 			} else {
@@ -508,7 +565,7 @@ void ISS::exec_step() {
 			auto addr = instr.csr();
 			auto zimm = instr.zimm();
 			auto write = zimm != 0;
-			if (is_invalid_csr_access(addr, write)) {
+			if (is_invalid_csr_access<Config>(addr, write)) {
 				// TODO: it can be virtual instruction exception
 				RAISE_ILLEGAL_INSTRUCTION();
 			} else {
@@ -526,7 +583,7 @@ void ISS::exec_step() {
 			auto addr = instr.csr();
 			auto zimm = instr.zimm();
 			auto write = zimm != 0;
-			if (is_invalid_csr_access(addr, write)) {
+			if (is_invalid_csr_access<Config>(addr, write)) {
 				// TODO: it can be virtual instruction exception
 				RAISE_ILLEGAL_INSTRUCTION();
 			} else {
@@ -1151,8 +1208,10 @@ void ISS::exec_step() {
 				raise_trap(EXC_ILLEGAL_INSTR, instr.data());
 
 			// TODO: has_local_pending_enabled_interrupts require injection modification
-			if (!ignore_wfi && !has_local_pending_enabled_interrupts())
+			if (!ignore_wfi && !has_local_pending_enabled_interrupts()) {
 				sc_core::wait(wfi_event);
+				quantum_keeper.resume();
+			}
 			break;
 
 		case Opcode::SFENCE_VMA:
@@ -1160,7 +1219,28 @@ void ISS::exec_step() {
 				raise_trap(EXC_ILLEGAL_INSTR, instr.data());
 			if (vs_mode() && csrs.hstatus.fields.vtvm)
 				raise_trap(EXC_VIRTUAL_INSTRUCTION, instr.data());
-			mem->flush_tlb();
+			// in VS-mode the fence applies to the VS-stage translations of the current virtual machine
+			if (vs_mode())
+				mem->hfence_vvma(instr.rs1() != RegFile::zero, uint32_t(regs[instr.rs1()]),
+				                 instr.rs2() != RegFile::zero, uint32_t(regs[instr.rs2()]));
+			else
+				mem->flush_tlb(instr.rs1() != RegFile::zero, uint32_t(regs[instr.rs1()]), instr.rs2() != RegFile::zero,
+				               uint32_t(regs[instr.rs2()]));
+			break;
+
+		case Opcode::HFENCE_VVMA:
+			hs_fence_check_access<Config>();
+			mem->hfence_vvma(instr.rs1() != RegFile::zero, uint32_t(regs[instr.rs1()]), instr.rs2() != RegFile::zero,
+			                 uint32_t(regs[instr.rs2()]));
+			break;
+
+		case Opcode::HFENCE_GVMA:
+			hs_fence_check_access<Config>();
+			if (s_mode() && csrs.mstatus.fields.tvm)
+				raise_trap(EXC_ILLEGAL_INSTR, instr.data());
+			// rs1 holds the guest physical address shifted right by 2
+			mem->hfence_gvma(instr.rs1() != RegFile::zero, uint64_t(uint32_t(regs[instr.rs1()])) << 2,
+			                 instr.rs2() != RegFile::zero, uint32_t(regs[instr.rs2()]));
 			break;
 
 		case Opcode::SRET:
@@ -1191,67 +1271,67 @@ void ISS::exec_step() {
 			break;
 
 		case Opcode::HLVB: {
-			hs_inst_check_access();
+			hs_inst_check_access<Config>();
 			uint32_t addr = regs[instr.rs1()];
 			regs[instr.rd()] = mem->load_byte(addr, hs_inst_lvsv_mode());
 		} break;
 
 		case Opcode::HLVBU: {
-			hs_inst_check_access();
+			hs_inst_check_access<Config>();
 			uint32_t addr = regs[instr.rs1()];
 			regs[instr.rd()] = mem->load_ubyte(addr, hs_inst_lvsv_mode());
 		} break;
 
 		case Opcode::HLVH: {
-			hs_inst_check_access();
+			hs_inst_check_access<Config>();
 			uint32_t addr = regs[instr.rs1()];
 			trap_check_addr_alignment<2, true>(addr);
 			regs[instr.rd()] = mem->load_half(addr, hs_inst_lvsv_mode());
 		} break;
 
 		case Opcode::HLVHU: {
-			hs_inst_check_access();
+			hs_inst_check_access<Config>();
 			uint32_t addr = regs[instr.rs1()];
 			trap_check_addr_alignment<2, true>(addr);
 			regs[instr.rd()] = mem->load_uhalf(addr, hs_inst_lvsv_mode(), false);
 		} break;
 
 		case Opcode::HLVW: {
-			hs_inst_check_access();
+			hs_inst_check_access<Config>();
 			uint32_t addr = regs[instr.rs1()];
 			trap_check_addr_alignment<4, true>(addr);
 			regs[instr.rd()] = mem->load_word(addr, hs_inst_lvsv_mode(), false);
 		} break;
 
 		case Opcode::HLVXHU: {
-			hs_inst_check_access();
+			hs_inst_check_access<Config>();
 			uint32_t addr = regs[instr.rs1()];
 			trap_check_addr_alignment<2, true>(addr);
 			regs[instr.rd()] = mem->load_uhalf(addr, hs_inst_lvsv_mode(), true);
 		} break;
 
 		case Opcode::HLVXWU: {
-			hs_inst_check_access();
+			hs_inst_check_access<Config>();
 			uint32_t addr = regs[instr.rs1()];
 			trap_check_addr_alignment<4, true>(addr);
 			regs[instr.rd()] = mem->load_word(addr, hs_inst_lvsv_mode(), true);
 		} break;
 
 		case Opcode::HSVB: {
-			hs_inst_check_access();
+			hs_inst_check_access<Config>();
 			uint32_t addr = regs[instr.rs1()];
 			mem->store_byte(addr, regs[instr.rs2()], hs_inst_lvsv_mode());
 		} break;
 
 		case Opcode::HSVH: {
-			hs_inst_check_access();
+			hs_inst_check_access<Config>();
 			uint32_t addr = regs[instr.rs1()];
 			trap_check_addr_alignment<2, false>(addr);
 			mem->store_half(addr, regs[instr.rs2()], hs_inst_lvsv_mode());
 		} break;
 
 		case Opcode::HSVW: {
-			hs_inst_check_access();
+			hs_inst_check_access<Config>();
 			uint32_t addr = regs[instr.rs1()];
 			trap_check_addr_alignment<4, false>(addr);
 			mem->store_word(addr, regs[instr.rs2()], hs_inst_lvsv_mode());
@@ -1310,15 +1390,11 @@ void ISS::exec_step() {
 }
 
 uint64_t ISS::_compute_and_get_current_cycles() {
-	assert(cycle_counter % cycle_time == sc_core::SC_ZERO_TIME);
-	assert(cycle_counter.value() % cycle_time.value() == 0);
-
-	uint64_t num_cycles = cycle_counter.value() / cycle_time.value();
-
-	return num_cycles;
+	return cycle_counter;
 }
 
 
+template <typename Config>
 bool ISS::is_invalid_csr_access(uint32_t csr_addr, bool is_write) {
 	if (csr_addr == csr::FFLAGS_ADDR || csr_addr == csr::FRM_ADDR || csr_addr == csr::FCSR_ADDR) {
 		REQUIRE_ISA(F_ISA_EXT);
@@ -1326,12 +1402,13 @@ bool ISS::is_invalid_csr_access(uint32_t csr_addr, bool is_write) {
 
 	using namespace csr;
 
+	const csr_desc &desc = csrs.get_desc(csr_addr);
 	// CSR Address [9:8]
-	uint32_t csr_prv = (CSR_TYPE_MASK & csr_addr) >> CSR_TYPE_SHIFT;
-	bool csr_readonly = ((0xC00 & csr_addr) >> 10) == 3;
-	bool s_invalid = (csr_prv == SupervisorMode) && !csrs.misa.has_supervisor_mode_extension();
+	uint32_t csr_prv = desc.type;
+	bool csr_readonly = desc.readonly;
+	bool s_invalid = (csr_prv == SupervisorMode) && !has_isa<Config>(S_ISA_EXT);
 	bool u_invalid = (csr_prv == UserMode) && !csrs.misa.has_user_mode_extension();
-	bool vs_invalid = (csr_prv == VirtualSupervisorMode) && !csrs.misa.has_hypervisor_mode_extension();
+	bool vs_invalid = (csr_prv == VirtualSupervisorMode) && !has_isa<Config>(H_ISA_EXT);
 
 	/* CSR type fields match to priveledge bits in case of M/S/U modes */
 	static_assert(CSR_TYPE_S == SupervisorMode);
@@ -1379,15 +1456,9 @@ void ISS::validate_csr_counter_read_access_rights(uint32_t addr) {
 }
 
 uint32_t ISS::csr_address_virt_transform(uint32_t addr) {
-	using namespace csr;
-
-	// CSR Address [9:8]
-	uint32_t csr_prv = (CSR_TYPE_MASK & addr) >> CSR_TYPE_SHIFT;
-
 	/* In VS mode we access VS CSRs via S addresses */
-	if (vs_mode() && (csr_prv == CSR_TYPE_S)) {
-		return (addr & ~CSR_TYPE_MASK) | (CSR_TYPE_HS_VS << CSR_TYPE_SHIFT);
-	}
+	if (vs_mode())
+		return csrs.get_desc(addr).virt_addr;
 
 	return addr;
 }
@@ -1490,10 +1561,12 @@ void ISS::vs_clint_vti_access_check(void) {
 uint32_t ISS::get_csr_value(uint32_t addr) {
 	validate_csr_counter_read_access_rights(addr);
 
-	auto read = [=](auto &x, uint32_t mask) { return x.reg & mask; };
-
 	addr = csr_address_virt_transform(addr);
 
+	const csr_desc &desc = csrs.get_desc(addr);
+	if (likely(!(desc.hooks & csr_desc::READ_HOOK)))
+		return csrs.read32(desc);
+
 	using namespace csr;
 
 	switch (addr) {
@@ -1513,9 +1586,6 @@ uint32_t ISS::get_csr_value(uint32_t addr) {
 			csrs.cycle.reg = _compute_and_get_current_cycles();
 			return csrs.cycle.words.low;
 
-		case CYCLEH_ADDR:
-			return csrs.cycle.words.high;
-
 		case MCYCLE_ADDR:
 			csrs.cycle.reg = _compute_and_get_current_cycles();
 			return csrs.cycle.words.low;
@@ -1524,20 +1594,9 @@ uint32_t ISS::get_csr_value(uint32_t addr) {
 			csrs.cycle.reg = _compute_and_get_current_cycles();
 			return csrs.cycle.words.high;
 
-		case MINSTRET_ADDR:
-			return csrs.instret.words.low;
-
-		case MINSTRETH_ADDR:
-			return csrs.instret.words.high;
-
 		SWITCH_CASE_MATCH_ANY_HPMCOUNTER_RV32:  // not implemented
 			return 0;
 
-		case MSTATUS_ADDR:
-			return read(csrs.mstatus, MSTATUS_MASK);
-		case SSTATUS_ADDR:
-			return read(csrs.mstatus, SSTATUS_MASK);
-
 		case csrs_clint_pend::xip::MIP_ADDR:
 			return csrs.clint.mip.checked_read_mip();
 		case csrs_clint_pend::xip::SIP_ADDR:
@@ -1636,8 +1695,15 @@ uint32_t ISS::get_csr_value(uint32_t addr) {
 				RAISE_ILLEGAL_INSTRUCTION();
 			break;
 
-		case FCSR_ADDR:
-			return read(csrs.fcsr, FCSR_MASK);
+		case VSATP_ADDR:
+			if (vs_mode() && csrs.hstatus.fields.vtvm)
+				raise_trap(EXC_VIRTUAL_INSTRUCTION, instr.data());
+			break;
+
+		case HGATP_ADDR:
+			if (s_mode() && csrs.mstatus.fields.tvm)
+				RAISE_ILLEGAL_INSTRUCTION();
+			break;
 
 		case FFLAGS_ADDR:
 			return csrs.fcsr.fields.fflags;
@@ -1686,6 +1752,11 @@ uint32_t ISS::get_csr_value(uint32_t addr) {
 			vstimecmp_access_check();
 			return csrs.timecontrol.vstimecmp.words.high;
 
+		case csr_timecontrol::HTIMEDELTA_ADDR:
+			return csrs.timecontrol.htimedelta.words.low;
+		case csr_timecontrol::HTIMEDELTAH_ADDR:
+			return csrs.timecontrol.htimedelta.words.high;
+
 		case MIREG_ADDR:
 		case MIREG2_ADDR:
 		case MIREG3_ADDR:
@@ -1701,9 +1772,6 @@ uint32_t ISS::get_csr_value(uint32_t addr) {
 			return icsrs_m.default_read32(icsr_addr);
 		}
 
-		case SISELECT_ADDR:
-			return read(csrs.siselect, SISELECT_MASK);
-
 		case SIREG_ADDR:
 		case SIREG2_ADDR:
 		case SIREG3_ADDR:
@@ -1721,9 +1789,6 @@ uint32_t ISS::get_csr_value(uint32_t addr) {
 			return icsrs_s.default_read32(icsr_addr);
 		}
 
-		case VSISELECT_ADDR:
-			return read(csrs.vsiselect, VSISELECT_MASK);
-
 		case VSIREG_ADDR:
 		case VSIREG2_ADDR:
 		case VSIREG3_ADDR:
@@ -1744,21 +1809,28 @@ uint32_t ISS::get_csr_value(uint32_t addr) {
 			return csrs.default_read32(addr);
 	}
 
-	if (!csrs.is_valid_csr32_addr(addr))
+	if (!desc.reg)
 		RAISE_ILLEGAL_INSTRUCTION();
 
-	return csrs.default_read32(addr);
+	return csrs.read32(desc);
 }
 
 void ISS::set_csr_value(uint32_t addr, uint32_t value, bool read_accessed) {
 	auto write = [=](auto &x, uint32_t mask) { x.reg = (x.reg & ~mask) | (value & mask); };
 
+	irq_state_dirty = true;
+
 	addr = csr_address_virt_transform(addr);
 
+	const csr_desc &desc = csrs.get_desc(addr);
+	if (likely(!(desc.hooks & csr_desc::WRITE_HOOK))) {
+		csrs.write32(desc, value);
+		return;
+	}
+
 	using namespace csr;
 
 	switch (addr) {
-		case MISA_ADDR:                         // currently, read-only, thus cannot be changed at runtime
 		SWITCH_CASE_MATCH_ANY_HPMCOUNTER_RV32:  // not implemented
 			break;
 
@@ -1766,9 +1838,34 @@ void ISS::set_csr_value(uint32_t addr, uint32_t value, bool read_accessed) {
 			if (csrs.mstatus.fields.tvm)
 				RAISE_ILLEGAL_INSTRUCTION();
 			write(csrs.satp, SATP_MASK);
+			mem->flush_fast_tlb();
 			// std::cout << "[iss] satp=" << boost::format("%x") % csrs.satp.reg << std::endl;
 		} break;
 
+		// guest translations are not cached in the fast TLB
+		case VSATP_ADDR: {
+			if (vs_mode() && csrs.hstatus.fields.vtvm)
+				raise_trap(EXC_VIRTUAL_INSTRUCTION, instr.data());
+			write(csrs.vsatp, SATP_MASK);
+		} break;
+
+		case HGATP_ADDR: {
+			if (s_mode() && csrs.mstatus.fields.tvm)
+				RAISE_ILLEGAL_INSTRUCTION();
+			write(csrs.hgatp, HGATP_MASK);
+		} break;
+
+		case MSTATUS_ADDR:
+		case SSTATUS_ADDR: {
+			auto old = csrs.mstatus;
+			csrs.write32(desc, value);
+			// MXR affects the loads of all privilege levels, SUM only S-mode accesses
+			if (csrs.mstatus.fields.mxr != old.fields.mxr)
+				mem->flush_fast_tlb();
+			else if (csrs.mstatus.fields.sum != old.fields.sum)
+				mem->flush_fast_tlb(SupervisorMode);
+		} break;
+
 		case MTVEC_ADDR:
 			csrs.mtvec.checked_write(value);
 			on_xtvec_write(MachineMode);
@@ -1789,17 +1886,6 @@ void ISS::set_csr_value(uint32_t addr, uint32_t value, bool read_accessed) {
 			write(csrs.sepc, pc_alignment_mask());
 			break;
 
-		case MSTATUS_ADDR:
-			write(csrs.mstatus, MSTATUS_MASK);
-			break;
-		case SSTATUS_ADDR:
-			write(csrs.mstatus, SSTATUS_MASK);
-			break;
-
-		case MSTATUSH_ADDR:
-			write(csrs.mstatush, MSTATUSH_MASK);
-			break;
-
 		case HSTATUS_ADDR:
 			csrs.hstatus.checked_write(value);
 
@@ -1882,26 +1968,6 @@ void ISS::set_csr_value(uint32_t addr, uint32_t value, bool read_accessed) {
 			claim_topei_interrupt_on_xtopei(VirtualSupervisorMode, value, !read_accessed);
 			break;
 
-		case HEDELEG_ADDR:
-			write(csrs.hedeleg, HEDELEG_MASK);
-			break;
-
-		case MCOUNTEREN_ADDR:
-			write(csrs.mcounteren, MCOUNTEREN_MASK);
-			break;
-
-		case SCOUNTEREN_ADDR:
-			write(csrs.scounteren, MCOUNTEREN_MASK);
-			break;
-
-		case MCOUNTINHIBIT_ADDR:
-			write(csrs.mcountinhibit, MCOUNTINHIBIT_MASK);
-			break;
-
-		case FCSR_ADDR:
-			write(csrs.fcsr, FCSR_MASK);
-			break;
-
 		case FFLAGS_ADDR:
 			csrs.fcsr.fields.fflags = value;
 			break;
@@ -1946,25 +2012,36 @@ void ISS::set_csr_value(uint32_t addr, uint32_t value, bool read_accessed) {
 		case csr_timecontrol::STIMECMP_ADDR:
 			stimecmp_access_check();
 			csrs.timecontrol.stimecmp.words.low = value;
-			clint->post_write_xtimecmp();
+			clint->post_write_xtimecmp(this, SupervisorMode);
 			return;
 
 		case csr_timecontrol::STIMECMPH_ADDR:
 			stimecmp_access_check();
 			csrs.timecontrol.stimecmp.words.high = value;
-			clint->post_write_xtimecmp();
+			clint->post_write_xtimecmp(this, SupervisorMode);
 			return;
 
 		case csr_timecontrol::VSTIMECMP_ADDR:
 			vstimecmp_access_check();
 			csrs.timecontrol.vstimecmp.words.low = value;
-			clint->post_write_xtimecmp();
+			clint->post_write_xtimecmp(this, VirtualSupervisorMode);
 			return;
 
 		case csr_timecontrol::VSTIMECMPH_ADDR:
 			vstimecmp_access_check();
 			csrs.timecontrol.vstimecmp.words.high = value;
-			clint->post_write_xtimecmp();
+			clint->post_write_xtimecmp(this, VirtualSupervisorMode);
+			return;
+
+		// the VS timer compares vstimecmp against time + htimedelta, hence its deadline moves too
+		case csr_timecontrol::HTIMEDELTA_ADDR:
+			csrs.timecontrol.htimedelta.words.low = value;
+			clint->post_write_xtimecmp(this, VirtualSupervisorMode);
+			return;
+
+		case csr_timecontrol::HTIMEDELTAH_ADDR:
+			csrs.timecontrol.htimedelta.words.high = value;
+			clint->post_write_xtimecmp(this, VirtualSupervisorMode);
 			return;
 
 		case MIREG_ADDR:
@@ -1993,10 +2070,6 @@ void ISS::set_csr_value(uint32_t addr, uint32_t value, bool read_accessed) {
 			return;
 		}
 
-		case SISELECT_ADDR:
-			write(csrs.siselect, SISELECT_MASK);
-			break;
-
 		case SIREG_ADDR:
 		case SIREG2_ADDR:
 		case SIREG3_ADDR:
@@ -2015,15 +2088,14 @@ void ISS::set_csr_value(uint32_t addr, uint32_t value, bool read_accessed) {
 
 			icsrs_s.default_write32(icsr_addr, value);
 
+			if (is_smpuaddr(icsr_addr) || is_hmpuaddr(icsr_addr))
+				mem->clear_smpu_cache();
+
 			compute_imsic_pending_interrupts_s();
 
 			return;
 		}
 
-		case VSISELECT_ADDR:
-			write(csrs.vsiselect, VSISELECT_MASK);
-			break;
-
 		case VSIREG_ADDR:
 		case VSIREG2_ADDR:
 		case VSIREG3_ADDR:
@@ -2040,6 +2112,9 @@ void ISS::set_csr_value(uint32_t addr, uint32_t value, bool read_accessed) {
 
 			icsrs_vs.default_write32(icsr_addr, csrs.hstatus.get_vgein(), value);
 
+			if (is_smpuaddr(icsr_addr))
+				mem->clear_smpu_cache();
+
 			compute_imsic_pending_interrupts_vs();
 
 			return;
@@ -2147,10 +2222,10 @@ void ISS::set_csr_value(uint32_t addr, uint32_t value, bool read_accessed) {
 			break;
 
 		default:
-			if (!csrs.is_valid_csr32_addr(addr))
+			if (!desc.reg)
 				RAISE_ILLEGAL_INSTRUCTION();
 
-			csrs.default_write32(addr, value);
+			csrs.write32(desc, value);
 	}
 }
 
@@ -2203,6 +2278,10 @@ void ISS::on_xenvcfgh_write(void) {
 		// csrs.clint.mip.fields.vstip = 0;
 		csrs.clint.mip.hw_write_mip(EXC_VS_TIMER_INTERRUPT, false);
 	}
+
+	// the stimecmp/vstimecmp comparators may have been enabled
+	clint->post_write_xtimecmp(this, SupervisorMode);
+	clint->post_write_xtimecmp(this, VirtualSupervisorMode);
 }
 
 void ISS::init(instr_memory_if *instr_mem, data_memory_if *data_mem, clint_if *clint, uint32_t entrypoint,
@@ -2324,6 +2403,9 @@ void ISS::fp_require_not_off() {
 
 // called on xRET instruction
 void ISS::return_from_trap_handler(PrivilegeLevel return_mode) {
+	// privilege level and global interrupt enable change
+	irq_state_dirty = true;
+
 	switch (return_mode) {
 		case MachineMode:
 			prv = VPPToPrivilegeLevel(csrs.mstatush.fields.mpv, csrs.mstatus.fields.mpp);
@@ -2522,14 +2604,14 @@ void ISS::claim_topei_interrupt(PrivilegeLevel target_level, bool mark_irq_handl
 		if (mark_irq_handled) {
 			icsrs_m.eithreshold.mark_irq_as_handled();
 		} else {
-			imsic_update_eip_bit(icsrs_m.eip, topei_iid, false);
+			imsic_update_eip_bit(icsrs_m.eip, icsrs_m.eie, icsrs_m.pending, topei_iid, false);
 		}
 		compute_imsic_pending_interrupts_m();
 	} else if (target_level == SupervisorMode) {
 		if (mark_irq_handled) {
 			icsrs_s.eithreshold.mark_irq_as_handled();
 		} else {
-			imsic_update_eip_bit(icsrs_s.eip, topei_iid, false);
+			imsic_update_eip_bit(icsrs_s.eip, icsrs_s.eie, icsrs_s.pending, topei_iid, false);
 		}
 		compute_imsic_pending_interrupts_s();
 	} else {
@@ -2540,14 +2622,14 @@ void ISS::claim_topei_interrupt(PrivilegeLevel target_level, bool mark_irq_handl
 			if (mark_irq_handled) {
 				bank.eithreshold.mark_irq_as_handled();
 			} else {
-				imsic_update_eip_bit(bank.eip, topei_iid, false);
+				imsic_update_eip_bit(bank.eip, bank.eie, bank.pending, topei_iid, false);
 			}
 		}
 		compute_imsic_pending_interrupts_vs();
 	}
 }
 
-void ISS::imsic_update_eip_bit(icsr_32 *eip, uint32_t value, bool set_bit) {
+void ISS::imsic_update_eip_bit(icsr_32 *eip, icsr_32 *eie, imsic_pending_summary &pending, uint32_t value, bool set_bit) {
 	assert(is_upper_bound_valid_minor_iid(value));
 
 	// IID = 0 is not supported
@@ -2564,9 +2646,10 @@ void ISS::imsic_update_eip_bit(icsr_32 *eip, uint32_t value, bool set_bit) {
 		eip[eip_arr_idx].reg |= BIT(eip_bit);
 	else
 		eip[eip_arr_idx].reg &= ~(BIT(eip_bit));
+	pending.update(eip, eie, eip_arr_idx);
 }
 
-std::tuple<bool, uint32_t> ISS::compute_imsic_pending(icsr_32 *eip, icsr_32 *eie, uint32_t size, icsr_eithreshold &eithreshold, icsr_eidelivery &eidelivery, bool nested_vectored) {
+std::tuple<bool, uint32_t> ISS::compute_imsic_pending(icsr_32 *eip, icsr_32 *eie, imsic_pending_summary &pending, icsr_eithreshold &eithreshold, icsr_eidelivery &eidelivery, bool nested_vectored) {
 	bool irq_pending = false;
 	uint32_t topei_val = 0;
 	constexpr uint32_t NO_IRQ_PENDING = iss_config::IMSIC_MAX_IRQS * 2; // value over any valid IID
@@ -2584,15 +2667,10 @@ std::tuple<bool, uint32_t> ISS::compute_imsic_pending(icsr_32 *eip, icsr_32 *eie
 		eithreshold_value = iss_config::IMSIC_MAX_IRQS;
 
 	uint32_t active_iid_num = NO_IRQ_PENDING;
-	uint32_t ext_pend = 0;
-
-	for (unsigned i = 0; i < size; i++) {
-		ext_pend = eip[i].reg & eie[i].reg;
 
-		if (ext_pend) {
-			active_iid_num = i * icsr_32::BITS_PER_CSR + __builtin_ctz(ext_pend);
-			break;
-		}
+	if (pending.words) {
+		unsigned i = __builtin_ctzll(pending.words);
+		active_iid_num = i * icsr_32::BITS_PER_CSR + __builtin_ctz(eip[i].reg & eie[i].reg);
 	}
 
 	bool threshold_matched = active_iid_num < eithreshold_value;
@@ -2615,22 +2693,28 @@ void ISS::on_guest_switch(void) {
 }
 
 void ISS::compute_imsic_pending_interrupts_m(void) {
+	irq_state_dirty = true;
+
 	// MachineMode
 	bool nv = is_irq_mode_snps_nested_vectored(MachineMode);
-	auto [irq_pending, topei_val] = compute_imsic_pending(icsrs_m.eip, icsrs_m.eie, icsrs_m.eip_eie_arr_size, icsrs_m.eithreshold, icsrs_m.eidelivery, nv);
+	auto [irq_pending, topei_val] = compute_imsic_pending(icsrs_m.eip, icsrs_m.eie, icsrs_m.pending, icsrs_m.eithreshold, icsrs_m.eidelivery, nv);
 	csrs.clint.mip.hw_write_mip(EXC_M_EXTERNAL_INTERRUPT, irq_pending);
 	set_topei(MachineMode, topei_val);
 }
 
 void ISS::compute_imsic_pending_interrupts_s(void) {
+	irq_state_dirty = true;
+
 	// SupervisorMode
 	bool nv = is_irq_mode_snps_nested_vectored(SupervisorMode);
-	auto [irq_pending, topei_val] = compute_imsic_pending(icsrs_s.eip, icsrs_s.eie, icsrs_s.eip_eie_arr_size, icsrs_s.eithreshold, icsrs_s.eidelivery, nv);
+	auto [irq_pending, topei_val] = compute_imsic_pending(icsrs_s.eip, icsrs_s.eie, icsrs_s.pending, icsrs_s.eithreshold, icsrs_s.eidelivery, nv);
 	csrs.clint.mip.hw_write_mip(EXC_S_EXTERNAL_INTERRUPT, irq_pending);
 	set_topei(SupervisorMode, topei_val);
 }
 
 void ISS::compute_imsic_pending_interrupts_vs(void) {
+	irq_state_dirty = true;
+
 	// VirtualSupervisorMode
 	bool vs_pend[iss_config::MAX_GUEST];
 	uint32_t vs_eiid[iss_config::MAX_GUEST];
@@ -2639,7 +2723,7 @@ void ISS::compute_imsic_pending_interrupts_vs(void) {
 	for (unsigned i = 0; i < iss_config::MAX_GUEST; i++) {
 		bool nv = is_irq_mode_snps_nested_vectored(VirtualSupervisorMode);
 		struct icsr_vs_table::bank & bank = icsrs_vs.bank[i];
-		std::tie(vs_pend[i], vs_eiid[i]) = compute_imsic_pending(bank.eip, bank.eie, icsrs_vs.eip_eie_arr_size, bank.eithreshold, bank.eidelivery, nv);
+		std::tie(vs_pend[i], vs_eiid[i]) = compute_imsic_pending(bank.eip, bank.eie, bank.pending, bank.eithreshold, bank.eidelivery, nv);
 
 		csrs.hgeip.set_guest_pending(i, vs_pend[i]);
 	}
@@ -2663,6 +2747,8 @@ void ISS::compute_imsic_pending_interrupts_vs(void) {
 void ISS::clint_hw_irq_route(uint32_t iid, bool set) {
 	assert(major_irq::is_valid(iid));
 
+	irq_state_dirty = true;
+
 	PendingInterrupts old_pendings_0 = compute_clint_pending_irq_bits_per_level();
 
 	// update bit in HW mip
@@ -2871,13 +2957,14 @@ void ISS::route_imsic_write(PrivilegeLevel target_imsic, unsigned guest_index, u
 		return;
 
 	if (target_imsic == MachineMode) {
-		imsic_update_eip_bit(icsrs_m.eip, value, true);
+		imsic_update_eip_bit(icsrs_m.eip, icsrs_m.eie, icsrs_m.pending, value, true);
 		compute_imsic_pending_interrupts_m();
 	} else if (target_imsic == SupervisorMode) {
-		imsic_update_eip_bit(icsrs_s.eip, value, true);
+		imsic_update_eip_bit(icsrs_s.eip, icsrs_s.eie, icsrs_s.pending, value, true);
 		compute_imsic_pending_interrupts_s();
 	} else if (target_imsic == VirtualSupervisorMode) {
-		imsic_update_eip_bit(icsrs_vs.bank[guest_index].eip, value, true);
+		struct icsr_vs_table::bank &bank = icsrs_vs.bank[guest_index];
+		imsic_update_eip_bit(bank.eip, bank.eie, bank.pending, value, true);
 		compute_imsic_pending_interrupts_vs();
 	} else {
 		assert(false);
@@ -2901,6 +2988,35 @@ uint32_t ISS::get_xtinst(SimulationTrap &e) {
 		return 0;
 }
 
+/* Whether the trap value of *e* is a guest virtual address (reported by the GVA bit of mstatush/hstatus), i.e. it is
+ * a faulting address of a VS/VU-mode access, of a hypervisor virtual machine load/store or of an M-mode access with
+ * MPRV and MPV set. */
+bool ISS::is_guest_virtual_tval(SimulationTrap &e) {
+	switch (e.reason) {
+		case EXC_INSTR_GUEST_PAGE_FAULT:
+		case EXC_LOAD_GUEST_PAGE_FAULT:
+		case EXC_STORE_AMO_GUEST_PAGE_FAULT:
+			return true;
+
+		case EXC_INSTR_ADDR_MISALIGNED:
+		case EXC_INSTR_ACCESS_FAULT:
+		case EXC_INSTR_PAGE_FAULT:
+			return PrivilegeLevelToV(prv);
+
+		case EXC_LOAD_ADDR_MISALIGNED:
+		case EXC_LOAD_ACCESS_FAULT:
+		case EXC_LOAD_PAGE_FAULT:
+		case EXC_STORE_AMO_ADDR_MISALIGNED:
+		case EXC_STORE_AMO_ACCESS_FAULT:
+		case EXC_STORE_AMO_PAGE_FAULT:
+			return PrivilegeLevelToV(prv) || (op >= Opcode::HLVB && op <= Opcode::HSVW) ||
+			       (m_mode() && csrs.mstatus.fields.mprv && csrs.mstatush.fields.mpv);
+
+		default:
+			return false;
+	}
+}
+
 PrivilegeLevel ISS::prepare_trap(SimulationTrap &e) {
 	// undo any potential pc update (for traps the pc should point to the originating instruction and not it's
 	// successor)
@@ -2915,6 +3031,7 @@ PrivilegeLevel ISS::prepare_trap(SimulationTrap &e) {
 		csrs.mtval.reg = boost::lexical_cast<uint32_t>(e.mtval);
 		csrs.mtval2.reg = boost::lexical_cast<uint32_t>(e.mtval2_htval);
 		csrs.mtinst.reg = get_xtinst(e);
+		csrs.mstatush.fields.gva = is_guest_virtual_tval(e);
 		return MachineMode;
 	}
 
@@ -2928,6 +3045,7 @@ PrivilegeLevel ISS::prepare_trap(SimulationTrap &e) {
 		csrs.stval.reg = boost::lexical_cast<uint32_t>(e.mtval);
 		csrs.htval.reg = boost::lexical_cast<uint32_t>(e.mtval2_htval);
 		csrs.htinst.reg = get_xtinst(e);
+		csrs.hstatus.fields.gva = is_guest_virtual_tval(e);
 		return SupervisorMode;
 	}
 
@@ -3172,6 +3290,10 @@ PrivilegeLevel ISS::compute_pending_interrupt(PendingInterrupts &irqs_pend) {
 }
 
 std::tuple<PrivilegeLevel, bool> ISS::prepare_interrupt(void) {
+	// nothing changed since the last computation, which found no interrupt to take
+	if (likely(!irq_state_dirty))
+		return {NoneMode, false};
+
 	PendingInterrupts irqs_pend = compute_clint_pending_irq_bits_per_level();
 
 	irqs_pend = process_clint_pending_irq_bits_per_level(irqs_pend);
@@ -3181,8 +3303,10 @@ std::tuple<PrivilegeLevel, bool> ISS::prepare_interrupt(void) {
 
 	PrivilegeLevel target_mode = compute_pending_interrupt(irqs_pend);
 
-	if (target_mode == NoneMode)
+	if (target_mode == NoneMode) {
+		irq_state_dirty = false;
 		return {target_mode, false};
+	}
 
 	if (trace) {
 		uint32_t iid = -1;
@@ -3424,6 +3548,9 @@ void ISS::switch_to_trap_handler(PrivilegeLevel target_mode) {
 	// free any potential LR/SC bus lock before processing a trap/interrupt
 	release_lr_sc_reservation();
 
+	// privilege level and global interrupt enable change
+	irq_state_dirty = true;
+
 	auto pp = prv;
 	prv = target_mode;
 
@@ -3480,7 +3607,7 @@ void ISS::switch_to_trap_handler(PrivilegeLevel target_mode) {
 	jump_to_trap_vector(target_mode);
 }
 
-void ISS::performance_and_sync_update(Opcode::Mapping executed_op) {
+void ISS::account_instr(Opcode::Mapping executed_op) {
 	++total_num_instr;
 
 	if (!csrs.mcountinhibit.fields.IR)
@@ -3498,14 +3625,36 @@ void ISS::performance_and_sync_update(Opcode::Mapping executed_op) {
 	if (!csrs.mcountinhibit.fields.CY)
 		cycle_counter += new_cycles;
 
-	quantum_keeper.inc(new_cycles);
+	quantum_keeper.inc_cycles(new_cycles);
+}
+
+bool ISS::sync_quantum() {
 	if (quantum_keeper.need_sync()) {
-		if (lr_sc_counter == 0) // match SystemC sync with bus unlocking in a tight LR_W/SC_W loop
+		if (lr_sc_counter == 0) { // match SystemC sync with bus unlocking in a tight LR_W/SC_W loop
 			quantum_keeper.sync();
+			return true;
+		}
 	}
+	return false;
 }
 
-void ISS::run_step() {
+void ISS::take_pending_trap() {
+	trap_pending = false;
+
+	if (trace)
+		std::cout << "[vp::iss] take trap " << pending_trap.reason << " in mode " << PrivilegeLevelToStr(prv)
+		          << ", mtval=" << pending_trap.mtval << std::endl;
+	auto target_mode = prepare_trap(pending_trap);
+	switch_to_trap_handler(target_mode);
+}
+
+void ISS::performance_and_sync_update(Opcode::Mapping executed_op) {
+	account_instr(executed_op);
+	sync_quantum();
+}
+
+template <typename Config>
+void ISS::_run_step() {
 	try {
 		assert(regs.read(0) == 0);
 
@@ -3523,20 +3672,22 @@ void ISS::run_step() {
 
 		last_pc = pc;
 
-		exec_step();
+		exec_step<Config>();
 
-		auto [target_mode, need_switch_to_trap] = prepare_interrupt();
-		// std::cout << "mip=0x" << std::hex << csrs.clint.mip.reg << " mie=0x" << csrs.mie.reg << " prv=" << PrivilegeLevelToStr(prv) << ((target_mode == NoneMode) ? " no irq" : " has irq") << std::endl;
-		if (need_switch_to_trap) {
-			switch_to_trap_handler(target_mode);
+		if (likely(!trap_pending)) {
+			auto [target_mode, need_switch_to_trap] = prepare_interrupt();
+			// std::cout << "mip=0x" << std::hex << csrs.clint.mip.reg << " mie=0x" << csrs.mie.reg << " prv=" << PrivilegeLevelToStr(prv) << ((target_mode == NoneMode) ? " no irq" : " has irq") << std::endl;
+			if (need_switch_to_trap) {
+				switch_to_trap_handler(target_mode);
+			}
 		}
 	} catch (SimulationTrap &e) {
-		if (trace)
-			std::cout << "[vp::iss] take trap " << e.reason << " in mode " << PrivilegeLevelToStr(prv) << ", mtval=" << e.mtval << std::endl;
-		auto target_mode = prepare_trap(e);
-		switch_to_trap_handler(target_mode);
+		signal_trap(e);
 	}
 
+	if (unlikely(trap_pending))
+		take_pending_trap();
+
 	// NOTE: writes to zero register are supposedly allowed but must be ignored
 	// (reset it after every instruction, instead of checking *rd != zero*
 	// before every register write)
@@ -3551,12 +3702,529 @@ void ISS::run_step() {
 	performance_and_sync_update(op);
 }
 
+namespace {
+
+/* Handlers of the block engine for the most frequent instructions, they have to match the corresponding cases of
+ * *ISS::execute_op*. All other instructions are dispatched through *exec_generic*. */
+template <typename Config>
+void exec_generic(ISS &core) {
+	core.execute_op<Config>();
+}
+
+void exec_addi(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] + core.instr.I_imm();
+}
+
+void exec_slti(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] < core.instr.I_imm();
+}
+
+void exec_sltiu(ISS &core) {
+	core.regs[core.instr.rd()] = ((uint32_t)core.regs[core.instr.rs1()]) < ((uint32_t)core.instr.I_imm());
+}
+
+void exec_xori(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] ^ core.instr.I_imm();
+}
+
+void exec_ori(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] | core.instr.I_imm();
+}
+
+void exec_andi(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] & core.instr.I_imm();
+}
+
+void exec_slli(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] << core.instr.shamt();
+}
+
+void exec_srli(ISS &core) {
+	core.regs[core.instr.rd()] = ((uint32_t)core.regs[core.instr.rs1()]) >> core.instr.shamt();
+}
+
+void exec_srai(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] >> core.instr.shamt();
+}
+
+void exec_add(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] + core.regs[core.instr.rs2()];
+}
+
+void exec_sub(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] - core.regs[core.instr.rs2()];
+}
+
+void exec_sll(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] << core.regs.shamt(core.instr.rs2());
+}
+
+void exec_slt(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] < core.regs[core.instr.rs2()];
+}
+
+void exec_sltu(ISS &core) {
+	core.regs[core.instr.rd()] = ((uint32_t)core.regs[core.instr.rs1()]) < ((uint32_t)core.regs[core.instr.rs2()]);
+}
+
+void exec_srl(ISS &core) {
+	core.regs[core.instr.rd()] = ((uint32_t)core.regs[core.instr.rs1()]) >> core.regs.shamt(core.instr.rs2());
+}
+
+void exec_sra(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] >> core.regs.shamt(core.instr.rs2());
+}
+
+void exec_xor(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] ^ core.regs[core.instr.rs2()];
+}
+
+void exec_or(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] | core.regs[core.instr.rs2()];
+}
+
+void exec_and(ISS &core) {
+	core.regs[core.instr.rd()] = core.regs[core.instr.rs1()] & core.regs[core.instr.rs2()];
+}
+
+void exec_lui(ISS &core) {
+	core.regs[core.instr.rd()] = core.instr.U_imm();
+}
+
+void exec_auipc(ISS &core) {
+	core.regs[core.instr.rd()] = core.last_pc + core.instr.U_imm();
+}
+
+template <typename Config, typename Cond>
+inline void exec_branch(ISS &core, Cond cond) {
+	if (cond(core.regs[core.instr.rs1()], core.regs[core.instr.rs2()])) {
+		core.pc = core.last_pc + core.instr.B_imm();
+		core.trap_check_pc_alignment<Config>();
+	}
+}
+
+template <typename Config>
+void exec_beq(ISS &core) {
+	exec_branch<Config>(core, [](int32_t a, int32_t b) { return a == b; });
+}
+
+template <typename Config>
+void exec_bne(ISS &core) {
+	exec_branch<Config>(core, [](int32_t a, int32_t b) { return a != b; });
+}
+
+template <typename Config>
+void exec_blt(ISS &core) {
+	exec_branch<Config>(core, [](int32_t a, int32_t b) { return a < b; });
+}
+
+template <typename Config>
+void exec_bge(ISS &core) {
+	exec_branch<Config>(core, [](int32_t a, int32_t b) { return a >= b; });
+}
+
+template <typename Config>
+void exec_bltu(ISS &core) {
+	exec_branch<Config>(core, [](int32_t a, int32_t b) { return (uint32_t)a < (uint32_t)b; });
+}
+
+template <typename Config>
+void exec_bgeu(ISS &core) {
+	exec_branch<Config>(core, [](int32_t a, int32_t b) { return (uint32_t)a >= (uint32_t)b; });
+}
+
+template <typename Config>
+void exec_jal(ISS &core) {
+	auto link = core.pc;
+	core.pc = core.last_pc + core.instr.J_imm();
+	core.trap_check_pc_alignment<Config>();
+	core.regs[core.instr.rd()] = link;
+}
+
+template <typename Config>
+void exec_jalr(ISS &core) {
+	auto link = core.pc;
+	core.pc = (core.regs[core.instr.rs1()] + core.instr.I_imm()) & ~1;
+	core.trap_check_pc_alignment<Config>();
+	core.regs[core.instr.rd()] = link;
+}
+
+template <typename Config>
+BasicBlock::handler_t block_handler(Opcode::Mapping op) {
+	switch (op) {
+		case Opcode::ADDI: return exec_addi;
+		case Opcode::SLTI: return exec_slti;
+		case Opcode::SLTIU: return exec_sltiu;
+		case Opcode::XORI: return exec_xori;
+		case Opcode::ORI: return exec_ori;
+		case Opcode::ANDI: return exec_andi;
+		case Opcode::SLLI: return exec_slli;
+		case Opcode::SRLI: return exec_srli;
+		case Opcode::SRAI: return exec_srai;
+		case Opcode::ADD: return exec_add;
+		case Opcode::SUB: return exec_sub;
+		case Opcode::SLL: return exec_sll;
+		case Opcode::SLT: return exec_slt;
+		case Opcode::SLTU: return exec_sltu;
+		case Opcode::SRL: return exec_srl;
+		case Opcode::SRA: return exec_sra;
+		case Opcode::XOR: return exec_xor;
+		case Opcode::OR: return exec_or;
+		case Opcode::AND: return exec_and;
+		case Opcode::LUI: return exec_lui;
+		case Opcode::AUIPC: return exec_auipc;
+		case Opcode::BEQ: return exec_beq<Config>;
+		case Opcode::BNE: return exec_bne<Config>;
+		case Opcode::BLT: return exec_blt<Config>;
+		case Opcode::BGE: return exec_bge<Config>;
+		case Opcode::BLTU: return exec_bltu<Config>;
+		case Opcode::BGEU: return exec_bgeu<Config>;
+		case Opcode::JAL: return exec_jal<Config>;
+		case Opcode::JALR: return exec_jalr<Config>;
+		default: return exec_generic<Config>;
+	}
+}
+
+/* Instructions which can be followed by further instructions in a block, i.e. they neither change the control
+ * flow nor anything the interrupt logic depends on (CSRs, memory mapped devices, privilege level). */
+bool is_block_interior_op(Opcode::Mapping op) {
+	switch (op) {
+		case Opcode::ADDI:
+		case Opcode::SLTI:
+		case Opcode::SLTIU:
+		case Opcode::XORI:
+		case Opcode::ORI:
+		case Opcode::ANDI:
+		case Opcode::SLLI:
+		case Opcode::SRLI:
+		case Opcode::SRAI:
+		case Opcode::ADD:
+		case Opcode::SUB:
+		case Opcode::SLL:
+		case Opcode::SLT:
+		case Opcode::SLTU:
+		case Opcode::SRL:
+		case Opcode::SRA:
+		case Opcode::XOR:
+		case Opcode::OR:
+		case Opcode::AND:
+		case Opcode::LUI:
+		case Opcode::AUIPC:
+		case Opcode::MUL:
+		case Opcode::MULH:
+		case Opcode::MULHU:
+		case Opcode::MULHSU:
+		case Opcode::DIV:
+		case Opcode::DIVU:
+		case Opcode::REM:
+		case Opcode::REMU:
+		case Opcode::FENCE:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/* A block ending with one of these instructions leaves the fetch translation untouched, hence its successor in
+ * the same page can be entered directly. */
+bool is_chainable_op(Opcode::Mapping op) {
+	switch (op) {
+		case Opcode::BEQ:
+		case Opcode::BNE:
+		case Opcode::BLT:
+		case Opcode::BGE:
+		case Opcode::BLTU:
+		case Opcode::BGEU:
+		case Opcode::JAL:
+		case Opcode::JALR:
+			return true;
+		default:
+			return is_block_interior_op(op);
+	}
+}
+
+}  // namespace
+
+bool ISS::block_engine_usable() {
+	// SPMP/SMPU regions can be smaller than a page, so the fetch check of the first instruction would not cover
+	// the whole block
+	return use_block_engine && decode_cache.enabled && !debug_mode && !trace && !use_spmp && !use_smpu;
+}
+
+template <typename Config>
+BasicBlock *ISS::build_block(uint64_t paddr) {
+	BasicBlock &b = block_cache.slot(paddr);
+	b.paddr = paddr;
+	b.num_ops = 0;
+	b.next[0] = b.next[1] = nullptr;
+	b.exec_count = 0;
+	b.jit_generation = 0;
+
+	uint64_t addr = paddr;
+	while (b.num_ops < BasicBlock::MAX_OPS) {
+		// the fetch always reads a 32 bit word, which must not cross the page
+		if ((addr & 0xfff) > 0xffc)
+			break;
+
+		BasicBlock::op_t &e = b.ops[b.num_ops];
+		auto cached = decode_cache.lookup(addr);
+		if (cached) {
+			e.instr = cached->instr;
+			e.op = cached->op;
+			e.length = cached->length;
+		} else {
+			uint32_t mem_word;
+			if (!instr_mem->peek_instr_paddr(addr, mem_word))
+				break;
+
+			e.instr = Instruction(mem_word);
+			if (e.instr.is_compressed()) {
+				e.op = e.instr.decode_and_expand_compressed<RV32>();
+				e.length = 2;
+			} else {
+				e.op = e.instr.decode_normal<RV32>();
+				e.length = 4;
+			}
+			// leave illegal instructions to the single step path
+			if (e.op == Opcode::UNDEF)
+				break;
+			decode_cache.insert(addr, mem_word, e.instr, e.op, e.length);
+		}
+
+		if (e.length == 2 && !has_isa<Config>(C_ISA_EXT))
+			break;
+
+		e.exec = block_handler<Config>(e.op);
+		++b.num_ops;
+		addr += e.length;
+
+		if (!is_block_interior_op(e.op))
+			break;
+	}
+
+	b.end_paddr = addr;
+	// after the instructions have been inserted, which starts tracking the page
+	b.generation = decode_cache.get_page_generation(paddr);
+	return &b;
+}
+
+/* Execute the translated code of a hot block, if the step loop would neither check interrupts nor sync within the
+ * translated instructions. Returns the number of executed instructions. */
+unsigned ISS::run_jit(BasicBlock *b) {
+	if (b->jit_generation != jit.get_generation()) {
+		if (++b->exec_count < BlockJit::HOT_THRESHOLD)
+			return 0;
+		jit.translate(*b, csrs.misa.reg & M_ISA_EXT, instr_cycles);
+	}
+
+	if (b->jit_ops == 0 || irq_state_dirty || lr_sc_counter != 0)
+		return 0;
+
+	auto local_time = quantum_keeper.get_local_time();
+	for (unsigned i = 0; i < b->jit_ops; ++i) {
+		if (i != 0)
+			instr_mem->account_skipped_instr_translation();
+		instr_mem->account_cached_instr_fetch();
+	}
+	quantum_keeper.inc_cycles(b->jit_cycles);
+	if (quantum_keeper.need_sync()) {
+		// the step loop would sync within the translated instructions
+		quantum_keeper.set(local_time);
+		return 0;
+	}
+
+	uint32_t block_pc = pc;
+	if (unlikely(jit.check)) {
+		RegFile initial(regs);
+		b->jit_code(regs.regs, block_pc);
+		RegFile translated(regs);
+
+		memcpy(regs.regs, initial.regs, sizeof(regs.regs));
+		for (unsigned i = 0; i < b->jit_ops; ++i) {
+			const BasicBlock::op_t &e = b->ops[i];
+			last_pc = pc;
+			pc += e.length;
+			instr = e.instr;
+			op = e.op;
+			e.exec(*this);
+			regs.regs[regs.zero] = 0;
+		}
+
+		for (unsigned i = 0; i < RegFile::NUM_REGS; ++i) {
+			if (regs.regs[i] != translated.regs[i]) {
+				throw std::runtime_error("[ISS] JIT mismatch in block at " + std::to_string(block_pc) + ": " +
+				                         regnames[i] + " = " + std::to_string(translated.regs[i]) + ", expected " +
+				                         std::to_string(regs.regs[i]));
+			}
+		}
+	} else {
+		b->jit_code(regs.regs, block_pc);
+	}
+	pc = block_pc + b->jit_bytes;
+
+	total_num_instr += b->jit_ops;
+	if (!csrs.mcountinhibit.fields.IR)
+		csrs.instret.reg += b->jit_ops;
+	if (!csrs.mcountinhibit.fields.CY)
+		cycle_counter += b->jit_cycles;
+
+	return b->jit_ops;
+}
+
+template <typename Config>
+BasicBlock *ISS::find_block() {
+	if (chained_block && ((pc ^ chained_block_vaddr) & ~0xfff) == 0) {
+		// same page as the previous block and nothing in between could have changed the translation
+		uint64_t paddr = (chained_block->paddr & ~uint64_t(0xfff)) | (pc & 0xfff);
+		instr_mem->account_skipped_instr_translation();
+		uint64_t generation = decode_cache.get_page_generation(paddr);
+		BasicBlock *&link = chained_block->next[paddr == chained_block->end_paddr ? 0 : 1];
+		if (!link || !link->is_valid(paddr, generation)) {
+			link = block_cache.lookup(paddr, generation);
+			if (!link)
+				link = build_block<Config>(paddr);
+		}
+		return link;
+	}
+
+	uint64_t paddr;
+	if (unlikely(!instr_mem->try_translate_instr_addr(pc, paddr, pending_trap))) {
+		trap_pending = true;
+		return nullptr;
+	}
+	BasicBlock *b = block_cache.lookup(paddr, decode_cache.get_page_generation(paddr));
+	if (!b)
+		b = build_block<Config>(paddr);
+	return b;
+}
+
+/* Execute a basic block, architecturally equivalent to calling *run_step* for each of its instructions: the
+ * instructions before the last one in a block cannot change the interrupt state, so the per instruction interrupt
+ * check is only done after the last one (or after the current one, as soon as *irq_state_dirty* is set by a trap or
+ * by other SystemC processes). Quantum syncs are done at the same points. */
+template <typename Config>
+void ISS::run_block() {
+	BasicBlock *b = nullptr;
+	bool completed = false;
+	bool switched = false;
+
+	try {
+		assert(regs.read(0) == 0);
+
+		process_pending_ivt();
+
+		last_pc = pc;
+
+		try {
+			b = find_block<Config>();
+		} catch (SimulationTrap &e) {
+			signal_trap(e);
+		}
+
+		if (unlikely(trap_pending)) {
+			// instruction fetch fault
+			op = Opcode::UNDEF;
+			instr = Instruction(0);
+		} else if (b->num_ops == 0) {
+			// no block possible at *pc*, e.g. not DMI memory or an illegal instruction
+			exec_step<Config>(b->paddr);
+		} else {
+			unsigned i = jit.enabled ? run_jit(b) : 0;
+			for (;; ++i) {
+				const BasicBlock::op_t &e = b->ops[i];
+
+				last_pc = pc;
+				pc += e.length;
+				instr = e.instr;
+				op = e.op;
+				// the first instruction has been translated by *find_block*
+				if (i != 0)
+					instr_mem->account_skipped_instr_translation();
+				instr_mem->account_cached_instr_fetch();
+
+				e.exec(*this);
+
+				// the interrupt state might have been changed by a trap or by other SystemC processes, e.g. during a
+				// sync, check interrupts after this instruction
+				completed = (i + 1) == b->num_ops;
+				if (completed || irq_state_dirty)
+					break;
+
+				regs.regs[regs.zero] = 0;
+				account_instr(op);
+				sync_quantum();
+			}
+		}
+
+		if (likely(!trap_pending)) {
+			auto [target_mode, need_switch_to_trap] = prepare_interrupt();
+			if (need_switch_to_trap) {
+				switch_to_trap_handler(target_mode);
+				switched = true;
+			}
+		}
+	} catch (SimulationTrap &e) {
+		signal_trap(e);
+	}
+
+	if (unlikely(trap_pending)) {
+		take_pending_trap();
+		switched = true;
+	}
+
+	regs.regs[regs.zero] = 0;
+
+	if (shall_exit)
+		status = CoreExecStatus::Terminated;
+
+	account_instr(op);
+	bool synced = sync_quantum();
+
+	if (completed && !switched && !synced && is_chainable_op(op)) {
+		chained_block = b;
+		chained_block_vaddr = last_pc;
+	} else {
+		chained_block = nullptr;
+	}
+}
+
+template <typename Config>
+void ISS::_run() {
+	if constexpr (!Config::is_dynamic) {
+		constexpr uint32_t base_isa = csr_misa::I | csr_misa::E;
+		assert((csrs.misa.fields.extensions & ~base_isa) == (Config::extensions & ~base_isa) &&
+		       "misa has been changed after specializing the ISS, use a matching ISA configuration");
+	}
+
+	if (block_engine_usable()) {
+		chained_block = nullptr;
+
+		do {
+			run_block<Config>();
+		} while (status == CoreExecStatus::Runnable);
+	} else {
+		// run a single step until either a breakpoint is hit or the execution
+		// terminates
+		do {
+			_run_step<Config>();
+		} while (status == CoreExecStatus::Runnable);
+	}
+}
+
+void ISS::run_step() {
+	// e.g. the debugger might have waited in between
+	quantum_keeper.resume();
+
+	// misa reflects the selected configuration, hence the generic step is equivalent
+	_run_step<DynamicIsaConfig>();
+}
+
 void ISS::run() {
-	// run a single step until either a breakpoint is hit or the execution
-	// terminates
-	do {
-		run_step();
-	} while (status == CoreExecStatus::Runnable);
+	// e.g. the debugger might have changed the state
+	irq_state_dirty = true;
+	quantum_keeper.resume();
+
+	(this->*run_loop)();
 
 	// force sync to make sure that no action is missed
 	quantum_keeper.sync();
@@ -3570,3 +4238,11 @@ void ISS::show() {
 	std::cout << "pc = " << std::hex << pc << std::endl;
 	std::cout << "num-instr = " << std::dec << csrs.instret.reg << std::endl;
 }
+
+// configurations available for *ISS::specialize*, see isa_config.h
+template void ISS::specialize<DynamicIsaConfig>();
+template void ISS::specialize<Rv32DefaultConfig>();
+template void ISS::specialize<Rv32DefaultMmuConfig>();
+template void ISS::specialize<Rv32DefaultSpmpConfig>();
+template void ISS::specialize<Rv32DefaultSmpuConfig>();
+template void ISS::specialize<Rv32LinuxConfig>();
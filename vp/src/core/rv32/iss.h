@@ -2,13 +2,18 @@
 
 #include "core/common/bus_lock_if.h"
 #include "core/common/clint_if.h"
+#include "core/common/decode_cache.h"
 #include "core/common/instr.h"
 #include "core/common/irq_if.h"
 #include "core/common/trap.h"
 #include "core/common/debug.h"
+#include "block_cache.h"
+#include "jit.h"
 #include "csr.h"
 #include "fp.h"
+#include "isa_config.h"
 #include "mem_if.h"
+#include "quantum_keeper.h"
 #include "syscall_if.h"
 #include "util/common.h"
 #include "csr-names.h"
@@ -17,7 +22,6 @@
 #include "trap-codes.h"
 
 #include "imsic-mem.h"
-#include "imsic-if.h"
 
 #include <assert.h>
 #include <stdint.h>
@@ -28,6 +32,7 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <unordered_set>
 #include <vector>
@@ -197,6 +202,25 @@ struct ISS : public external_interrupt_target, public clint_interrupt_target, pu
 	// last decoded and executed instruction and opcode
 	Instruction instr;
 	Opcode::Mapping op;
+	DecodedInstrCache decode_cache;
+
+	/* Set on every change which can affect the pending interrupt computation (CSR writes, privilege level changes,
+	 * CLINT/IMSIC deliveries, guest switches). *prepare_interrupt* only recomputes the interrupt state if set. */
+	bool irq_state_dirty = true;
+
+	// trap signalled without an exception, see *signal_trap*
+	bool trap_pending = false;
+	SimulationTrap pending_trap;
+
+	// optional block execution engine, see *run_block*
+	bool use_block_engine = false;
+	BlockCache block_cache;
+	BasicBlock *chained_block = nullptr;  // last executed block, if its successor can be entered without translation
+	uint32_t chained_block_vaddr = 0;
+	BlockJit jit;
+
+	// execution loop of the configuration selected by *specialize*
+	void (ISS::*run_loop)() = nullptr;
 
 	CoreExecStatus status = CoreExecStatus::Runnable;
 	std::unordered_set<uint32_t> breakpoints;
@@ -205,20 +229,61 @@ struct ISS : public external_interrupt_target, public clint_interrupt_target, pu
 	sc_core::sc_event wfi_event;
 
 	std::string systemc_name;
-	tlm_utils::tlm_quantumkeeper quantum_keeper;
-	sc_core::sc_time cycle_time;
-	sc_core::sc_time cycle_counter;  // use a separate cycle counter, since cycle count can be inhibited
-	std::array<sc_core::sc_time, Opcode::NUMBER_OF_INSTRUCTIONS> instr_cycles;
+	sc_core::sc_time cycle_time = sc_core::sc_time(10, sc_core::SC_NS);
+	CycleQuantumKeeper quantum_keeper{cycle_time};
+	uint64_t cycle_counter = 0;  // use a separate cycle counter, since cycle count can be inhibited
+	std::array<uint32_t, Opcode::NUMBER_OF_INSTRUCTIONS> instr_cycles;
 
 	static constexpr int32_t REG_MIN = INT32_MIN;
 	static constexpr unsigned xlen = 32;
 
 	ISS(uint32_t hart_id, bool use_E_base_isa = false);
 
+	/* Specialize the instruction execution for the ISA configuration *Config* (see isa_config.h), misa and the
+	 * protection settings are set accordingly. Call before the simulation starts, the default is the generic
+	 * *DynamicIsaConfig*. Only the configurations instantiated at the end of iss.cpp are available. */
+	template <typename Config>
+	void specialize();
+
+	/* Extension check, a compile time constant for static configurations. These require misa to match the
+	 * configuration, i.e. misa must not be changed after *specialize*. */
+	template <typename Config>
+	inline bool has_isa(uint32_t ext) {
+		if constexpr (Config::is_dynamic) {
+			return csrs.misa.reg & ext;
+		} else {
+			assert(bool(csrs.misa.reg & ext) == bool(Config::extensions & ext) &&
+			       "misa does not match the static ISA configuration");
+			return Config::extensions & ext;
+		}
+	}
+
+	template <typename Config>
+	inline bool uses_spmp() {
+		if constexpr (Config::is_dynamic)
+			return use_spmp;
+		else
+			return Config::protection == MemoryProtection::SPMP;
+	}
+
+	template <typename Config>
+	inline bool uses_smpu() {
+		if constexpr (Config::is_dynamic)
+			return use_smpu;
+		else
+			return Config::protection == MemoryProtection::SMPU;
+	}
+
+	template <typename Config = DynamicIsaConfig>
 	void hs_inst_check_access(void);
+	template <typename Config = DynamicIsaConfig>
+	void hs_fence_check_access(void);
 	PrivilegeLevel hs_inst_lvsv_mode(void);
 
-	void exec_step();
+	template <typename Config = DynamicIsaConfig>
+	void exec_step(std::optional<uint64_t> translated_fetch_paddr = std::nullopt);
+	template <typename Config = DynamicIsaConfig>
+	void execute_op();
 	void set_pending_ivt(uint32_t address);
 	void process_pending_ivt(void);
 
@@ -262,7 +327,7 @@ struct ISS : public external_interrupt_target, public clint_interrupt_target, pu
 	void claim_topei_interrupt_internal(PrivilegeLevel target_level);
 	void claim_topei_interrupt(PrivilegeLevel target_level, bool mark_irq_handled);
 
-	void imsic_update_eip_bit(icsr_32 *eip, uint32_t value, bool set_bit);
+	void imsic_update_eip_bit(icsr_32 *eip, icsr_32 *eie, imsic_pending_summary &pending, uint32_t value, bool set_bit);
 
 	uint8_t get_iprio(PrivilegeLevel level, uint32_t iid);
 	struct irq_cprio get_external_cprio(PrivilegeLevel level);
@@ -281,7 +346,7 @@ struct ISS : public external_interrupt_target, public clint_interrupt_target, pu
 	void s_icsr_imsic_access_check(unsigned icsr_addr);
 	void sanitize_vs_external_pend(PendingInterrupts &irqs_pend);
 
-	std::tuple<bool, uint32_t> compute_imsic_pending(icsr_32 *eip, icsr_32 *eie, uint32_t size, icsr_eithreshold &eithreshold, icsr_eidelivery &eidelivery, bool nested_vectored);
+	std::tuple<bool, uint32_t> compute_imsic_pending(icsr_32 *eip, icsr_32 *eie, imsic_pending_summary &pending, icsr_eithreshold &eithreshold, icsr_eidelivery &eidelivery, bool nested_vectored);
 	void compute_imsic_pending_interrupts_m(void);
 	void compute_imsic_pending_interrupts_s(void);
 	void compute_imsic_pending_interrupts_vs(void);
@@ -337,27 +402,71 @@ struct ISS : public external_interrupt_target, public clint_interrupt_target, pu
 	uint32_t get_csr_value(uint32_t addr);
 	void set_csr_value(uint32_t addr, uint32_t value, bool read_accessed);
 
+	template <typename Config = DynamicIsaConfig>
 	bool is_invalid_csr_access(uint32_t csr_addr, bool is_write);
 	void validate_csr_counter_read_access_rights(uint32_t addr);
 
 	uint32_t csr_address_virt_transform(uint32_t addr);
 
+	template <typename Config = DynamicIsaConfig>
 	unsigned pc_alignment_mask() {
-		if (csrs.misa.has_C_extension())
+		if (has_isa<Config>(C_ISA_EXT))
 			return ~0x1;
 		else
 			return ~0x3;
 	}
 
+	template <typename Config = DynamicIsaConfig>
 	inline void trap_check_pc_alignment() {
 		assert(!(pc & 0x1) && "not possible due to immediate formats and jump execution");
 
-		if (unlikely((pc & 0x3) && (!csrs.misa.has_C_extension()))) {
+		if (unlikely((pc & 0x3) && (!has_isa<Config>(C_ISA_EXT)))) {
 			// NOTE: misaligned instruction address not possible on machines supporting compressed instructions
 			raise_trap(EXC_INSTR_ADDR_MISALIGNED, pc);
 		}
 	}
 
+	/* Alternative to *raise_trap* for the frequent traps (page faults, ecall, misaligned and illegal instructions):
+	 * the trap is taken at the end of the current step without unwinding the stack. The caller has to return
+	 * without any further side effect of the instruction. */
+	inline void signal_trap(uint32_t exc, unsigned long mtval, unsigned long mtval2_htval = 0) {
+		pending_trap = {exc, mtval, mtval2_htval};
+		trap_pending = true;
+	}
+
+	inline void signal_trap(const SimulationTrap &e) {
+		pending_trap = e;
+		trap_pending = true;
+	}
+
+	void take_pending_trap();
+
+	template <typename T>
+	inline void execute_load() {
+		uint32_t addr = regs[instr.rs1()] + instr.I_imm();
+		if (unlikely(addr % sizeof(T))) {
+			signal_trap(EXC_LOAD_ADDR_MISALIGNED, addr);
+			return;
+		}
+		uint32_t value;
+		if (unlikely(!mem->try_load(addr, sizeof(T), value, pending_trap))) {
+			trap_pending = true;
+			return;
+		}
+		regs[instr.rd()] = (T)value;
+	}
+
+	template <typename T>
+	inline void execute_store() {
+		uint32_t addr = regs[instr.rs1()] + instr.S_imm();
+		if (unlikely(addr % sizeof(T))) {
+			signal_trap(EXC_STORE_AMO_ADDR_MISALIGNED, addr);
+			return;
+		}
+		if (unlikely(!mem->try_store(addr, sizeof(T), (T)regs[instr.rs2()], pending_trap)))
+			trap_pending = true;
+	}
+
 	template <unsigned Alignment, bool isLoad>
 	inline void trap_check_addr_alignment(uint32_t addr) {
 		if (unlikely(addr % Alignment)) {
@@ -399,6 +508,8 @@ struct ISS : public external_interrupt_target, public clint_interrupt_target, pu
 
 	uint32_t get_xtinst(SimulationTrap &e);
 
+	bool is_guest_virtual_tval(SimulationTrap &e);
+
 	PrivilegeLevel prepare_trap(SimulationTrap &e);
 
 	void prepare_interrupt(const PendingInterrupts &x);
@@ -420,8 +531,24 @@ struct ISS : public external_interrupt_target, public clint_interrupt_target, pu
 
 	void switch_to_trap_handler(PrivilegeLevel target_mode);
 
+	void account_instr(Opcode::Mapping executed_op);
+	bool sync_quantum();
 	void performance_and_sync_update(Opcode::Mapping executed_op);
 
+	bool block_engine_usable();
+	template <typename Config>
+	BasicBlock *build_block(uint64_t paddr);
+	template <typename Config>
+	BasicBlock *find_block();
+	unsigned run_jit(BasicBlock *b);
+	template <typename Config>
+	void run_block();
+
+	template <typename Config>
+	void _run_step();
+	template <typename Config>
+	void _run();
+
 	void run_step() override;
 
 	void run() override;
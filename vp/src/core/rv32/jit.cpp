@@ -0,0 +1,368 @@
+#include "jit.h"
+
+#include <assert.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+
+using namespace rv32;
+
+namespace {
+
+// upper bound of the host code size of a single translated instruction (plus the final return)
+constexpr size_t MAX_HOST_BYTES_PER_OP = 32;
+
+/* x86-64 code emitter, the translated function has the signature *BasicBlock::jit_code_t*, i.e. (System V ABI)
+ * rdi holds the register file and esi the (virtual) address of the block. Only eax and ecx are used as scratch
+ * registers, both are caller saved. */
+struct X86Emitter {
+	uint8_t *p;
+
+	void byte(uint8_t x) {
+		*p++ = x;
+	}
+
+	void word(uint32_t x) {
+		memcpy(p, &x, sizeof(x));
+		p += sizeof(x);
+	}
+
+	static uint32_t reg_disp(unsigned reg) {
+		return reg * sizeof(int32_t);
+	}
+
+	// <opcode> r32, [rdi + disp32]
+	void op_mem(uint8_t opcode, unsigned host_reg, unsigned reg) {
+		byte(opcode);
+		byte(0x87 | (host_reg << 3));
+		word(reg_disp(reg));
+	}
+
+	void load_eax(unsigned reg) {
+		op_mem(0x8B, 0, reg);
+	}
+
+	void load_ecx(unsigned reg) {
+		op_mem(0x8B, 1, reg);
+	}
+
+	void store_eax(unsigned reg) {
+		op_mem(0x89, 0, reg);
+	}
+
+	// <alu> eax, imm32 (short form with eax as destination)
+	void alu_eax_imm(uint8_t opcode, int32_t imm) {
+		byte(opcode);
+		word(imm);
+	}
+
+	void shift_eax_imm(uint8_t ext, uint8_t shamt) {
+		byte(0xC1);
+		byte(0xC0 | (ext << 3));
+		byte(shamt);
+	}
+
+	void shift_eax_cl(uint8_t ext) {
+		byte(0xD3);
+		byte(0xC0 | (ext << 3));
+	}
+
+	// setcc al; movzx eax, al
+	void setcc_eax(uint8_t cc) {
+		byte(0x0F);
+		byte(0x90 | cc);
+		byte(0xC0);
+		byte(0x0F);
+		byte(0xB6);
+		byte(0xC0);
+	}
+
+	void store_imm(unsigned reg, int32_t imm) {
+		byte(0xC7);
+		byte(0x87);
+		word(reg_disp(reg));
+		word(imm);
+	}
+
+	// lea eax, [rsi + disp32]
+	void lea_eax_block_pc(int32_t disp) {
+		byte(0x8D);
+		byte(0x86);
+		word(disp);
+	}
+
+	void imul_eax_mem(unsigned reg) {
+		byte(0x0F);
+		op_mem(0xAF, 0, reg);
+	}
+
+	void ret() {
+		byte(0xC3);
+	}
+};
+
+enum : uint8_t {
+	ALU_ADD = 0x05,
+	ALU_OR = 0x0D,
+	ALU_AND = 0x25,
+	ALU_XOR = 0x35,
+	ALU_CMP = 0x3D,
+	// the same operations with a memory source operand
+	ALU_ADD_MEM = 0x03,
+	ALU_OR_MEM = 0x0B,
+	ALU_AND_MEM = 0x23,
+	ALU_SUB_MEM = 0x2B,
+	ALU_XOR_MEM = 0x33,
+	ALU_CMP_MEM = 0x3B,
+	SHIFT_SHL = 4,
+	SHIFT_SHR = 5,
+	SHIFT_SAR = 7,
+	CC_B = 0x2,  // unsigned less than
+	CC_L = 0xC,  // signed less than
+};
+
+/* Emit the host code for a single instruction located at *offset* bytes behind the start of the block. Returns
+ * false if the instruction is not supported. */
+bool emit_op(X86Emitter &e, const BasicBlock::op_t &o, uint32_t offset, bool has_M_extension) {
+	Instruction instr = o.instr;
+
+	if (o.op == Opcode::FENCE)
+		return true;
+
+	// translated code cannot trap, leave the illegal instruction exception to the interpreter
+	if (o.op == Opcode::MUL && !has_M_extension)
+		return false;
+
+	switch (o.op) {
+		case Opcode::ADDI:
+		case Opcode::SLTI:
+		case Opcode::SLTIU:
+		case Opcode::XORI:
+		case Opcode::ORI:
+		case Opcode::ANDI:
+		case Opcode::SLLI:
+		case Opcode::SRLI:
+		case Opcode::SRAI:
+		case Opcode::ADD:
+		case Opcode::SUB:
+		case Opcode::SLL:
+		case Opcode::SLT:
+		case Opcode::SLTU:
+		case Opcode::SRL:
+		case Opcode::SRA:
+		case Opcode::XOR:
+		case Opcode::OR:
+		case Opcode::AND:
+		case Opcode::LUI:
+		case Opcode::AUIPC:
+		case Opcode::MUL:
+			break;
+		default:
+			return false;
+	}
+
+	// no side effects besides writing rd, and writes to zero are ignored
+	if (instr.rd() == 0)
+		return true;
+
+	switch (o.op) {
+		case Opcode::ADDI:
+			e.load_eax(instr.rs1());
+			e.alu_eax_imm(ALU_ADD, instr.I_imm());
+			break;
+		case Opcode::SLTI:
+			e.load_eax(instr.rs1());
+			e.alu_eax_imm(ALU_CMP, instr.I_imm());
+			e.setcc_eax(CC_L);
+			break;
+		case Opcode::SLTIU:
+			e.load_eax(instr.rs1());
+			e.alu_eax_imm(ALU_CMP, instr.I_imm());
+			e.setcc_eax(CC_B);
+			break;
+		case Opcode::XORI:
+			e.load_eax(instr.rs1());
+			e.alu_eax_imm(ALU_XOR, instr.I_imm());
+			break;
+		case Opcode::ORI:
+			e.load_eax(instr.rs1());
+			e.alu_eax_imm(ALU_OR, instr.I_imm());
+			break;
+		case Opcode::ANDI:
+			e.load_eax(instr.rs1());
+			e.alu_eax_imm(ALU_AND, instr.I_imm());
+			break;
+		case Opcode::SLLI:
+			e.load_eax(instr.rs1());
+			e.shift_eax_imm(SHIFT_SHL, instr.shamt());
+			break;
+		case Opcode::SRLI:
+			e.load_eax(instr.rs1());
+			e.shift_eax_imm(SHIFT_SHR, instr.shamt());
+			break;
+		case Opcode::SRAI:
+			e.load_eax(instr.rs1());
+			e.shift_eax_imm(SHIFT_SAR, instr.shamt());
+			break;
+		case Opcode::ADD:
+			e.load_eax(instr.rs1());
+			e.op_mem(ALU_ADD_MEM, 0, instr.rs2());
+			break;
+		case Opcode::SUB:
+			e.load_eax(instr.rs1());
+			e.op_mem(ALU_SUB_MEM, 0, instr.rs2());
+			break;
+		case Opcode::XOR:
+			e.load_eax(instr.rs1());
+			e.op_mem(ALU_XOR_MEM, 0, instr.rs2());
+			break;
+		case Opcode::OR:
+			e.load_eax(instr.rs1());
+			e.op_mem(ALU_OR_MEM, 0, instr.rs2());
+			break;
+		case Opcode::AND:
+			e.load_eax(instr.rs1());
+			e.op_mem(ALU_AND_MEM, 0, instr.rs2());
+			break;
+		case Opcode::SLT:
+			e.load_eax(instr.rs1());
+			e.op_mem(ALU_CMP_MEM, 0, instr.rs2());
+			e.setcc_eax(CC_L);
+			break;
+		case Opcode::SLTU:
+			e.load_eax(instr.rs1());
+			e.op_mem(ALU_CMP_MEM, 0, instr.rs2());
+			e.setcc_eax(CC_B);
+			break;
+		// x86 masks 32 bit shift amounts to 5 bits, same as RV32
+		case Opcode::SLL:
+			e.load_ecx(instr.rs2());
+			e.load_eax(instr.rs1());
+			e.shift_eax_cl(SHIFT_SHL);
+			break;
+		case Opcode::SRL:
+			e.load_ecx(instr.rs2());
+			e.load_eax(instr.rs1());
+			e.shift_eax_cl(SHIFT_SHR);
+			break;
+		case Opcode::SRA:
+			e.load_ecx(instr.rs2());
+			e.load_eax(instr.rs1());
+			e.shift_eax_cl(SHIFT_SAR);
+			break;
+		case Opcode::LUI:
+			e.store_imm(instr.rd(), instr.U_imm());
+			return true;
+		case Opcode::AUIPC:
+			e.lea_eax_block_pc(offset + instr.U_imm());
+			break;
+		case Opcode::MUL:
+			e.load_eax(instr.rs1());
+			e.imul_eax_mem(instr.rs2());
+			break;
+		default:
+			assert(false);
+	}
+
+	e.store_eax(instr.rd());
+	return true;
+}
+
+}  // namespace
+
+BlockJit::~BlockJit() {
+	if (buffer)
+		munmap(buffer, BUFFER_SIZE);
+}
+
+bool BlockJit::is_supported() {
+#if defined(__x86_64__)
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool BlockJit::reserve(size_t size) {
+	if (buffer_failed)
+		return false;
+
+	if (!buffer) {
+		// W^X: the buffer is never mapped writable and executable at the same time, see *protect*
+		void *p = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			std::cerr << "[ISS] WARNING: cannot allocate executable memory, JIT disabled" << std::endl;
+			buffer_failed = true;
+			return false;
+		}
+		buffer = (uint8_t *)p;
+	}
+
+	if (used + size > BUFFER_SIZE) {
+		// drop all translations and start over
+		used = 0;
+		++generation;
+	}
+	return true;
+}
+
+bool BlockJit::protect(size_t begin, size_t end, int prot) {
+	static const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	begin &= ~(page_size - 1);
+	end = std::min((end + page_size - 1) & ~(page_size - 1), BUFFER_SIZE);
+
+	if (mprotect(buffer + begin, end - begin, prot) == 0)
+		return true;
+
+	std::cerr << "[ISS] WARNING: cannot change the protection of the JIT code buffer, JIT disabled" << std::endl;
+	buffer_failed = true;
+	++generation;
+	return false;
+}
+
+void BlockJit::translate(BasicBlock &b, bool has_M_extension,
+                         const std::array<uint32_t, Opcode::NUMBER_OF_INSTRUCTIONS> &instr_cycles) {
+	b.jit_ops = 0;
+	b.jit_bytes = 0;
+	b.jit_cycles = 0;
+	b.jit_code = nullptr;
+
+	if (!is_supported() || b.num_ops < 2 || !reserve(BasicBlock::MAX_OPS * MAX_HOST_BYTES_PER_OP + 1)) {
+		b.jit_generation = generation;
+		return;
+	}
+	b.jit_generation = generation;
+
+	// the pages of the emitted range are writable only while the block is emitted
+	const size_t begin = used;
+	const size_t end = begin + BasicBlock::MAX_OPS * MAX_HOST_BYTES_PER_OP + 1;
+	if (!protect(begin, end, PROT_READ | PROT_WRITE))
+		return;
+
+	X86Emitter e{buffer + used};
+	uint8_t *start = e.p;
+
+	for (unsigned i = 0; i + 1 < b.num_ops; ++i) {
+		const BasicBlock::op_t &o = b.ops[i];
+		if (!emit_op(e, o, b.jit_bytes, has_M_extension))
+			break;
+		++b.jit_ops;
+		b.jit_bytes += o.length;
+		b.jit_cycles += instr_cycles[o.op];
+	}
+
+	if (b.jit_ops != 0) {
+		e.ret();
+		assert((size_t)(e.p - start) <= end - begin);
+		used += e.p - start;
+	}
+
+	if (!protect(begin, end, PROT_READ | PROT_EXEC) || b.jit_ops == 0) {
+		b.jit_ops = 0;
+		return;
+	}
+	b.jit_code = (BasicBlock::jit_code_t)start;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <array>
+
+#include "block_cache.h"
+#include "core/common/instr.h"
+
+namespace rv32 {
+
+/* Minimal dynamic binary translator for the block engine. The leading pure integer instructions of a hot basic
+ * block are translated into x86-64 host code which operates directly on the register file. Everything else
+ * (memory accesses, control flow, CSRs, traps, interrupts) is left to the interpreter, which executes the rest of
+ * the block. Translated code cannot trap, hence falling back to the interpreter is always exact.
+ *
+ * Only available on x86-64 hosts, *is_supported* is false elsewhere and the block engine keeps interpreting. */
+struct BlockJit {
+	// number of block executions before it is translated
+	static constexpr unsigned HOT_THRESHOLD = 16;
+	static constexpr size_t BUFFER_SIZE = 4 * 1024 * 1024;
+
+	bool enabled = false;
+	// execute all translated code also in the interpreter and abort on any difference
+	bool check = false;
+
+	BlockJit() = default;
+	BlockJit(const BlockJit &) = delete;
+	BlockJit &operator=(const BlockJit &) = delete;
+	~BlockJit();
+
+	static bool is_supported();
+
+	/* Translate the leading translatable instructions of *b* (never the last one, which is left to the regular
+	 * per instruction interrupt and sync handling). Sets the *jit_* fields of *b*, *jit_ops* is zero if nothing
+	 * could be translated. */
+	void translate(BasicBlock &b, bool has_M_extension,
+	               const std::array<uint32_t, Opcode::NUMBER_OF_INSTRUCTIONS> &instr_cycles);
+
+	/* Translations are dropped by changing the generation, e.g. if the code buffer is full. */
+	inline uint64_t get_generation() const {
+		return generation;
+	}
+
+   private:
+	uint8_t *buffer = nullptr;
+	size_t used = 0;
+	uint64_t generation = 1;
+	bool buffer_failed = false;
+
+	bool reserve(size_t size);
+	/* Change the protection of the pages covering [*begin*, *end*) of the buffer. */
+	bool protect(size_t begin, size_t end, int prot);
+};
+
+}  // namespace rv32
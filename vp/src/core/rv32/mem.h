@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/common/dmi.h"
+#include "core/common/payload_pool.h"
 #include "iss.h"
 #include "core/common/protected_access.h"
 #include "mmu.h"
@@ -9,47 +10,125 @@
 
 namespace rv32 {
 
-/* For optimization, use DMI to fetch instructions */
+/* For optimization, use DMI to fetch instructions. The DMI range is obtained from (and fetches outside of DMI memory
+ * are forwarded to) the memory interface of the core, see *dmi_provider_if*. */
 struct InstrMemoryProxy : public instr_memory_if {
+	dmi_provider_if &mem;
 	MemoryDMI dmi;
+	uint64_t dmi_generation;
 
-	tlm_utils::tlm_quantumkeeper &quantum_keeper;
+	CycleQuantumKeeper &quantum_keeper;
 	sc_core::sc_time clock_cycle = sc_core::sc_time(10, sc_core::SC_NS);
 	sc_core::sc_time access_delay = clock_cycle * 2;
 
-	InstrMemoryProxy(const MemoryDMI &dmi, ISS &owner) : dmi(dmi), quantum_keeper(owner.quantum_keeper) {}
+	InstrMemoryProxy(dmi_provider_if &mem, ISS &owner)
+	    : mem(mem), dmi_generation(mem.get_dmi_generation()), quantum_keeper(owner.quantum_keeper) {}
+
+	/* Whether the instruction word at *paddr* is covered by the DMI range, which is (re-)requested if necessary. */
+	inline bool has_dmi(uint64_t paddr) {
+		if (unlikely(dmi_generation != mem.get_dmi_generation())) {
+			dmi = MemoryDMI();
+			dmi_generation = mem.get_dmi_generation();
+		}
+
+		if (unlikely(!dmi.contains(paddr)) && !mem.get_dmi_range(paddr, dmi))
+			return false;
+		return (paddr + sizeof(uint32_t)) <= dmi.get_end();
+	}
 
 	virtual uint32_t load_instr(uint64_t pc) override {
+		bool cacheable;
+		return load_instr_paddr(pc, cacheable);
+	}
+
+	virtual uint32_t load_instr_paddr(uint64_t paddr, bool &cacheable) override {
+		if (unlikely(!has_dmi(paddr)))
+			return mem.load_instr_paddr(paddr, cacheable);
+
+		cacheable = true;
+		quantum_keeper.inc(access_delay);
+		return dmi.load<uint32_t>(paddr);
+	}
+
+	virtual void account_cached_instr_fetch() override {
 		quantum_keeper.inc(access_delay);
-		return dmi.load<uint32_t>(pc);
+	}
+
+	virtual bool peek_instr_paddr(uint64_t paddr, uint32_t &word) override {
+		if (!has_dmi(paddr))
+			return false;
+		word = dmi.load<uint32_t>(paddr);
+		return true;
 	}
 };
 
-struct CombinedMemoryInterface : public sc_core::sc_module,
-                                 public instr_memory_if,
-                                 public data_memory_if,
-                                 public mmu_memory_if,
-                                 public spmp_memory_if,
-                                 public smpu_memory_if {
+/* Memory interface of the ISS, the protection checks of the access paths are specialized for *Config* (see
+ * isa_config.h), which has to match the configuration of the ISS. */
+template <typename Config = DynamicIsaConfig>
+struct CombinedMemoryInterfaceT : public sc_core::sc_module,
+                                  public instr_memory_if,
+                                  public data_memory_if,
+                                  public mmu_memory_if,
+                                  public spmp_memory_if,
+                                  public smpu_memory_if,
+                                  public dmi_provider_if {
 	ISS &iss;
 	std::shared_ptr<bus_lock_if> bus_lock;
 	uint64_t lr_addr = 0;
 
-	tlm_utils::simple_initiator_socket<CombinedMemoryInterface> isock;
-	tlm_utils::tlm_quantumkeeper &quantum_keeper;
+	tlm_utils::simple_initiator_socket<CombinedMemoryInterfaceT> isock;
+	CycleQuantumKeeper &quantum_keeper;
+	BlockingPayload bus_payload;  // for all bus and DMI requests of the core, tagged with its hart id
 
 	// optionally add DMI ranges for optimization
 	sc_core::sc_time clock_cycle = sc_core::sc_time(10, sc_core::SC_NS);
 	sc_core::sc_time dmi_access_delay = clock_cycle * 4;
 	std::vector<MemoryDMI> dmi_ranges;
 
+	/* With *lazy_dmi* set, the DMI range of a region is requested from the bus on the first access to it and added
+	 * to *dmi_ranges*. Regions the targets refused DMI for are remembered in *dmi_denied* (inclusive bounds) so they
+	 * are not asked again. Both are reset whenever a target invalidates its DMI ranges. */
+	bool lazy_dmi = false;
+	std::vector<std::pair<uint64_t, uint64_t>> dmi_denied;
+	uint64_t dmi_generation = 0;
+
+	/* Fast data TLB (softmmu style): maps a virtual page to the host memory of the DMI range backing it, once the slow
+	 * path (protection checks, address translation, DMI lookup) succeeded for an access to the page and its result is
+	 * known to hold for the whole page. A hit only compares the tag and adds the page offset, the timing is the same
+	 * as for the slow path with an MMU TLB hit.
+	 * Entries are kept per privilege level and access type. Accesses with mstatus.MPRV set, explicit privilege
+	 * overrides and virtual modes always take the slow path. MMU translations are only cached while the MMU TLB holds
+	 * them (see *mmu_tlb_evicted*), everything else the cached result depends on flushes the entries
+	 * (see *data_memory_if::flush_fast_tlb*). */
+	struct fast_tlb_entry_t {
+		uint64_t vpage = -1;  // tag, never matches if all ones
+		uint64_t ppage = 0;
+		uint8_t *host = nullptr;
+	};
+
+	static constexpr unsigned FAST_TLB_ENTRIES = 256;
+	static constexpr unsigned FAST_TLB_MODES = MachineMode + 1;
+
+	fast_tlb_entry_t fast_tlb[FAST_TLB_MODES][2][FAST_TLB_ENTRIES];  // LOAD, STORE
+	sc_core::sc_time fast_tlb_delay[FAST_TLB_MODES];
+
     MMU *mmu;
     SPMP *spmp;
     SMPU *smpu;
 
-	CombinedMemoryInterface(sc_core::sc_module_name, ISS &owner, MMU *mmu = nullptr,
+	CombinedMemoryInterfaceT(sc_core::sc_module_name, ISS &owner, MMU *mmu = nullptr,
 	      SPMP *spmp = nullptr, SMPU *smpu = nullptr)
-	    : iss(owner), quantum_keeper(iss.quantum_keeper), mmu(mmu), spmp(spmp), smpu(smpu) {
+	    : iss(owner), quantum_keeper(iss.quantum_keeper), bus_payload(iss.get_hart_id()), mmu(mmu), spmp(spmp), smpu(smpu) {
+		assert((Config::is_dynamic || ((mmu != nullptr) == (Config::protection == MemoryProtection::MMU))) &&
+		       "MMU does not match the ISA configuration");
+		isock.register_invalidate_direct_mem_ptr(this, &CombinedMemoryInterfaceT::invalidate_direct_mem_ptr);
+	}
+
+	inline bool has_mmu() const {
+		if constexpr (Config::is_dynamic)
+			return mmu != nullptr;
+		else
+			return Config::protection == MemoryProtection::MMU;
 	}
 
 	inline bool phya_spmp_check(PrivilegeLevel mode, uint64_t paddr, uint32_t sz,
@@ -67,18 +146,29 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 	}
 
     uint64_t v2p(uint64_t vaddr, MemoryAccessType type) override {
-	    if (mmu == nullptr)
+	    if (!has_mmu())
 	        return vaddr;
         return mmu->translate_virtual_to_physical_addr(vaddr, type);
     }
 
+	// translation of a hypervisor virtual machine load/store (HLV/HLVX/HSV) in mode *privilege_override*
+	uint64_t v2p(uint64_t vaddr, MemoryAccessType type, PrivilegeLevel privilege_override, bool is_hlvx_access) {
+		if (!has_mmu())
+			return vaddr;
+		return mmu->translate_virtual_to_physical_addr(vaddr, type, privilege_override, is_hlvx_access);
+	}
+
+	inline bool try_v2p(uint64_t vaddr, MemoryAccessType type, uint64_t &paddr, SimulationTrap &trap) {
+		if (!has_mmu()) {
+			paddr = vaddr;
+			return true;
+		}
+		return mmu->try_translate(vaddr, type, paddr, trap);
+	}
+
 	inline void _do_transaction(tlm::tlm_command cmd, uint64_t addr, uint8_t *data, unsigned num_bytes) {
-		tlm::tlm_generic_payload trans;
-		trans.set_command(cmd);
-		trans.set_address(addr);
-		trans.set_data_ptr(data);
-		trans.set_data_length(num_bytes);
-		trans.set_response_status(tlm::TLM_OK_RESPONSE);
+		auto &trans = bus_payload.prepare(cmd, addr, data, num_bytes, iss.prv);
+		trans.set_response_status(tlm::TLM_OK_RESPONSE);  // not all targets set it
 
 		sc_core::sc_time local_delay = quantum_keeper.get_local_time();
 
@@ -99,11 +189,26 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 		}
 	}
 
+	/* Waiting for the bus lock of another hart might advance the SystemC time, see *CycleQuantumKeeper::resume*. */
+	inline void wait_for_access_rights() {
+		if (unlikely(bus_lock->is_locked() && !bus_lock->is_locked(iss.get_hart_id()))) {
+			bus_lock->wait_until_unlocked();
+			quantum_keeper.resume();
+		}
+	}
+
+	inline void lock_bus() {
+		bool contended = bus_lock->is_locked() && !bus_lock->is_locked(iss.get_hart_id());
+		bus_lock->lock(iss.get_hart_id());
+		if (unlikely(contended))
+			quantum_keeper.resume();
+	}
+
 	template <typename T>
 	inline T _raw_load_data(uint64_t addr) {
 		// NOTE: a DMI load will not context switch (SystemC) and not modify the memory, hence should be able to
 		// postpone the lock after the dmi access
-		bus_lock->wait_for_access_rights(iss.get_hart_id());
+		wait_for_access_rights();
 
 		for (auto &e : dmi_ranges) {
 			if (e.contains(addr)) {
@@ -112,29 +217,227 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 			}
 		}
 
+		if (auto e = acquire_dmi(addr)) {
+			quantum_keeper.inc(dmi_access_delay);
+			return e->template load<T>(addr);
+		}
+
 		T ans;
 		_do_transaction(tlm::TLM_READ_COMMAND, addr, (uint8_t *)&ans, sizeof(T));
 		return ans;
 	}
 
+	inline bool is_dmi_backed(uint64_t addr) {
+		for (auto &e : dmi_ranges) {
+			if (e.contains(addr))
+				return true;
+		}
+		return acquire_dmi(addr) != nullptr;
+	}
+
+	/* Request the DMI range of *addr* from the bus, unless the targets refused it before. */
+	bool request_dmi(uint64_t addr, MemoryDMI &dmi) {
+		for (auto &r : dmi_denied) {
+			if (addr >= r.first && addr <= r.second)
+				return false;
+		}
+
+		auto &trans = bus_payload.prepare(tlm::TLM_READ_COMMAND, addr, nullptr, 0, iss.prv);
+		tlm::tlm_dmi dmi_data;
+
+		if (!isock->get_direct_mem_ptr(trans, dmi_data) || !dmi_data.is_read_allowed()) {
+			dmi_denied.push_back({dmi_data.get_start_address(), dmi_data.get_end_address()});
+			return false;
+		}
+
+		assert(dmi_data.get_start_address() <= addr && addr <= dmi_data.get_end_address());
+		dmi = MemoryDMI::create_start_end_mapping(dmi_data.get_dmi_ptr(), dmi_data.get_start_address(),
+		                                          dmi_data.get_end_address() + 1, dmi_data.is_write_allowed());
+		return true;
+	}
+
+	/* Add the DMI range of *addr* (if *lazy_dmi* is set and it is not covered yet), nullptr if there is none. */
+	MemoryDMI *acquire_dmi(uint64_t addr) {
+		if (!lazy_dmi)
+			return nullptr;
+
+		for (auto &e : dmi_ranges) {
+			if (e.contains(addr))
+				return nullptr;
+		}
+
+		MemoryDMI dmi;
+		if (!request_dmi(addr, dmi))
+			return nullptr;
+
+		dmi_ranges.push_back(dmi);
+		return &dmi_ranges.back();
+	}
+
+	bool get_dmi_range(uint64_t addr, MemoryDMI &dmi) override {
+		for (auto &e : dmi_ranges) {
+			if (e.contains(addr)) {
+				dmi = e;
+				return true;
+			}
+		}
+
+		if (lazy_dmi) {
+			auto e = acquire_dmi(addr);
+			if (e)
+				dmi = *e;
+			return e != nullptr;
+		}
+		return request_dmi(addr, dmi);
+	}
+
+	uint64_t get_dmi_generation() override {
+		return dmi_generation;
+	}
+
 	template <typename T>
 	inline void _raw_store_data(uint64_t addr, T value) {
-		bus_lock->wait_for_access_rights(iss.get_hart_id());
+		wait_for_access_rights();
+
+		iss.decode_cache.invalidate_store(addr, sizeof(T));
 
 		bool done = false;
 		for (auto &e : dmi_ranges) {
-			if (e.contains(addr)) {
+			if (e.contains(addr) && e.is_writable()) {
 				quantum_keeper.inc(dmi_access_delay);
 				e.store(addr, value);
 				done = true;
 			}
 		}
 
+		if (!done) {
+			auto e = acquire_dmi(addr);
+			if (e && e->is_writable()) {
+				quantum_keeper.inc(dmi_access_delay);
+				e->store(addr, value);
+				done = true;
+			}
+		}
+
 		if (!done)
 			_do_transaction(tlm::TLM_WRITE_COMMAND, addr, (uint8_t *)&value, sizeof(T));
 		atomic_unlock();
 	}
 
+	/* Host address of the physical page *ppage*, if it is covered by a single DMI range (the slow path accesses all
+	 * ranges that overlap the address), which has to be writable for stores. */
+	inline uint8_t *dmi_page_ptr(uint64_t ppage, MemoryAccessType type) {
+		uint8_t *host = nullptr;
+		for (auto &e : dmi_ranges) {
+			if (ppage >= e.get_end() || (ppage + PGSIZE) <= e.get_start())
+				continue;
+			if (host || !e.contains(ppage) || (ppage + PGSIZE) > e.get_end() || (type == STORE && !e.is_writable()))
+				return nullptr;
+			host = e.get_mem_ptr_to_global_addr<uint8_t>(ppage);
+		}
+		return host;
+	}
+
+	/* Fast TLB entry of *addr*, nullptr on a miss. Accesses that are misaligned (hence possibly cross the page) never
+	 * match the tag. */
+	template <typename T>
+	inline fast_tlb_entry_t *fast_tlb_lookup(uint64_t addr, MemoryAccessType type) {
+		auto mode = iss.prv;
+		if (unlikely(mode >= FAST_TLB_MODES || iss.csrs.mstatus.fields.mprv))
+			return nullptr;
+
+		auto &e = fast_tlb[mode][type == STORE][(addr >> PGSHIFT) % FAST_TLB_ENTRIES];
+		if (likely(e.vpage == (addr & (~uint64_t(PGMASK) | (sizeof(T) - 1)))))
+			return &e;
+		return nullptr;
+	}
+
+	/* Cache the successful slow path access of *vaddr* (translated to *paddr*), see *fast_tlb*. Must only be called if
+	 * the protection checks and the translation hold for the whole page. */
+	inline void fast_tlb_fill(uint64_t vaddr, uint64_t paddr, MemoryAccessType type) {
+		auto mode = iss.prv;
+		if (mode >= FAST_TLB_MODES || iss.csrs.mstatus.fields.mprv)
+			return;
+
+		uint64_t ppage = paddr & ~uint64_t(PGMASK);
+		uint8_t *host = dmi_page_ptr(ppage, type);
+		if (!host)
+			return;
+
+		auto &e = fast_tlb[mode][type == STORE][(vaddr >> PGSHIFT) % FAST_TLB_ENTRIES];
+		e.vpage = vaddr & ~uint64_t(PGMASK);
+		e.ppage = ppage;
+		e.host = host;
+
+		// the same for all pages of the privilege level until the next flush (satp write)
+		fast_tlb_delay[mode] = dmi_access_delay;
+		if (has_mmu() && mmu->translation_mode(type) != MachineMode)
+			fast_tlb_delay[mode] += mmu->mmu_access_delay;
+	}
+
+	void flush_fast_tlb(PrivilegeLevel mode = NoneMode) override {
+		if (mode == NoneMode) {
+			memset(&fast_tlb[0], -1, sizeof(fast_tlb));
+		} else {
+			assert(mode < FAST_TLB_MODES);
+			memset(&fast_tlb[mode], -1, sizeof(fast_tlb[mode]));
+		}
+	}
+
+	void mmu_tlb_evicted(uint64_t vaddr, uint64_t size) override {
+		for (auto &mode_entries : fast_tlb) {
+			for (auto &entries : mode_entries) {
+				if (size == PGSIZE) {
+					auto &e = entries[(vaddr >> PGSHIFT) % FAST_TLB_ENTRIES];
+					if (e.vpage == vaddr)
+						e.vpage = -1;
+				} else {
+					for (auto &e : entries) {
+						if (e.vpage - vaddr < size)
+							e.vpage = -1;
+					}
+				}
+			}
+		}
+	}
+
+	/* The target revoked the DMI access to [start, end]. */
+	void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end) {
+		auto overlaps = [=](MemoryDMI &e) { return start < e.get_end() && e.get_start() <= end; };
+		dmi_ranges.erase(std::remove_if(dmi_ranges.begin(), dmi_ranges.end(), overlaps), dmi_ranges.end());
+		dmi_denied.clear();
+		dmi_generation++;
+		flush_fast_tlb();
+		// cached instructions have been fetched without side effects, as they were served from DMI
+		iss.decode_cache.flush();
+	}
+
+	template <typename T>
+	inline bool fast_load(uint64_t addr, T &value) {
+		auto e = fast_tlb_lookup<T>(addr, LOAD);
+		if (!e)
+			return false;
+
+		wait_for_access_rights();
+		quantum_keeper.inc(fast_tlb_delay[iss.prv]);
+		memcpy(&value, e->host + (addr & PGMASK), sizeof(T));
+		return true;
+	}
+
+	template <typename T>
+	inline bool fast_store(uint64_t addr, T value) {
+		auto e = fast_tlb_lookup<T>(addr, STORE);
+		if (!e)
+			return false;
+
+		wait_for_access_rights();
+		iss.decode_cache.invalidate_store(e->ppage | (addr & PGMASK), sizeof(T));
+		quantum_keeper.inc(fast_tlb_delay[iss.prv]);
+		memcpy(e->host + (addr & PGMASK), &value, sizeof(T));
+		atomic_unlock();
+		return true;
+	}
+
 	inline PrivilegeLevel get_mem_mode(MemoryAccessType type, PrivilegeLevel privilege_override) {
 		auto mode = iss.prv;
 		if (type != FETCH && iss.csrs.mstatus.fields.mprv)
@@ -154,37 +457,92 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 		return smpu_done;
 	}
 
-	template <typename T>
-	inline T _load_data(uint64_t addr, PrivilegeLevel privilege_override = NoneMode, bool is_hlvx_access = false) {
-		auto mode = get_mem_mode(LOAD, privilege_override);
-
-		if (iss.use_smpu) { // SMPU
-			if (_phya_smpu_check(mode, &addr, sizeof(T), LOAD, is_hlvx_access))
-				return _raw_load_data<T>(addr);
-		} else if (iss.use_spmp) { // SPMP
-			if (phya_spmp_check(mode, addr, sizeof(T), LOAD))
-				return _raw_load_data<T>(addr);
+	/* Protection checks and address translation of the slow data access path. *page_wide* is cleared if the result
+	 * does not necessarily hold for the whole page, i.e. must not be cached in the fast TLB. */
+	inline uint64_t translate_data_addr(uint64_t addr, uint32_t sz, MemoryAccessType type,
+			PrivilegeLevel privilege_override, bool is_hlvx_access, bool &page_wide) {
+		auto mode = get_mem_mode(type, privilege_override);
+
+		if (iss.uses_smpu<Config>()) { // SMPU
+			if (_phya_smpu_check(mode, &addr, sz, type, is_hlvx_access)) {
+				// SMPU regions can be smaller than a page and translate addresses, only cache the unchecked M-mode
+				page_wide &= mode == MachineMode;
+				return addr;
+			}
+		} else if (iss.uses_spmp<Config>()) { // SPMP
+			if (phya_spmp_check(mode, addr, sz, type)) {
+				page_wide &= spmp->is_range_accessible(mode, addr & ~uint64_t(PGMASK), PGSIZE, type);
+				return addr;
+			}
 		}
 		/* satp.mode != Bare, then paged Virtual Memory only */
-		return _raw_load_data<T>(v2p(addr, LOAD));
+		return v2p(addr, type, privilege_override, is_hlvx_access);
+	}
+
+	template <typename T>
+	inline T _load_data(uint64_t addr, PrivilegeLevel privilege_override = NoneMode, bool is_hlvx_access = false) {
+		T value;
+		bool cacheable = privilege_override == NoneMode && !is_hlvx_access;
+		if (cacheable && fast_load(addr, value))
+			return value;
+
+		uint64_t paddr = translate_data_addr(addr, sizeof(T), LOAD, privilege_override, is_hlvx_access, cacheable);
+		value = _raw_load_data<T>(paddr);
+		if (cacheable)
+			fast_tlb_fill(addr, paddr, LOAD);
+		return value;
 	}
 
 	template <typename T>
 	inline void _store_data(uint64_t addr, T value, PrivilegeLevel privilege_override = NoneMode) {
-		auto mode = get_mem_mode(STORE, privilege_override);
+		bool cacheable = privilege_override == NoneMode;
+		if (cacheable && fast_store(addr, value))
+			return;
+
+		uint64_t paddr = translate_data_addr(addr, sizeof(T), STORE, privilege_override, false, cacheable);
+		_raw_store_data(paddr, value);
+		if (cacheable)
+			fast_tlb_fill(addr, paddr, STORE);
+	}
 
-		if (iss.use_smpu) { // SMPU
-			if (_phya_smpu_check(mode, &addr, sizeof(T), STORE)) {
-				_raw_store_data<T>(addr, value);
-				return;
-			}
-		} else if (iss.use_spmp) { // SPMP
-			if (phya_spmp_check(mode, addr, sizeof(T), STORE)) {
-				_raw_store_data<T>(addr, value);
-				return;
-			}
+	// SPMP/SMPU checks still throw, the non-throwing path only covers the MMU
+	template <typename T>
+	inline bool _try_load_data(uint64_t addr, uint32_t &value, SimulationTrap &trap) {
+		if (iss.uses_smpu<Config>() || iss.uses_spmp<Config>()) {
+			value = _load_data<T>(addr);
+			return true;
 		}
-		_raw_store_data(v2p(addr, STORE), value);
+
+		T x;
+		if (fast_load(addr, x)) {
+			value = x;
+			return true;
+		}
+
+		uint64_t paddr;
+		if (unlikely(!try_v2p(addr, LOAD, paddr, trap)))
+			return false;
+		value = _raw_load_data<T>(paddr);
+		fast_tlb_fill(addr, paddr, LOAD);
+		return true;
+	}
+
+	template <typename T>
+	inline bool _try_store_data(uint64_t addr, T value, SimulationTrap &trap) {
+		if (iss.uses_smpu<Config>() || iss.uses_spmp<Config>()) {
+			_store_data<T>(addr, value);
+			return true;
+		}
+
+		if (fast_store(addr, value))
+			return true;
+
+		uint64_t paddr;
+		if (unlikely(!try_v2p(addr, STORE, paddr, trap)))
+			return false;
+		_raw_store_data<T>(paddr, value);
+		fast_tlb_fill(addr, paddr, STORE);
+		return true;
 	}
 
     uint64_t mmu_load_pte64(uint64_t addr) override {
@@ -199,23 +557,90 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 
     void flush_tlb() override {
         mmu->flush_tlb();
+        flush_fast_tlb();
+    }
+
+    void clear_smpu_cache() override {
+        if (smpu)
+            smpu->clear_smpu_cache();
     }
 
+	void flush_tlb(bool has_vaddr, uint64_t vaddr, bool has_asid, uint32_t asid) override {
+		if (has_mmu())
+			mmu->flush_tlb(has_vaddr, vaddr, has_asid, asid);
+		// selectively dropped pages are reported by the MMU (see *mmu_tlb_evicted*), a full flush is not
+		if (!has_vaddr && !has_asid)
+			flush_fast_tlb();
+	}
+
+	// the fast TLB does not cache guest translations
+	void hfence_vvma(bool has_vaddr, uint64_t vaddr, bool has_asid, uint32_t asid) override {
+		if (has_mmu())
+			mmu->hfence_vvma(has_vaddr, vaddr, has_asid, asid);
+	}
+
+	void hfence_gvma(bool has_gaddr, uint64_t gaddr, bool has_vmid, uint32_t vmid) override {
+		if (has_mmu())
+			mmu->hfence_gvma(has_gaddr, gaddr, has_vmid, vmid);
+	}
+
     void clear_spmp_cache() override {
         spmp->clear_spmp_cache();
+        flush_fast_tlb();
     }
 
-	uint32_t load_instr(uint64_t addr) override {
+	uint64_t translate_instr_addr(uint64_t addr) override {
 		auto mode = get_mem_mode(FETCH, NoneMode);
 
-		if (iss.use_smpu) { // SMPU
+		if (iss.uses_smpu<Config>()) { // SMPU
 			if (_phya_smpu_check(mode, &addr, sizeof(uint32_t), FETCH))
-				return _raw_load_data<uint32_t>(addr);
-		} else if (iss.use_spmp) { // SPMP
+				return addr;
+		} else if (iss.uses_spmp<Config>()) { // SPMP
 			if (phya_spmp_check(mode, addr, sizeof(uint32_t), FETCH))
-				return _raw_load_data<uint32_t>(addr);
+				return addr;
+		}
+		return v2p(addr, FETCH);
+	}
+
+	bool try_translate_instr_addr(uint64_t addr, uint64_t &paddr, SimulationTrap &trap) override {
+		if (iss.uses_smpu<Config>() || iss.uses_spmp<Config>()) {
+			paddr = translate_instr_addr(addr);
+			return true;
 		}
-		return _raw_load_data<uint32_t>(v2p(addr, FETCH));
+		return try_v2p(addr, FETCH, paddr, trap);
+	}
+
+	uint32_t load_instr(uint64_t addr) override {
+		return _raw_load_data<uint32_t>(translate_instr_addr(addr));
+	}
+
+	uint32_t load_instr_paddr(uint64_t paddr, bool &cacheable) override {
+		cacheable = is_dmi_backed(paddr);
+		return _raw_load_data<uint32_t>(paddr);
+	}
+
+	void account_cached_instr_fetch() override {
+		quantum_keeper.inc(dmi_access_delay);
+	}
+
+	void account_skipped_instr_translation() override {
+		if (has_mmu())
+			mmu->account_tlb_hit(FETCH);
+	}
+
+	bool peek_instr_paddr(uint64_t paddr, uint32_t &word) override {
+		for (auto &e : dmi_ranges) {
+			if (e.contains(paddr) && (paddr + sizeof(uint32_t)) <= e.get_end()) {
+				word = e.load<uint32_t>(paddr);
+				return true;
+			}
+		}
+
+		auto e = acquire_dmi(paddr);
+		if (!e || (paddr + sizeof(uint32_t)) > e->get_end())
+			return false;
+		word = e->template load<uint32_t>(paddr);
+		return true;
 	}
 
     int64_t load_double(uint64_t addr) override {
@@ -252,8 +677,26 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 		_store_data(addr, value, privilege_override);
 	}
 
+	bool try_load(uint64_t addr, unsigned num_bytes, uint32_t &value, SimulationTrap &trap) override {
+		if (num_bytes == 1)
+			return _try_load_data<uint8_t>(addr, value, trap);
+		else if (num_bytes == 2)
+			return _try_load_data<uint16_t>(addr, value, trap);
+		else
+			return _try_load_data<uint32_t>(addr, value, trap);
+	}
+
+	bool try_store(uint64_t addr, unsigned num_bytes, uint32_t value, SimulationTrap &trap) override {
+		if (num_bytes == 1)
+			return _try_store_data<uint8_t>(addr, value, trap);
+		else if (num_bytes == 2)
+			return _try_store_data<uint16_t>(addr, value, trap);
+		else
+			return _try_store_data<uint32_t>(addr, value, trap);
+	}
+
 	virtual int32_t atomic_load_word(uint64_t addr) override {
-		bus_lock->lock(iss.get_hart_id());
+		lock_bus();
 		return load_word(addr);
 	}
 	virtual void atomic_store_word(uint64_t addr, uint32_t value) override {
@@ -261,7 +704,7 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 		store_word(addr, value);
 	}
 	virtual int32_t atomic_load_reserved_word(uint64_t addr) override {
-		bus_lock->lock(iss.get_hart_id());
+		lock_bus();
 		lr_addr = addr;
 		return load_word(addr);
 	}
@@ -283,4 +726,6 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 	}
 };
 
+typedef CombinedMemoryInterfaceT<> CombinedMemoryInterface;
+
 }  // namespace rv32
@@ -2,12 +2,47 @@
 
 #include <stdint.h>
 
+#include "core/common/dmi.h"
+#include "core/common/trap.h"
+
 namespace rv32 {
 
 struct instr_memory_if {
 	virtual ~instr_memory_if() {}
 
 	virtual uint32_t load_instr(uint64_t pc) = 0;
+
+	/* Support for the decoded instruction cache (DecodedInstrCache): the fetch is split into the address
+	 * translation (including all protection checks) and the physical fetch. *cacheable* is set by the physical
+	 * fetch if the instruction has been served from DMI memory, i.e. re-using it later cannot skip side effects. */
+	virtual uint64_t translate_instr_addr(uint64_t pc) {
+		return pc;
+	}
+
+	/* Same as *translate_instr_addr*, but an address translation fault is reported in *trap* (returning false)
+	 * instead of throwing it. Other traps are still thrown. */
+	virtual bool try_translate_instr_addr(uint64_t pc, uint64_t &paddr, SimulationTrap &) {
+		paddr = translate_instr_addr(pc);
+		return true;
+	}
+
+	virtual uint32_t load_instr_paddr(uint64_t paddr, bool &cacheable) {
+		cacheable = false;
+		return load_instr(paddr);
+	}
+
+	/* Account the timing of a fetch that has been served from the decoded instruction cache. */
+	virtual void account_cached_instr_fetch() {}
+
+	/* Account the timing of an instruction address translation that has been skipped, as it is known to give the
+	 * same result as the last one (fetch from the same page without anything in between that could change it). */
+	virtual void account_skipped_instr_translation() {}
+
+	/* Read an instruction word without any side effects (no timing, no bus transaction). Only possible for DMI
+	 * memory, returns false otherwise. Used to build basic blocks ahead of their execution. */
+	virtual bool peek_instr_paddr(uint64_t, uint32_t &) {
+		return false;
+	}
 };
 
 //NOTE: load/store double is used for floating point D extension
@@ -34,8 +69,65 @@ struct data_memory_if {
 	virtual bool atomic_store_conditional_word(uint64_t addr, uint32_t value) = 0;
 	virtual void atomic_unlock() = 0;
 
+	/* Loads (zero extended) and stores of *num_bytes* (1, 2 or 4) used by the ISS for the regular load/store
+	 * instructions. An address translation fault is reported in *trap* (returning false) instead of throwing it,
+	 * other traps (e.g. bus errors) are still thrown. */
+	virtual bool try_load(uint64_t addr, unsigned num_bytes, uint32_t &value, SimulationTrap &) {
+		if (num_bytes == 1)
+			value = load_ubyte(addr);
+		else if (num_bytes == 2)
+			value = load_uhalf(addr);
+		else
+			value = load_word(addr);
+		return true;
+	}
+
+	virtual bool try_store(uint64_t addr, unsigned num_bytes, uint32_t value, SimulationTrap &) {
+		if (num_bytes == 1)
+			store_byte(addr, value);
+		else if (num_bytes == 2)
+			store_half(addr, value);
+		else
+			store_word(addr, value);
+		return true;
+	}
+
     virtual void flush_tlb() = 0;
+
+	/* SFENCE.VMA with operands, see *GenericMMU::flush_tlb*. */
+	virtual void flush_tlb(bool has_vaddr, uint64_t vaddr, bool has_asid, uint32_t asid) {
+		flush_tlb();
+	}
+	/* HFENCE.VVMA and HFENCE.GVMA, see *GenericMMU::hfence_vvma* and *GenericMMU::hfence_gvma*. */
+	virtual void hfence_vvma(bool has_vaddr, uint64_t vaddr, bool has_asid, uint32_t asid) {
+		flush_tlb();
+	}
+	virtual void hfence_gvma(bool has_gaddr, uint64_t gaddr, bool has_vmid, uint32_t vmid) {
+		flush_tlb();
+	}
 	virtual void clear_spmp_cache() = 0;
+	virtual void clear_smpu_cache() = 0;
+
+	/* Drop the cached host pointers of data pages (see *CombinedMemoryInterfaceT::fast_tlb*), either all of them or
+	 * only those of privilege level *mode*. Called whenever the result of a data address translation or protection
+	 * check might change without a TLB flush. */
+	virtual void flush_fast_tlb(PrivilegeLevel mode = NoneMode) {}
+};
+
+/* Hands out the DMI ranges of the bus to memory interfaces without a bus connection of their own (see
+ * *InstrMemoryProxy*). */
+struct dmi_provider_if {
+	virtual ~dmi_provider_if() {}
+
+	/* DMI range containing *addr*, requested from the bus on the first access to the region. Returns false if the
+	 * target does not support DMI. */
+	virtual bool get_dmi_range(uint64_t addr, MemoryDMI &dmi) = 0;
+
+	/* Incremented whenever a target invalidates its DMI ranges, copies obtained before are stale afterwards. */
+	virtual uint64_t get_dmi_generation() = 0;
+
+	/* Fetch through a bus transaction, for addresses without DMI range. */
+	virtual uint32_t load_instr_paddr(uint64_t paddr, bool &cacheable) = 0;
 };
 
 }  // namespace rv32
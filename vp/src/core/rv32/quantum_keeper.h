@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <systemc>
+#include <tlm_utils/tlm_quantumkeeper.h>
+
+namespace rv32 {
+
+/* Quantum keeper of the ISS. The cycles of executed instructions are accumulated as integer (*inc_cycles*) and only
+ * converted to sc_time when the local time is observed (*get_local_time*, e.g. for a TLM transaction) or on a sync.
+ * *need_sync* compares raw time values against the distance of the next sync point to the SystemC time, which is
+ * only updated on a sync or *set*. Hence *resume* has to be called whenever the owning thread waited without
+ * syncing (e.g. WFI or a contended bus lock). */
+struct CycleQuantumKeeper : public tlm_utils::tlm_quantumkeeper {
+	CycleQuantumKeeper(const sc_core::sc_time &cycle_time) : cycle_ticks(cycle_time.value()) {
+		resume();
+	}
+
+	inline void inc_cycles(uint64_t cycles) {
+		pending_cycles += cycles;
+	}
+
+	void set(const sc_core::sc_time &t) override {
+		pending_cycles = 0;
+		m_local_time = t;
+		resume();
+	}
+
+	bool need_sync() const override {
+		return m_local_time.value() + pending_cycles * cycle_ticks >= sync_distance;
+	}
+
+	void sync() override {
+		commit_cycles();
+		tlm_utils::tlm_quantumkeeper::sync();
+	}
+
+	void reset() override {
+		tlm_utils::tlm_quantumkeeper::reset();
+		resume();
+	}
+
+	sc_core::sc_time get_current_time() const override {
+		return sc_core::sc_time_stamp() + get_local_time();
+	}
+
+	sc_core::sc_time get_local_time() const override {
+		return m_local_time + sc_core::sc_time::from_value(pending_cycles * cycle_ticks);
+	}
+
+	/* Update the distance of the next sync point after the SystemC time might have advanced. */
+	void resume() {
+		const sc_core::sc_time &now = sc_core::sc_time_stamp();
+		sync_distance = m_next_sync_point > now ? (m_next_sync_point - now).value() : 0;
+	}
+
+   private:
+	uint64_t cycle_ticks;
+	uint64_t pending_cycles = 0;
+	uint64_t sync_distance = 0;
+
+	void commit_cycles() {
+		m_local_time += sc_core::sc_time::from_value(pending_cycles * cycle_ticks);
+		pending_cycles = 0;
+	}
+};
+
+}  // namespace rv32
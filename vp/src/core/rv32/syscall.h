@@ -5,6 +5,7 @@
 #include <stdint.h>
 
 #include <boost/lexical_cast.hpp>
+#include <unordered_map>
 
 // see: newlib/libgloss/riscv @
 // https://github.com/riscv/riscv-newlib/tree/riscv-newlib-2.5.0/libgloss/riscv
@@ -125,22 +125,47 @@ ISS::ISS(uint64_t hart_id) : systemc_name("Core-" + std::to_string(hart_id)) {
 void ISS::exec_step() {
 	assert(((pc & ~pc_alignment_mask()) == 0) && "misaligned instruction");
 
+	// the decoded instruction cache is bypassed in debug mode, as the debugger can modify memory directly
+	bool use_decode_cache = decode_cache.enabled && !debug_mode;
+	DecodedInstrCache::entry_t *cached = nullptr;
+	uint64_t fetch_paddr = 0;
+	bool cacheable = false;
+
 	uint32_t mem_word;
 	try {
-		mem_word = instr_mem->load_instr(pc);
-		instr = Instruction(mem_word);
+		if (use_decode_cache) {
+			fetch_paddr = instr_mem->translate_instr_addr(pc);
+			cached = decode_cache.lookup(fetch_paddr);
+		}
+
+		if (cached) {
+			instr_mem->account_cached_instr_fetch();
+			mem_word = cached->raw;
+		} else {
+			mem_word = use_decode_cache ? instr_mem->load_instr_paddr(fetch_paddr, cacheable)
+			                            : instr_mem->load_instr(pc);
+			instr = Instruction(mem_word);
+		}
 	} catch (SimulationTrap &e) {
 		op = Opcode::UNDEF;
 		instr = Instruction(0);
 		throw;
 	}
 
-	if (instr.is_compressed()) {
-		op = instr.decode_and_expand_compressed(RV64);
+	if (cached) {
+		instr = cached->instr;
+		op = cached->op;
+		pc += cached->length;
+	} else if (instr.is_compressed()) {
+		op = instr.decode_and_expand_compressed<RV64>();
 		pc += 2;
+		if (cacheable && op != Opcode::UNDEF)
+			decode_cache.insert(fetch_paddr, mem_word, instr, op, 2);
 	} else {
-		op = instr.decode_normal(RV64);
+		op = instr.decode_normal<RV64>();
 		pc += 4;
+		if (cacheable && op != Opcode::UNDEF)
+			decode_cache.insert(fetch_paddr, mem_word, instr, op, 4);
 	}
 
 	if (trace) {
@@ -429,11 +454,15 @@ void ISS::exec_step() {
 			regs[instr.rd()] = (int32_t)((int32_t)regs[instr.rs1()] >> regs.shamt_w(instr.rs2()));
 			break;
 
-		case Opcode::FENCE:
-		case Opcode::FENCE_I: {
+		case Opcode::FENCE: {
 			// not using out of order execution/caches so can be ignored
 		} break;
 
+		case Opcode::FENCE_I: {
+			// memory might have been modified by other harts or bus masters (e.g. DMA)
+			decode_cache.flush();
+		} break;
+
 		case Opcode::ECALL: {
 			if (sys) {
 				sys->execute_syscall(this);
@@ -1264,7 +1293,14 @@ void ISS::exec_step() {
 		case Opcode::SFENCE_VMA:
 			if (s_mode() && csrs.mstatus.fields.tvm)
 				raise_trap(EXC_ILLEGAL_INSTR, instr.data());
-			mem->flush_tlb();
+			mem->flush_tlb(instr.rs1() != RegFile::zero, regs[instr.rs1()], instr.rs2() != RegFile::zero,
+			               regs[instr.rs2()]);
+			break;
+
+		case Opcode::HFENCE_VVMA:
+		case Opcode::HFENCE_GVMA:
+			// hypervisor extension not supported
+			raise_trap(EXC_ILLEGAL_INSTR, instr.data());
 			break;
 
 		case Opcode::URET:
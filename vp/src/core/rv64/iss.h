@@ -3,6 +3,7 @@
 #include "core/common/bus_lock_if.h"
 #include "core/common/clint_if.h"
 #include "core/common/core_defs.h"
+#include "core/common/decode_cache.h"
 #include "core/common/instr.h"
 #include "core/common/irq_if.h"
 #include "core/common/trap.h"
@@ -157,6 +158,7 @@ struct ISS : public external_interrupt_target, public clint_interrupt_target, pu
 	// last decoded and executed instruction and opcode
 	Instruction instr;
 	Opcode::Mapping op;
+	DecodedInstrCache decode_cache;
 
 	CoreExecStatus status = CoreExecStatus::Runnable;
 	std::unordered_set<uint64_t> breakpoints;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/common/dmi.h"
+#include "core/common/payload_pool.h"
 #include "iss.h"
 #include "mmu.h"
 
@@ -22,6 +23,15 @@ struct InstrMemoryProxy : public instr_memory_if {
 		quantum_keeper.inc(access_delay);
 		return *(dmi.get_mem_ptr_to_global_addr<uint32_t>(pc));
 	}
+
+	virtual uint32_t load_instr_paddr(uint64_t paddr, bool &cacheable) override {
+		cacheable = true;
+		return load_instr(paddr);
+	}
+
+	virtual void account_cached_instr_fetch() override {
+		quantum_keeper.inc(access_delay);
+	}
 };
 
 struct CombinedMemoryInterface : public sc_core::sc_module,
@@ -34,6 +44,7 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 
 	tlm_utils::simple_initiator_socket<CombinedMemoryInterface> isock;
 	tlm_utils::tlm_quantumkeeper &quantum_keeper;
+	BlockingPayload bus_payload;  // for all bus requests of the core, tagged with its hart id
 
 	// optionally add DMI ranges for optimization
 	sc_core::sc_time clock_cycle = sc_core::sc_time(10, sc_core::SC_NS);
@@ -43,19 +54,15 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 	MMU &mmu;
 
 	CombinedMemoryInterface(sc_core::sc_module_name, ISS &owner, MMU &mmu)
-	    : iss(owner), quantum_keeper(iss.quantum_keeper), mmu(mmu) {}
+	    : iss(owner), quantum_keeper(iss.quantum_keeper), bus_payload(iss.get_hart_id()), mmu(mmu) {}
 
 	uint64_t v2p(uint64_t vaddr, MemoryAccessType type) override {
 		return mmu.translate_virtual_to_physical_addr(vaddr, type);
 	}
 
 	inline void _do_transaction(tlm::tlm_command cmd, uint64_t addr, uint8_t *data, unsigned num_bytes) {
-		tlm::tlm_generic_payload trans;
-		trans.set_command(cmd);
-		trans.set_address(addr);
-		trans.set_data_ptr(data);
-		trans.set_data_length(num_bytes);
-		trans.set_response_status(tlm::TLM_OK_RESPONSE);
+		auto &trans = bus_payload.prepare(cmd, addr, data, num_bytes, iss.prv);
+		trans.set_response_status(tlm::TLM_OK_RESPONSE);  // not all targets set it
 
 		sc_core::sc_time local_delay = quantum_keeper.get_local_time();
 
@@ -96,10 +103,20 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 		return ans;
 	}
 
+	inline bool is_dmi_backed(uint64_t addr) {
+		for (auto &e : dmi_ranges) {
+			if (e.contains(addr))
+				return true;
+		}
+		return false;
+	}
+
 	template <typename T>
 	inline void _raw_store_data(uint64_t addr, T value) {
 		bus_lock->wait_for_access_rights(iss.get_hart_id());
 
+		iss.decode_cache.invalidate_store(addr, sizeof(T));
+
 		bool done = false;
 		for (auto &e : dmi_ranges) {
 			if (e.contains(addr)) {
@@ -139,8 +156,25 @@ struct CombinedMemoryInterface : public sc_core::sc_module,
 		mmu.flush_tlb();
 	}
 
+	void flush_tlb(bool has_vaddr, uint64_t vaddr, bool has_asid, uint32_t asid) override {
+		mmu.flush_tlb(has_vaddr, vaddr, has_asid, asid);
+	}
+
+	uint64_t translate_instr_addr(uint64_t addr) override {
+		return v2p(addr, FETCH);
+	}
+
 	uint32_t load_instr(uint64_t addr) override {
-		return _raw_load_data<uint32_t>(v2p(addr, FETCH));
+		return _raw_load_data<uint32_t>(translate_instr_addr(addr));
+	}
+
+	uint32_t load_instr_paddr(uint64_t paddr, bool &cacheable) override {
+		cacheable = is_dmi_backed(paddr);
+		return _raw_load_data<uint32_t>(paddr);
+	}
+
+	void account_cached_instr_fetch() override {
+		quantum_keeper.inc(dmi_access_delay);
 	}
 
 	template <typename T>
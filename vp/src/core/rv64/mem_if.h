@@ -8,6 +8,21 @@ struct instr_memory_if {
 	virtual ~instr_memory_if() {}
 
 	virtual uint32_t load_instr(uint64_t pc) = 0;
+
+	/* Support for the decoded instruction cache (DecodedInstrCache): the fetch is split into the address
+	 * translation (including all protection checks) and the physical fetch. *cacheable* is set by the physical
+	 * fetch if the instruction has been served from DMI memory, i.e. re-using it later cannot skip side effects. */
+	virtual uint64_t translate_instr_addr(uint64_t pc) {
+		return pc;
+	}
+
+	virtual uint32_t load_instr_paddr(uint64_t paddr, bool &cacheable) {
+		cacheable = false;
+		return load_instr(paddr);
+	}
+
+	/* Account the timing of a fetch that has been served from the decoded instruction cache. */
+	virtual void account_cached_instr_fetch() {}
 };
 
 struct data_memory_if {
@@ -38,6 +53,11 @@ struct data_memory_if {
 	virtual bool atomic_store_conditional_double(uint64_t addr, uint64_t value) = 0;
 
 	virtual void flush_tlb() = 0;
+
+	/* SFENCE.VMA with operands, see *GenericMMU::flush_tlb*. */
+	virtual void flush_tlb(bool has_vaddr, uint64_t vaddr, bool has_asid, uint32_t asid) {
+		flush_tlb();
+	}
 };
 
 }  // namespace rv64
\ No newline at end of file
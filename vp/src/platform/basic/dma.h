@@ -9,9 +9,12 @@
 #include <unordered_map>
 #include <array>
 
+#include "core/common/payload_pool.h"
+
 struct SimpleDMA : public sc_core::sc_module {
 	tlm_utils::simple_initiator_socket<SimpleDMA> isock;
 	tlm_utils::simple_target_socket<SimpleDMA> tsock;
+	BlockingPayload payload;
 
 	interrupt_gateway *plic = 0;
 	uint32_t irq_number = 0;
@@ -145,12 +148,7 @@ struct SimpleDMA : public sc_core::sc_module {
 	void do_transaction(tlm::tlm_command cmd, uint64_t addr, uint8_t *data, unsigned num_bytes) {
 		sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
 
-		tlm::tlm_generic_payload trans;
-		trans.set_command(cmd);
-		trans.set_address(addr);
-		trans.set_data_ptr(data);
-		trans.set_data_length(num_bytes);
-
+		auto &trans = payload.prepare(cmd, addr, data, num_bytes);
 		isock->b_transport(trans, delay);
 
 		if (delay != sc_core::SC_ZERO_TIME)
@@ -84,6 +84,7 @@ public:
 
 	bool quiet = false;
 	bool use_E_base_isa = false;
+	bool aplic_msi_through_bus = false;
 
 	OptionValue<unsigned long> entry_point;
 
@@ -94,6 +95,7 @@ public:
 			("memory-start", po::value<unsigned int>(&mem_start_addr),"set memory start address")
 			("memory-size", po::value<unsigned int>(&mem_size), "set memory size")
 			("use-E-base-isa", po::bool_switch(&use_E_base_isa), "use the E instead of the I integer base ISA")
+			("aplic-msi-through-bus", po::bool_switch(&aplic_msi_through_bus), "send APLIC MSIs over the bus instead of directly to the IMSIC")
 			("entry-point", po::value<std::string>(&entry_point.option),"set entry point address (ISS program counter)")
 			("mram-image", po::value<std::string>(&mram_image)->default_value(""),"MRAM image file for persistency")
 			("mram-image-size", po::value<unsigned int>(&mram_size), "MRAM image size")
@@ -101,6 +103,7 @@ public:
 			("network-device", po::value<std::string>(&network_device)->default_value(""),"name of the tap network adapter, e.g. /dev/tap6")
 			("signature", po::value<std::string>(&test_signature)->default_value(""),"output filename for the test execution signature");
         	// clang-format on
+		add_exec_engine_options();
 	};
 
 	void printValues(std::ostream& os) const override {
@@ -157,8 +160,7 @@ int sc_main(int argc, char **argv) {
 	Display display("Display");
 	DebugMemoryInterface dbg_if("DebugMemoryInterface");
 
-	MemoryDMI dmi = MemoryDMI::create_start_size_mapping(mem.data, opt.mem_start_addr, mem.size);
-	InstrMemoryProxy instr_mem(dmi, core);
+	InstrMemoryProxy instr_mem(iss_mem_if, core);
 
 	std::shared_ptr<BusLock> bus_lock = std::make_shared<BusLock>();
 	iss_mem_if.bus_lock = bus_lock;
@@ -168,7 +170,7 @@ int sc_main(int argc, char **argv) {
 	if (opt.use_instr_dmi)
 		instr_mem_if = &instr_mem;
 	if (opt.use_data_dmi) {
-		iss_mem_if.dmi_ranges.emplace_back(dmi);
+		iss_mem_if.lazy_dmi = true;
 	}
 
 	uint64_t entry_point = loader.get_entrypoint();
@@ -197,6 +199,16 @@ int sc_main(int argc, char **argv) {
 
 	core.use_spmp = opt.use_spmp;
 	core.use_smpu = opt.use_smpu;
+	// the protection is selected at run time, hence only the ISS is specialized and the memory interface is generic
+	if (opt.use_smpu)
+		core.specialize<PlatformIsaConfig<Rv32DefaultSmpuConfig>>();
+	else if (opt.use_spmp)
+		core.specialize<PlatformIsaConfig<Rv32DefaultSpmpConfig>>();
+	else
+		core.specialize<PlatformIsaConfig<Rv32DefaultConfig>>();
+	core.use_block_engine = (opt.exec_engine != "step");
+	core.jit.enabled = (opt.exec_engine == "jit");
+	core.jit.check = opt.jit_check;
 
 	// address mapping
 	{
@@ -248,6 +260,8 @@ int sc_main(int argc, char **argv) {
 
 	// connect interrupt signals/communication
 	plic.target_harts[0] = &core;
+	plic.register_imsic(0, opt.imsic_start_addr, iss_config::MAX_GUEST, &core);
+	plic.msi_through_bus = opt.aplic_msi_through_bus;
 	clint.target_harts[0] = &core;
 	sensor.plic = &plic;
 	dma.plic = &plic;
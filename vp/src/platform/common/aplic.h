@@ -3,7 +3,11 @@
 #include <tlm_utils/simple_target_socket.h>
 #include <systemc>
 
+#include <stdexcept>
+#include <string>
+
 #include "core/common/irq_if.h"
+#include "core/common/payload_pool.h"
 #include "util/memory_map.h"
 #include "util/tlm_map.h"
 
@@ -17,7 +21,8 @@ static constexpr bool trace_mode = false;
 #define IMSIC_HART0_S_IFILE       (IMSIC_HART0_BASE + 4096)
 
 
-#define HART_0_INDEX              (0)	/* Only one hart now */
+/* The interrupt files of the harts are 2^IMSIC_HART_STRIDE_BITS pages apart, hart 0 at the addresses above */
+#define IMSIC_HART_STRIDE_BITS    4
 
 #define APLIC_BASE                (0x40000000)
 #define APLIC_DOMAIN_OFFSET       (0x10000)
@@ -122,9 +127,24 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 
 	tlm_utils::simple_target_socket<APLIC> tsock;
 	tlm_utils::simple_initiator_socket<APLIC> isock;
+	BlockingPayload msi_payload;
 
 	std::array<external_interrupt_target *, NumberCores> target_harts{};
 
+	/* The IMSIC of each hart (see *register_imsic*). MSIs to its interrupt files are delivered directly to the
+	 * target unless *msi_through_bus* is set, e.g. to trace them on the bus. */
+	struct imsic_region {
+		imsic_mem_target *target = nullptr;
+		uint64_t base_addr = 0;
+		unsigned num_files = 0; /* M, S and guest interrupt files, one page each */
+	};
+
+	std::array<imsic_region, NumberCores> imsics{};
+	bool msi_through_bus = false;
+
+	/* Number of bits of the hart index within the default MSI address configuration */
+	static constexpr unsigned HART_INDEX_BITS = NumberCores > 1 ? 32 - __builtin_clz(NumberCores - 1) : 0;
+
 	/* APLIC memory-mapped control region (for each interrupt domain that an APLIC supports) */
 	RegisterRange *regs_domaincfg[NumberDomains];
 	IntegerView<uint32_t> *domaincfg[NumberDomains];
@@ -180,13 +200,16 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 	RegisterRange *regs_target[NumberDomains];
 	ArrayView<uint32_t> *target[NumberDomains];
 
-	std::vector<RegisterRange *> register_ranges;
+	vp::mm::RegisterMap register_map{"APLIC"};
 
 	sc_core::sc_event e_run;
 	sc_core::sc_time clock_cycle;
 
 	uint32_t ie_reg[NumberDomains][32];
 	uint32_t ip_reg[NumberDomains][32];
+	/* Sources active in the domain (see *source_is_inactive*), updated on every sourcecfg write. Together with
+	 * ie_reg and ip_reg the next interrupt to forward is found word-wise. */
+	uint32_t active_reg[NumberDomains][32];
 
 	SC_HAS_PROCESS(APLIC);
 
@@ -196,11 +219,11 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 
 			regs_domaincfg[ii] = new RegisterRange{domain_base + APLIC_DOMAINCFG, sizeof(uint32_t) * 1};
 			domaincfg[ii] = new IntegerView<uint32_t>(*regs_domaincfg[ii]);
-			(*regs_domaincfg[ii]).post_write_callback = std::bind(&APLIC::post_write_domainconfig, this, std::placeholders::_1);
+			(*regs_domaincfg[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_domainconfig>(this);
 
 			regs_sourcecfg[ii] = new RegisterRange{domain_base + APLIC_SOURCECFG, sizeof(uint32_t) * NumberInterrupts};
 			sourcecfg[ii] = new ArrayView<uint32_t>(*regs_sourcecfg[ii]);
-			(*regs_sourcecfg[ii]).post_write_callback = std::bind(&APLIC::post_write_sourcecfg, this, std::placeholders::_1);
+			(*regs_sourcecfg[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_sourcecfg>(this);
 
 			/* Implemented only at the M-mode */
 			regs_mmsiaddrcfg[ii] = new RegisterRange{domain_base + APLIC_MMSIADDRCFG, sizeof(uint32_t) * 1};
@@ -219,83 +242,85 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 			smsiaddrcfgh[ii] = new IntegerView<uint32_t>(*regs_smsiaddrcfgh[ii]);
 
 			if (ii != APLIC_M_DOMAIN) { /* Machine domain only */
-				(*regs_mmsiaddrcfg[ii]).post_write_callback = std::bind(&APLIC::post_write_xmsiaddrcfg, this, std::placeholders::_1);
-				(*regs_mmsiaddrcfgh[ii]).post_write_callback = std::bind(&APLIC::post_write_xmsiaddrcfg, this, std::placeholders::_1);
-				(*regs_smsiaddrcfg[ii]).post_write_callback = std::bind(&APLIC::post_write_xmsiaddrcfg, this, std::placeholders::_1);
-				(*regs_smsiaddrcfgh[ii]).post_write_callback = std::bind(&APLIC::post_write_xmsiaddrcfg, this, std::placeholders::_1);
+				(*regs_mmsiaddrcfg[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_xmsiaddrcfg>(this);
+				(*regs_mmsiaddrcfgh[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_xmsiaddrcfg>(this);
+				(*regs_smsiaddrcfg[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_xmsiaddrcfg>(this);
+				(*regs_smsiaddrcfgh[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_xmsiaddrcfg>(this);
 			}
 
 			regs_setip[ii] = new RegisterRange{domain_base + APLIC_SETIP, sizeof(uint32_t) * 32};
 			setip[ii] = new ArrayView<uint32_t>(*regs_setip[ii]);
-			(*regs_setip[ii]).post_write_callback = std::bind(&APLIC::post_write_setip, this, std::placeholders::_1);
-			(*regs_setip[ii]).pre_read_callback = std::bind(&APLIC::pre_read_setip, this, std::placeholders::_1);
+			(*regs_setip[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_setip>(this);
+			(*regs_setip[ii]).pre_read_callback = vp::mm::bind<&APLIC::pre_read_setip>(this);
 
 			regs_setipnum[ii] = new RegisterRange{domain_base + APLIC_SETIPNUM, sizeof(uint32_t) * 1};
 			setipnum[ii] = new IntegerView<uint32_t>(*regs_setipnum[ii]);
-			(*regs_setipnum[ii]).post_write_callback = std::bind(&APLIC::post_write_setipnum, this, std::placeholders::_1);
+			(*regs_setipnum[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_setipnum>(this);
 
 			regs_in_clrip[ii] = new RegisterRange{domain_base + APLIC_IN_CLRIP, sizeof(uint32_t) * 32};
 			in_clrip[ii] = new ArrayView<uint32_t>(*regs_in_clrip[ii]);
-			(*regs_in_clrip[ii]).post_write_callback = std::bind(&APLIC::post_write_in_clrip, this, std::placeholders::_1);
-			(*regs_in_clrip[ii]).pre_read_callback = std::bind(&APLIC::pre_read_in_clrip, this, std::placeholders::_1);
+			(*regs_in_clrip[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_in_clrip>(this);
+			(*regs_in_clrip[ii]).pre_read_callback = vp::mm::bind<&APLIC::pre_read_in_clrip>(this);
 
 			regs_clripnum[ii] = new RegisterRange{domain_base + APLIC_CLRIPNUM, sizeof(uint32_t) * 1};
 			clripnum[ii] = new IntegerView<uint32_t>(*regs_clripnum[ii]);
-			(*regs_clripnum[ii]).post_write_callback = std::bind(&APLIC::post_write_clripnum, this, std::placeholders::_1);
+			(*regs_clripnum[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_clripnum>(this);
 
 			regs_setie[ii] = new RegisterRange{domain_base + APLIC_SETIE, sizeof(uint32_t) * 32};
 			setie[ii] = new ArrayView<uint32_t>(*regs_setie[ii]);
-			(*regs_setie[ii]).post_write_callback = std::bind(&APLIC::post_write_setie, this, std::placeholders::_1);
-			(*regs_setie[ii]).pre_read_callback = std::bind(&APLIC::pre_read_setie, this, std::placeholders::_1);
+			(*regs_setie[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_setie>(this);
+			(*regs_setie[ii]).pre_read_callback = vp::mm::bind<&APLIC::pre_read_setie>(this);
 
 			regs_setienum[ii] = new RegisterRange{domain_base + APLIC_SETIENUM, sizeof(uint32_t) * 1};
 			setienum[ii] = new IntegerView<uint32_t>(*regs_setienum[ii]);
-			(*regs_setienum[ii]).post_write_callback = std::bind(&APLIC::post_write_setienum, this, std::placeholders::_1);
+			(*regs_setienum[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_setienum>(this);
 
 			regs_clrie[ii] = new RegisterRange{domain_base + APLIC_CLRIE, sizeof(uint32_t) * 32};
 			clrie[ii] = new ArrayView<uint32_t>(*regs_clrie[ii]);
-			(*regs_clrie[ii]).post_write_callback = std::bind(&APLIC::post_write_clrie, this, std::placeholders::_1);
+			(*regs_clrie[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_clrie>(this);
 
 			regs_clrienum[ii] = new RegisterRange{domain_base + APLIC_CLRIENUM, sizeof(uint32_t) * 1};
 			clrienum[ii] = new IntegerView<uint32_t>(*regs_clrienum[ii]);
-			(*regs_clrienum[ii]).post_write_callback = std::bind(&APLIC::post_write_clrienum, this, std::placeholders::_1);
+			(*regs_clrienum[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_clrienum>(this);
 
 			regs_setipnum_le[ii] = new RegisterRange{domain_base + APLIC_SETIPNUMLE, sizeof(uint32_t) * 1};
 			setipnum_le[ii] = new IntegerView<uint32_t>(*regs_setipnum_le[ii]);
-			(*regs_setipnum_le[ii]).post_write_callback = std::bind(&APLIC::post_write_setipnum_le, this, std::placeholders::_1);
+			(*regs_setipnum_le[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_setipnum_le>(this);
 
 			regs_setipnum_be[ii] = new RegisterRange{domain_base + APLIC_SETIPNUMBE, sizeof(uint32_t) * 1};
 			setipnum_be[ii] = new IntegerView<uint32_t>(*regs_setipnum_be[ii]);
-			(*regs_setipnum_be[ii]).post_write_callback = std::bind(&APLIC::post_write_setipnum_be, this, std::placeholders::_1);
+			(*regs_setipnum_be[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_setipnum_be>(this);
 
 			regs_genmsi[ii] = new RegisterRange{domain_base + APLIC_GENMSI, sizeof(uint32_t) * 1};
 			genmsi[ii] = new IntegerView<uint32_t>(*regs_genmsi[ii]);
-			(*regs_genmsi[ii]).post_write_callback = std::bind(&APLIC::post_write_genmsi, this, std::placeholders::_1);
+			(*regs_genmsi[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_genmsi>(this);
 
 			regs_target[ii] = new RegisterRange{domain_base + APLIC_TARGET, sizeof(uint32_t) * 1023};
 			target[ii] = new ArrayView<uint32_t>(*regs_target[ii]);
-			(*regs_target[ii]).post_write_callback = std::bind(&APLIC::post_write_target, this, std::placeholders::_1);
-
-			register_ranges.push_back(&(*regs_domaincfg[ii]));
-			register_ranges.push_back(&(*regs_sourcecfg[ii]));
-			register_ranges.push_back(&(*regs_mmsiaddrcfg[ii]));
-			register_ranges.push_back(&(*regs_mmsiaddrcfgh[ii]));
-			register_ranges.push_back(&(*regs_smsiaddrcfg[ii]));
-			register_ranges.push_back(&(*regs_smsiaddrcfgh[ii]));
-			register_ranges.push_back(&(*regs_setip[ii]));
-			register_ranges.push_back(&(*regs_setipnum[ii]));
-			register_ranges.push_back(&(*regs_in_clrip[ii]));
-			register_ranges.push_back(&(*regs_clripnum[ii]));
-			register_ranges.push_back(&(*regs_setie[ii]));
-			register_ranges.push_back(&(*regs_setienum[ii]));
-			register_ranges.push_back(&(*regs_clrie[ii]));
-			register_ranges.push_back(&(*regs_clrienum[ii]));
-			register_ranges.push_back(&(*regs_setipnum_le[ii]));
-			register_ranges.push_back(&(*regs_setipnum_be[ii]));
-			register_ranges.push_back(&(*regs_genmsi[ii]));
-			register_ranges.push_back(&(*regs_target[ii]));
+			(*regs_target[ii]).post_write_callback = vp::mm::bind<&APLIC::post_write_target>(this);
+
+			register_map.add(*regs_domaincfg[ii]);
+			register_map.add(*regs_sourcecfg[ii]);
+			register_map.add(*regs_mmsiaddrcfg[ii]);
+			register_map.add(*regs_mmsiaddrcfgh[ii]);
+			register_map.add(*regs_smsiaddrcfg[ii]);
+			register_map.add(*regs_smsiaddrcfgh[ii]);
+			register_map.add(*regs_setip[ii]);
+			register_map.add(*regs_setipnum[ii]);
+			register_map.add(*regs_in_clrip[ii]);
+			register_map.add(*regs_clripnum[ii]);
+			register_map.add(*regs_setie[ii]);
+			register_map.add(*regs_setienum[ii]);
+			register_map.add(*regs_clrie[ii]);
+			register_map.add(*regs_clrienum[ii]);
+			register_map.add(*regs_setipnum_le[ii]);
+			register_map.add(*regs_setipnum_be[ii]);
+			register_map.add(*regs_genmsi[ii]);
+			register_map.add(*regs_target[ii]);
 		}
 
+		register_map.build();
+
 		clock_cycle = sc_core::sc_time(10, sc_core::SC_NS);
 		tsock.register_b_transport(this, &APLIC::transport);
 
@@ -318,6 +343,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 
 				ie_reg[ii][jj] = 0;
 				ip_reg[ii][jj] = 0;
+				active_reg[ii][jj] = 0;
 			}
 
 			*setipnum[ii] = 0;
@@ -337,11 +363,12 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 
 				msi_addr = IMSIC_HART0_M_IFILE;
 				*mmsiaddrcfg[ii] = msi_addr >> APLIC_PAGE_BITS;
-				*mmsiaddrcfgh[ii] = 0;
+				*mmsiaddrcfgh[ii] = (HART_INDEX_BITS << APLIC_MMSIADDRCFGH_LHXW_BIT) |
+						    (IMSIC_HART_STRIDE_BITS << APLIC_MMSIADDRCFGH_LHXS_BIT);
 
 				msi_addr = IMSIC_HART0_S_IFILE;
 				*smsiaddrcfg[ii] = msi_addr >> APLIC_PAGE_BITS;
-				*smsiaddrcfgh[ii] = 0;
+				*smsiaddrcfgh[ii] = IMSIC_HART_STRIDE_BITS << APLIC_SMSIADDRCFGH_LHXS_BIT;
 			} else {
 				*mmsiaddrcfg[ii] = 0;
 				*mmsiaddrcfgh[ii] = 0;
@@ -353,7 +380,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		SC_THREAD(run);
 	}
 
-	void post_write_domainconfig(RegisterRange::WriteInfo t)
+	void post_write_domainconfig(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *domaincfg = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t tmp = *domaincfg;
@@ -367,7 +394,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		*domaincfg = domaincfg_reg;
 	}
 
-	void post_write_sourcecfg(RegisterRange::WriteInfo t)
+	void post_write_sourcecfg(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *sourcecfg = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t eiid = (t.addr >> 2) + 1;
@@ -387,6 +414,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 			(*target[APLIC_M_DOMAIN])[eiid - 1] = 0;
 			ie_reg[APLIC_M_DOMAIN][idx] &= ~BIT(off);
 			ip_reg[APLIC_M_DOMAIN][idx] &= ~BIT(off);
+			update_source_active(eiid);
 			return;
 		}
 
@@ -400,9 +428,11 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		}
 
 		/* ToDo: When source is not implemented => *sourcecfg = 0 */
+
+		update_source_active(eiid);
 	}
 
-	void post_write_xmsiaddrcfg(RegisterRange::WriteInfo t)
+	void post_write_xmsiaddrcfg(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *addr = reinterpret_cast<uint32_t *>(t.var_addr);
 
@@ -411,7 +441,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		*addr = 0;
 	}
 
-	void post_write_setip(RegisterRange::WriteInfo t)
+	void post_write_setip(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *setip = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t idx = t.addr >> 2;
@@ -445,7 +475,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		}
 	}
 
-	bool pre_read_setip(RegisterRange::ReadInfo t)
+	bool pre_read_setip(const RegisterRange::ReadInfo &t)
 	{
 		uint32_t *setip = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t idx = t.addr >> 2;
@@ -457,7 +487,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		return true;
 	}
 
-	void post_write_setipnum(RegisterRange::WriteInfo t)
+	void post_write_setipnum(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *setipnum = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t irq_id = *setipnum;
@@ -479,7 +509,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		e_run.notify(clock_cycle); /* We have set a pending bit, if source is enabled we need to send MSI */
 	}
 
-	void post_write_in_clrip(RegisterRange::WriteInfo t)
+	void post_write_in_clrip(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *in_clrip = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t idx = t.addr >> 2;
@@ -490,7 +520,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		ip_reg[APLIC_M_DOMAIN][idx] &= ~(in_clrip_reg);
 	}
 
-	bool pre_read_in_clrip(RegisterRange::ReadInfo t)
+	bool pre_read_in_clrip(const RegisterRange::ReadInfo &t)
 	{
 		uint32_t *in_clrip = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t idx = t.addr >> 2;
@@ -504,7 +534,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		return true;
 	}
 
-	void post_write_clripnum(RegisterRange::WriteInfo t)
+	void post_write_clripnum(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *clripnum = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t clripnum_reg = *clripnum;
@@ -521,7 +551,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		(*setip[APLIC_M_DOMAIN])[idx] = ip_reg[APLIC_M_DOMAIN][idx]; /* Read of setip return pending bits of the sources */
 	}
 
-	void post_write_setie(RegisterRange::WriteInfo t)
+	void post_write_setie(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *setie = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t idx = t.addr >> 2;
@@ -558,7 +588,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 			e_run.notify(clock_cycle);
 	}
 
-	bool pre_read_setie(RegisterRange::ReadInfo t)
+	bool pre_read_setie(const RegisterRange::ReadInfo &t)
 	{
 		uint32_t *setie = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t idx = t.addr >> 2;
@@ -570,7 +600,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		return true;
 	}
 
-	void post_write_setienum(RegisterRange::WriteInfo t)
+	void post_write_setienum(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *setienum = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t irq_id = *setienum;
@@ -592,7 +622,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		e_run.notify(clock_cycle);
 	}
 
-	void post_write_clrie(RegisterRange::WriteInfo t)
+	void post_write_clrie(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *clrie = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t idx = t.addr >> 2;
@@ -606,7 +636,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		(*setie[APLIC_M_DOMAIN])[idx] = ie_reg[APLIC_M_DOMAIN][idx]; /* Read of setie return enable bits of the sources */
 	}
 
-	void post_write_clrienum(RegisterRange::WriteInfo t)
+	void post_write_clrienum(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *clrienum = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t clrienum_reg = *clrienum;
@@ -626,19 +656,19 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		(*setie[APLIC_M_DOMAIN])[idx] = ie_reg[APLIC_M_DOMAIN][idx]; /* Read of setie return enable bits of the sources */
 	}
 
-	void post_write_setipnum_le(RegisterRange::WriteInfo t)
+	void post_write_setipnum_le(const RegisterRange::WriteInfo &t)
 	{
 		post_write_setipnum(t); /* ToDO: need to complete */
 	}
 
-	void post_write_setipnum_be(RegisterRange::WriteInfo t)
+	void post_write_setipnum_be(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *setipnum_be = reinterpret_cast<uint32_t *>(t.var_addr);
 
 		*setipnum_be = 0;
 	}
 
-	void post_write_genmsi(RegisterRange::WriteInfo t)
+	void post_write_genmsi(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *genmsi = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t hart_ind;
@@ -654,13 +684,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		/* MSI is sent even if domaincfg.IE = 0 */
 		msi_data = (*genmsi >> APLIC_GENMSI_EIID_BIT) & APLIC_GENMSI_EIID_MASK; /* Data value for the MSI */
 
-		sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
-		tlm::tlm_generic_payload trans;
-		trans.set_command(tlm::TLM_WRITE_COMMAND);
-		trans.set_address(addr);
-		trans.set_data_ptr(reinterpret_cast<unsigned char *>(&msi_data));
-		trans.set_data_length(sizeof(uint32_t));
-		isock->b_transport(trans, delay); /* Send MSI */
+		send_msi(hart_ind, addr, msi_data);
 
 		/* All MSIs previously sent from this APLIC to the same hart must be visible at the
 			hart’s IMSIC before the extempore MSI becomes visible at the hart’s IMSIC. */
@@ -668,7 +692,7 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 			MSI is sent even if domaincfg.IE = 0 */
 	}
 
-	void post_write_target(RegisterRange::WriteInfo t)
+	void post_write_target(const RegisterRange::WriteInfo &t)
 	{
 		uint32_t *target = reinterpret_cast<uint32_t *>(t.var_addr);
 		uint32_t idx = t.addr >> 2;
@@ -744,10 +768,22 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		return false;
 	}
 
-	unsigned hart_get_next_pending_interrupt(int domain)
+	void update_source_active(uint32_t irq_id)
 	{
-		uint32_t irq_id;
+		unsigned idx = irq_id / 32;
+		unsigned off = irq_id % 32;
+
+		for (unsigned ii = 0; ii < NumberDomains; ii++) {
+			if (source_is_inactive(ii, irq_id))
+				active_reg[ii][idx] &= ~BIT(off);
+			else
+				active_reg[ii][idx] |= BIT(off);
+		}
+	}
 
+	/* Returns the lowest active, enabled and pending source >= first_irq_id, 0 if none */
+	unsigned hart_get_next_pending_interrupt(int domain, uint32_t first_irq_id = 1)
+	{
 		if ((((*domaincfg[domain]) >> APLIC_DOMAINCFG_DM_BIT) & APLIC_DOMAINCFG_DM_MASK) == 0) {
 			return 0; /* Direct delivery mode is not supported */
 		}
@@ -756,25 +792,27 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 			return 0; /* All interrupts are disabled */
 		}
 
-		for (irq_id = 1; irq_id < NumberInterrupts; irq_id++) { /* ToDo: Rewrite this algorithm!! */
-			if (source_is_inactive(domain, irq_id)) {
-				continue;
-			}
+		if (first_irq_id >= NumberInterrupts)
+			return 0;
 
-			if (is_pending_interrupt(domain, irq_id))
-				break;
-		}
+		/* Sources >= NumberInterrupts and source 0 are never active */
+		unsigned idx = first_irq_id / 32;
+		uint32_t pending = ip_reg[domain][idx] & ie_reg[domain][idx] & active_reg[domain][idx];
 
-		if (irq_id == NumberInterrupts)
-			return 0;
+		pending &= ~(uint32_t)(BIT(first_irq_id % 32) - 1);
+		while (pending == 0) {
+			if (++idx == 32)
+				return 0;
+			pending = ip_reg[domain][idx] & ie_reg[domain][idx] & active_reg[domain][idx];
+		}
 
-		return irq_id;
+		return idx * 32 + __builtin_ctz(pending);
 	}
 
 	void transport(tlm::tlm_generic_payload &trans, sc_core::sc_time &delay)
 	{
 		delay += 4 * clock_cycle;
-		vp::mm::route("APLIC", register_ranges, trans, delay);
+		register_map.route(trans, delay);
 	}
 
 	uint32_t get_m_target_address(uint32_t hart_ind /* From target[i] */)
@@ -785,8 +823,6 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		uint32_t g, h;
 		uint32_t lhxw, hhxw, hhxs, lhxs;
 
-		assert(hart_ind < NumberCores);
-
 		mmsiaddr = *mmsiaddrcfg[APLIC_M_DOMAIN];
 		mmsiaddrh = *mmsiaddrcfgh[APLIC_M_DOMAIN];
 		lhxw = (mmsiaddrh >> APLIC_MMSIADDRCFGH_LHXW_BIT) & APLIC_MMSIADDRCFGH_LHXW_MASK;
@@ -812,8 +848,6 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		uint32_t lhxw, hhxw, hhxs, lhxs;
 		uint32_t offs;
 
-		assert(machine_hart_ind < NumberCores);
-
 		mmsiaddr = *mmsiaddrcfg[APLIC_M_DOMAIN];
 		mmsiaddrh = *mmsiaddrcfgh[APLIC_M_DOMAIN];
 		smsiaddr = *smsiaddrcfg[APLIC_M_DOMAIN];
@@ -852,11 +886,52 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		(*setip[domain])[idx] = ip_reg[domain][idx]; /* Read of setip return pending bits of the sources */
 	}
 
+	/* Registers the IMSIC of hart *hart_ind* whose M, S and *num_guests* guest interrupt files are consecutive pages
+	 * starting at *base_addr* (see ImsicMem) */
+	void register_imsic(uint32_t hart_ind, uint64_t base_addr, unsigned num_guests, imsic_mem_target *target)
+	{
+		if (hart_ind >= NumberCores)
+			throw std::runtime_error("APLIC: no hart with index " + std::to_string(hart_ind) + " to register an IMSIC for");
+
+		imsics[hart_ind].target = target;
+		imsics[hart_ind].base_addr = base_addr;
+		imsics[hart_ind].num_files = 2 + num_guests;
+	}
+
+	/* *hart_ind* comes from the guest written target/genmsi registers and may exceed *NumberCores*, such MSIs
+	 * always go over the bus */
+	void send_msi(uint32_t hart_ind, uint32_t addr, uint32_t msi_data)
+	{
+		/* Only the seteipnum_le register at the start of an interrupt file's page takes the MSI, other writes are
+		 * left to the bus (and ignored by the IMSIC) */
+		if (!msi_through_bus && hart_ind < NumberCores && imsics[hart_ind].target &&
+		    addr >= imsics[hart_ind].base_addr) {
+			const imsic_region &imsic = imsics[hart_ind];
+			uint64_t offs = addr - imsic.base_addr;
+			uint64_t file = offs >> APLIC_PAGE_BITS;
+
+			if ((offs & (APLIC_PAGE_SIZE - 1)) == 0 && file < imsic.num_files) {
+				if (file == 0)
+					imsic.target->route_imsic_write(MachineMode, 0, msi_data);
+				else if (file == 1)
+					imsic.target->route_imsic_write(SupervisorMode, 0, msi_data);
+				else
+					imsic.target->route_imsic_write(VirtualSupervisorMode, file - 2, msi_data);
+				return;
+			}
+		}
+
+		sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+		auto &trans = msi_payload.prepare(tlm::TLM_WRITE_COMMAND, addr, reinterpret_cast<unsigned char *>(&msi_data),
+		                                  sizeof(uint32_t));
+		isock->b_transport(trans, delay); /* Send MSI */
+	}
+
 	void msi_write(uint32_t domain, uint32_t irq_id)
 	{
 		uint32_t tgt;
 		uint32_t addr;
-		uint32_t hart_ind;
+		uint32_t hart_ind, guest_ind;
 		uint32_t msi_data;
 
 		if (irq_id < 1 || irq_id >= NumberInterrupts)
@@ -868,18 +943,18 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 
 		tgt = (*target[domain])[irq_id - 1];
 		hart_ind = (tgt >> APLIC_TARGETS_HARTIND_BIT) & APLIC_TARGETS_HARTIND_MASK;
-		addr = get_m_target_address(hart_ind);
+		if (domain == APLIC_M_DOMAIN) {
+			addr = get_m_target_address(hart_ind);
+		} else {
+			/* Supervisor-level domain: the interrupt file of the supervisor or of a guest */
+			guest_ind = (tgt >> APLIC_TARGETS_DMSICONTX_BIT) & APLIC_TARGETS_DMSICONTX_MASK;
+			addr = get_s_target_address(hart_ind, guest_ind);
+		}
 
 		/* MSI is sent even if domaincfg.IE = 0 */
 		msi_data = (tgt >> APLIC_TARGETS_EIID_BIT) & APLIC_TARGETS_EIID_MASK; /* MSI data: zero extended EIID field */
 
-		sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
-		tlm::tlm_generic_payload trans;
-		trans.set_command(tlm::TLM_WRITE_COMMAND);
-		trans.set_address(addr);
-		trans.set_data_ptr(reinterpret_cast<unsigned char *>(&msi_data));
-		trans.set_data_length(sizeof(uint32_t));
-		isock->b_transport(trans, delay); /* Send MSI */
+		send_msi(hart_ind, addr, msi_data);
 
 		/* Clear pending bit, if edge level triggered */
 		msi_clr_pending(domain, irq_id);
@@ -892,9 +967,14 @@ struct APLIC : public sc_core::sc_module, public interrupt_gateway {
 		while (true) {
 			sc_core::wait(e_run);
 
-			int_id = hart_get_next_pending_interrupt(APLIC_M_DOMAIN);
-			if (int_id > 0) {
-				msi_write(APLIC_M_DOMAIN, int_id);
+			/* Forward every interrupt pending at this point in ascending order. Level-sensitive sources stay
+			 * pending after the MSI, hence are forwarded once per activation. */
+			for (unsigned domain = 0; domain < NumberDomains; domain++) {
+				int_id = hart_get_next_pending_interrupt(domain);
+				while (int_id > 0) {
+					msi_write(domain, int_id);
+					int_id = hart_get_next_pending_interrupt(domain, int_id + 1);
+				}
 			}
 		}
 	}
@@ -0,0 +1,75 @@
+/* Measures the address decoding of SimpleBus for an increasing number of targets and compares it to a linear scan
+ * over the port mappings. The targets either occupy whole pages (served by the decode table) or share pages (served
+ * by the binary search). */
+#include "bus.h"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static constexpr uint64_t BASE_ADDR = 0x10000000;
+static constexpr unsigned NUM_ADDRS = 1 << 20;
+static constexpr unsigned ROUNDS = 20;
+static constexpr unsigned BURST = 4;
+
+template <typename F>
+static double measure(const vector<uint64_t> &addrs, F decode) {
+	uint64_t sum = 0;
+	auto start = chrono::steady_clock::now();
+	for (unsigned r = 0; r < ROUNDS; ++r) {
+		for (uint64_t addr : addrs)
+			sum += decode(addr);
+	}
+	auto end = chrono::steady_clock::now();
+	// keep the decoding alive
+	if (sum == 1)
+		cout << "";
+	return chrono::duration<double, nano>(end - start).count() / (double(addrs.size()) * ROUNDS);
+}
+
+template <unsigned N>
+static void bench(uint64_t stride) {
+	SimpleBus<1, N> bus(("SimpleBus_" + to_string(N) + "_" + to_string(stride)).c_str());
+	for (unsigned i = 0; i < N; ++i)
+		bus.ports[i] = new PortMapping(BASE_ADDR + i * stride, BASE_ADDR + (i + 1) * stride - 1);
+	bus.build_decoder();
+
+	// a few accesses to one target at a time, e.g. a driver accessing the registers of a device
+	mt19937_64 rng(42);
+	vector<uint64_t> addrs;
+	while (addrs.size() < NUM_ADDRS) {
+		uint64_t target = BASE_ADDR + (rng() % N) * stride;
+		for (unsigned i = 0; i < BURST; ++i)
+			addrs.push_back(target + rng() % stride);
+	}
+
+	double linear = measure(addrs, [&bus](uint64_t addr) {
+		for (unsigned i = 0; i < N; ++i) {
+			if (bus.ports[i]->contains(addr))
+				return int(i);
+		}
+		return -1;
+	});
+	double decode = measure(addrs, [&bus](uint64_t addr) { return bus.decode(addr); });
+	double last_target = measure(addrs, [&bus](uint64_t addr) { return bus.decode(0, addr); });
+
+	cout << N << " targets, stride 0x" << hex << stride << dec << ": linear " << linear << " ns, decode " << decode
+	     << " ns, decode with last target " << last_target << " ns" << endl;
+
+	for (auto p : bus.ports)
+		delete p;
+}
+
+int sc_main(int, char **) {
+	for (uint64_t stride : {0x1000, 0x100}) {
+		bench<4>(stride);
+		bench<16>(stride);
+		bench<64>(stride);
+		bench<250>(stride);
+	}
+	return 0;
+}
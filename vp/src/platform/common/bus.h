@@ -5,9 +5,12 @@
 #include <tlm_utils/simple_target_socket.h>
 #include <systemc>
 
+#include <algorithm>
 #include <map>
 #include <stdexcept>
 #include <memory>
+#include <string>
+#include <vector>
 
 struct PortMapping {
 	uint64_t start;
@@ -24,33 +27,140 @@ struct PortMapping {
 	uint64_t global_to_local(uint64_t addr) {
 		return addr - start;
 	}
+
+	// addresses beyond the mapping are clipped to its end
+	uint64_t local_to_global(uint64_t addr) {
+		return std::min(addr, end - start) + start;
+	}
 };
 
 template <unsigned int NR_OF_INITIATORS, unsigned int NR_OF_TARGETS>
 struct SimpleBus : sc_core::sc_module {
-	std::array<tlm_utils::simple_target_socket<SimpleBus>, NR_OF_INITIATORS> tsocks;
+	//
+	// Address decoding uses a table with the target of every page in the low 4 GiB, pages shared by several targets
+	// (or partially unmapped) and addresses above fall back to a binary search over the port mappings sorted by start
+	// address, which is skipped if the access hits the last target of the initiator. Both are built once after
+	// elaboration, when all *ports* are set.
+	//
+	static constexpr unsigned DECODE_PAGE_SHIFT = 12;
+	static constexpr uint64_t DECODE_TABLE_END = uint64_t(1) << 32;
+	static constexpr uint8_t PAGE_UNMAPPED = 0xff;
+	static constexpr uint8_t PAGE_SHARED = 0xfe;
+	static_assert(NR_OF_TARGETS < PAGE_SHARED, "target ids must fit into the decode table");
+
+	std::array<tlm_utils::simple_target_socket_tagged<SimpleBus>, NR_OF_INITIATORS> tsocks;
 
-	std::array<tlm_utils::simple_initiator_socket<SimpleBus>, NR_OF_TARGETS> isocks;
-	std::array<PortMapping *, NR_OF_TARGETS> ports;
+	std::array<tlm_utils::simple_initiator_socket_tagged<SimpleBus>, NR_OF_TARGETS> isocks;
+	std::array<PortMapping *, NR_OF_TARGETS> ports{};
+
+	std::vector<uint8_t> decode_table;
+	std::vector<unsigned> sorted_ports;  // target ids by start address
+	std::vector<uint64_t> sorted_starts;
+	std::array<int, NR_OF_INITIATORS> last_target;
 
 	SimpleBus(sc_core::sc_module_name) {
-		for (auto &s : tsocks) {
-			s.register_b_transport(this, &SimpleBus::transport);
-			s.register_transport_dbg(this, &SimpleBus::transport_dbg);
+		for (unsigned i = 0; i < NR_OF_INITIATORS; ++i) {
+			tsocks[i].register_b_transport(this, &SimpleBus::transport, i);
+			tsocks[i].register_transport_dbg(this, &SimpleBus::transport_dbg, i);
+			tsocks[i].register_get_direct_mem_ptr(this, &SimpleBus::get_direct_mem_ptr, i);
 		}
+
+		for (unsigned i = 0; i < NR_OF_TARGETS; ++i)
+			isocks[i].register_invalidate_direct_mem_ptr(this, &SimpleBus::invalidate_direct_mem_ptr, i);
+
+		last_target.fill(-1);
 	}
 
-	int decode(uint64_t addr) {
+	void end_of_elaboration() override {
+		build_decoder();
+	}
+
+	void build_decoder() {
+		sorted_ports.clear();
 		for (unsigned i = 0; i < NR_OF_TARGETS; ++i) {
-			if (ports[i]->contains(addr))
-				return i;
+			if (ports[i])
+				sorted_ports.push_back(i);
+		}
+		std::sort(sorted_ports.begin(), sorted_ports.end(),
+		          [this](unsigned a, unsigned b) { return ports[a]->start < ports[b]->start; });
+
+		sorted_starts.clear();
+		for (unsigned i = 0; i < sorted_ports.size(); ++i) {
+			auto p = ports[sorted_ports[i]];
+			if (i > 0 && p->start <= ports[sorted_ports[i - 1]]->end)
+				throw std::runtime_error("overlapping port mappings of target " + std::to_string(sorted_ports[i - 1]) +
+				                         " and " + std::to_string(sorted_ports[i]) + " in " + name());
+			sorted_starts.push_back(p->start);
+		}
+
+		decode_table.assign(DECODE_TABLE_END >> DECODE_PAGE_SHIFT, PAGE_UNMAPPED);
+		for (auto id : sorted_ports) {
+			auto p = ports[id];
+			if (p->start >= DECODE_TABLE_END)
+				continue;
+
+			uint64_t last = std::min(p->end, DECODE_TABLE_END - 1);
+			for (uint64_t page = p->start >> DECODE_PAGE_SHIFT; page <= (last >> DECODE_PAGE_SHIFT); ++page) {
+				uint64_t page_start = page << DECODE_PAGE_SHIFT;
+				uint64_t page_end = page_start + (uint64_t(1) << DECODE_PAGE_SHIFT) - 1;
+				bool whole_page = p->start <= page_start && page_end <= p->end;
+
+				if (whole_page && decode_table[page] == PAGE_UNMAPPED)
+					decode_table[page] = id;
+				else
+					decode_table[page] = PAGE_SHARED;
+			}
 		}
-		return -1;
 	}
 
-	void transport(tlm::tlm_generic_payload &trans, sc_core::sc_time &delay) {
+	/* Target of *addr* if it can be determined from the decode table, PAGE_SHARED otherwise. */
+	int decode_page(uint64_t addr) {
+		if (decode_table.empty())
+			build_decoder();  // accessed before the end of elaboration
+
+		if (addr >= DECODE_TABLE_END)
+			return PAGE_SHARED;
+
+		auto e = decode_table[addr >> DECODE_PAGE_SHIFT];
+		return e == PAGE_UNMAPPED ? -1 : e;
+	}
+
+	int search(uint64_t addr) {
+		if (sorted_starts.empty() || addr < sorted_starts[0])
+			return -1;
+
+		// last port starting at or below addr, without data dependent branches
+		size_t pos = 0;
+		for (size_t n = sorted_starts.size(); n > 1; n -= n / 2)
+			pos = (sorted_starts[pos + n / 2] <= addr) ? pos + n / 2 : pos;
+
+		unsigned id = sorted_ports[pos];
+		return ports[id]->contains(addr) ? int(id) : -1;
+	}
+
+	int decode(uint64_t addr) {
+		int id = decode_page(addr);
+		return id == PAGE_SHARED ? search(addr) : id;
+	}
+
+	int decode(int initiator, uint64_t addr) {
+		int id = decode_page(addr);
+		if (id != PAGE_SHARED)
+			return id;
+
+		int &last = last_target[initiator];
+		if (last >= 0 && ports[last]->contains(addr))
+			return last;
+
+		id = search(addr);
+		if (id >= 0)
+			last = id;
+		return id;
+	}
+
+	void transport(int initiator, tlm::tlm_generic_payload &trans, sc_core::sc_time &delay) {
 		auto addr = trans.get_address();
-		auto id = decode(addr);
+		auto id = decode(initiator, addr);
 
 		if (id < 0) {
 			trans.set_response_status(tlm::TLM_ADDRESS_ERROR_RESPONSE);
@@ -61,9 +171,9 @@ struct SimpleBus : sc_core::sc_module {
 		isocks[id]->b_transport(trans, delay);
 	}
 
-	unsigned transport_dbg(tlm::tlm_generic_payload &trans) {
+	unsigned transport_dbg(int initiator, tlm::tlm_generic_payload &trans) {
 		auto addr = trans.get_address();
-		auto id = decode(addr);
+		auto id = decode(initiator, addr);
 
 		if (id < 0) {
 			trans.set_response_status(tlm::TLM_ADDRESS_ERROR_RESPONSE);
@@ -73,6 +183,31 @@ struct SimpleBus : sc_core::sc_module {
 		trans.set_address(ports[id]->global_to_local(addr));
 		return isocks[id]->transport_dbg(trans);
 	}
+
+	bool get_direct_mem_ptr(int initiator, tlm::tlm_generic_payload &trans, tlm::tlm_dmi &dmi) {
+		auto addr = trans.get_address();
+		auto id = decode(initiator, addr);
+
+		if (id < 0) {
+			dmi.set_start_address(addr);
+			dmi.set_end_address(addr);
+			return false;
+		}
+
+		// the granted (or denied) range is translated back to global addresses and limited to the target
+		trans.set_address(ports[id]->global_to_local(addr));
+		bool ok = isocks[id]->get_direct_mem_ptr(trans, dmi);
+		trans.set_address(addr);
+
+		dmi.set_start_address(ports[id]->local_to_global(dmi.get_start_address()));
+		dmi.set_end_address(ports[id]->local_to_global(dmi.get_end_address()));
+		return ok;
+	}
+
+	void invalidate_direct_mem_ptr(int id, sc_dt::uint64 start, sc_dt::uint64 end) {
+		for (auto &s : tsocks)
+			s->invalidate_direct_mem_ptr(ports[id]->local_to_global(start), ports[id]->local_to_global(end));
+	}
 };
 
 #include "core/common/bus_lock_if.h"
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string.h>
+
 #include <tlm_utils/simple_target_socket.h>
 #include <systemc>
 
@@ -18,6 +20,7 @@ template <unsigned NumberCores, unsigned NumberInterrupts, unsigned NumberInterr
 struct FE310_PLIC : public sc_core::sc_module, public interrupt_gateway {
 	static_assert(NumberInterrupts <= 4096, "out of bound");
 	static_assert(NumberCores <= 15360, "out of bound");
+	static_assert(MaxPriority < 64, "priority summary is a 64 bit mask");
 	static constexpr unsigned WORDS_FOR_INTERRUPT_ENTRIES = (NumberInterruptEntries+(32-1))/32;
 
 	tlm_utils::simple_target_socket<FE310_PLIC> tsock;
@@ -49,6 +52,11 @@ struct FE310_PLIC : public sc_core::sc_module, public interrupt_gateway {
 	                                             &regs_hart_config
 	};
 
+	// pending interrupts bucketed by their priority (bucket 0 is unused, priority zero never interrupts), prio_summary
+	// has a bit set for each non-empty bucket; both are updated on pending and priority changes
+	uint32_t prio_pending[MaxPriority + 1][WORDS_FOR_INTERRUPT_ENTRIES] = {};
+	uint64_t prio_summary = 0;
+
 	PrivilegeLevel irq_level;
 	std::array<bool, NumberCores> hart_eip{};
 
@@ -64,28 +72,12 @@ struct FE310_PLIC : public sc_core::sc_module, public interrupt_gateway {
 		regs_pending_interrupts.readonly = true;
 		regs_hart_config.alignment = 4;
 
-		regs_interrupt_priorities.post_write_callback =
-		    std::bind(&FE310_PLIC::post_write_interrupt_priorities, this, std::placeholders::_1);
-		regs_hart_config.post_write_callback = std::bind(&FE310_PLIC::post_write_hart_config, this, std::placeholders::_1);
-		regs_hart_config.pre_read_callback = std::bind(&FE310_PLIC::pre_read_hart_config, this, std::placeholders::_1);
+		regs_interrupt_priorities.post_write_callback = vp::mm::bind<&FE310_PLIC::post_write_interrupt_priorities>(this);
+		regs_hart_config.post_write_callback = vp::mm::bind<&FE310_PLIC::post_write_hart_config>(this);
+		regs_hart_config.pre_read_callback = vp::mm::bind<&FE310_PLIC::pre_read_hart_config>(this);
 		
-		if (trace_mode) {
-		    regs_hart_enabled_interrupts.post_write_callback = [this](RegisterRange::WriteInfo t){
-			    std::cout << "[vp::plic] Wrote enabled_interrupts at offs +" << std::dec << t.addr << " value 0x" << std::hex << *reinterpret_cast<uint32_t*>(t.trans.get_data_ptr()) << std::dec << std::endl;
-			    for (unsigned n = 0; n < NumberCores; ++n) {
-				    for (unsigned i = 0; i < WORDS_FOR_INTERRUPT_ENTRIES; ++i) {
-					    const uint32_t itr_group = hart_enabled_interrupts(n, i);
-					    if(itr_group) {
-						    for(unsigned b = 0; b < 32; b++) {
-							    if((1 << b) & itr_group) {
-        							std::cout << "[vp::plic]\t Hart " << n << " ITR " << i*32 + b << " enabled." << std::dec << std::endl;
-							    }
-						    }
-					    }
-				    }
-			    }
-		    };
-	    }
+		if (trace_mode)
+			regs_hart_enabled_interrupts.post_write_callback = vp::mm::bind<&FE310_PLIC::trace_write_enabled_interrupts>(this);
 		
 		for (unsigned i = 0; i < NumberInterrupts; ++i) {
 			interrupt_priorities[i] = 0;
@@ -113,6 +105,7 @@ struct FE310_PLIC : public sc_core::sc_module, public interrupt_gateway {
 		unsigned off = irq_id % 32;
 
 		pending_interrupts[idx] |= 1 << off;
+		update_prio_bucket(irq_id);
 
 		e_run.notify(clock_cycle);
 	}
@@ -125,33 +118,77 @@ struct FE310_PLIC : public sc_core::sc_module, public interrupt_gateway {
 		unsigned off = irq_id % 32;
 
 		pending_interrupts[idx] &= ~(1 << off);
+		if (irq_id > 0)
+			update_prio_bucket(irq_id);
+	}
+
+	// only called for pending changes, the bucket of an interrupt changes with its priority in *rebuild_prio_buckets*
+	void update_prio_bucket(unsigned irq_id) {
+		unsigned idx = irq_id / 32;
+		unsigned off = irq_id % 32;
+		auto prio = interrupt_priorities[irq_id];
+
+		if (prio == 0)
+			return;
+
+		if (pending_interrupts[idx] & (1 << off)) {
+			prio_pending[prio][idx] |= 1 << off;
+			prio_summary |= uint64_t(1) << prio;
+		} else {
+			prio_pending[prio][idx] &= ~(1 << off);
+			if (bucket_empty(prio))
+				prio_summary &= ~(uint64_t(1) << prio);
+		}
+	}
+
+	bool bucket_empty(unsigned prio) {
+		for (unsigned i = 0; i < WORDS_FOR_INTERRUPT_ENTRIES; ++i) {
+			if (prio_pending[prio][i])
+				return false;
+		}
+		return true;
+	}
+
+	void rebuild_prio_buckets() {
+		memset(prio_pending, 0, sizeof(prio_pending));
+		prio_summary = 0;
+
+		for (unsigned irq_id = 1; irq_id < NumberInterrupts; ++irq_id) {
+			unsigned idx = irq_id / 32;
+			unsigned off = irq_id % 32;
+			auto prio = interrupt_priorities[irq_id];
+
+			if (prio > 0 && (pending_interrupts[idx] & (1 << off))) {
+				prio_pending[prio][idx] |= 1 << off;
+				prio_summary |= uint64_t(1) << prio;
+			}
+		}
 	}
 
 	unsigned hart_get_next_pending_interrupt(unsigned hart_id, bool consider_threshold) {
-		unsigned min_id = 0;
-		unsigned max_priority = 0;
-
-		for (unsigned i = 1; i < NumberInterrupts; ++i) {
-			unsigned idx = i / 32;
-			unsigned off = i % 32;
-
-			if (hart_enabled_interrupts(hart_id, idx) & (1 << off)) {
-				if (trace_mode) std::cout << "[vp::plic] hart " << hart_id << " has enabled ITR " << i << std::endl;
-				if (pending_interrupts[idx] & (1 << off)) {
-					auto prio = interrupt_priorities[i];
-					if (trace_mode) std::cout << "[vp::plic] .. and it is pending with priority " << prio << std::endl;
-					if (prio > 0 && (!consider_threshold || (prio > hart_config[hart_id].priority_threshold))) {
-						if (trace_mode) std::cout << "[vp::plic]   .. which is greater than the hart's threshold of " << hart_config[hart_id].priority_threshold << std::endl;
-						if (prio > max_priority) {
-							max_priority = prio;
-							min_id = i;
-						}
-					}
+		uint64_t prios = prio_summary;
+
+		if (consider_threshold) {
+			auto threshold = hart_config[hart_id].priority_threshold;
+			prios &= (threshold >= MaxPriority) ? 0 : ~((uint64_t(2) << threshold) - 1);
+		}
+
+		// within a priority the interrupt with the lowest id wins
+		while (prios) {
+			unsigned prio = 63 - __builtin_clzll(prios);
+
+			for (unsigned i = 0; i < WORDS_FOR_INTERRUPT_ENTRIES; ++i) {
+				uint32_t itrs = prio_pending[prio][i] & hart_enabled_interrupts(hart_id, i);
+				if (itrs) {
+					if (trace_mode) std::cout << "[vp::plic] hart " << hart_id << " next ITR " << i * 32 + __builtin_ctz(itrs) << " with priority " << prio << std::endl;
+					return i * 32 + __builtin_ctz(itrs);
 				}
 			}
+
+			prios &= ~(uint64_t(1) << prio);
 		}
 
-		return min_id;
+		return 0;
 	}
 
 	void transport(tlm::tlm_generic_payload &trans, sc_core::sc_time &delay) {
@@ -160,7 +197,23 @@ struct FE310_PLIC : public sc_core::sc_module, public interrupt_gateway {
 		vp::mm::route("FE310_PLIC", register_ranges, trans, delay);
 	}
 
-	void post_write_interrupt_priorities(RegisterRange::WriteInfo) {
+	void trace_write_enabled_interrupts(const RegisterRange::WriteInfo &t) {
+		std::cout << "[vp::plic] Wrote enabled_interrupts at offs +" << std::dec << t.addr << " value 0x" << std::hex << *reinterpret_cast<uint32_t*>(t.trans.get_data_ptr()) << std::dec << std::endl;
+		for (unsigned n = 0; n < NumberCores; ++n) {
+			for (unsigned i = 0; i < WORDS_FOR_INTERRUPT_ENTRIES; ++i) {
+				const uint32_t itr_group = hart_enabled_interrupts(n, i);
+				if(itr_group) {
+					for(unsigned b = 0; b < 32; b++) {
+						if((1 << b) & itr_group) {
+							std::cout << "[vp::plic]\t Hart " << n << " ITR " << i*32 + b << " enabled." << std::dec << std::endl;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void post_write_interrupt_priorities(const RegisterRange::WriteInfo &) {
 		if (trace_mode) std::cout << "[vp::plic] wrote ITR priority:" << std::endl;
 		unsigned i = 0;
 		for (auto &x : interrupt_priorities) {
@@ -168,9 +221,11 @@ struct FE310_PLIC : public sc_core::sc_module, public interrupt_gateway {
 			if (trace_mode) if(x) std::cout << "[vp::plic]\t Prio for ITR nr. " << i << ": " << x << std::endl;
 			i++;
 		}
+
+		rebuild_prio_buckets();
 	}
 
-	bool pre_read_hart_config(RegisterRange::ReadInfo t) {
+	bool pre_read_hart_config(const RegisterRange::ReadInfo &t) {
 		assert(t.addr % 4 == 0);
 		unsigned idx = t.addr / 4;
 
@@ -187,7 +242,7 @@ struct FE310_PLIC : public sc_core::sc_module, public interrupt_gateway {
 		return true;
 	}
 
-	void post_write_hart_config(RegisterRange::WriteInfo t) {
+	void post_write_hart_config(const RegisterRange::WriteInfo &t) {
 		assert(t.addr % 4 == 0);
 		unsigned idx = t.addr / 4;
 
@@ -35,39 +35,39 @@ FU540_PLIC::FU540_PLIC(sc_core::sc_module_name, unsigned harts) {
 }
 
 void FU540_PLIC::create_registers(void) {
-	regs_interrupt_priorities.post_write_callback =
-		std::bind(&FU540_PLIC::write_irq_prios, this, std::placeholders::_1);
+	regs_interrupt_priorities.post_write_callback = vp::mm::bind<&FU540_PLIC::write_irq_prios>(this);
 
 	/* make pending interrupts read-only */
-	regs_pending_interrupts.pre_write_callback =
-		[] (RegisterRange::WriteInfo) { return false; };
+	regs_pending_interrupts.pre_write_callback = vp::mm::bind<&FU540_PLIC::ignore_write>(this);
 
 	/* The priorities end address, as documented in the FU540-C000
 	 * manual, is incorrect <https://github.com/riscv/opensbi/pull/138> */
 	assert_addr(0x4, 0xD4, &regs_interrupt_priorities);
 	assert_addr(0x1000, 0x1004, &regs_pending_interrupts);
 
-	register_ranges.push_back(&regs_interrupt_priorities);
-	register_ranges.push_back(&regs_pending_interrupts);
+	register_map.add({&regs_interrupt_priorities, &regs_pending_interrupts});
 
 	/* create IRQ enable and context registers */
 	create_hart_regs(ENABLE_BASE, ENABLE_PER_HART, enabled_irqs);
 	create_hart_regs(CONTEXT_BASE, CONTEXT_PER_HART, hart_context);
 
 	/* only supports "naturally aligned 32-bit memory accesses" */
-	for (size_t i = 0; i < register_ranges.size(); i++)
-		register_ranges[i]->alignment = sizeof(uint32_t);
+	for (auto r : register_map.get_ranges())
+		r->alignment = sizeof(uint32_t);
+
+	register_map.build();
 }
 
 void FU540_PLIC::create_hart_regs(uint64_t addr, uint64_t inc, hartmap &map) {
 	auto add_reg = [this, addr] (unsigned int h, PrivilegeLevel l, uint64_t a) {
 		RegisterRange *r = new RegisterRange(a, HART_REG_SIZE);
 		if (addr == CONTEXT_BASE) {
-			r->pre_read_callback = std::bind(&FU540_PLIC::read_hartctx, this, std::placeholders::_1, h, l);
-			r->post_write_callback = std::bind(&FU540_PLIC::write_hartctx, this, std::placeholders::_1, h, l);
+			contexts.emplace_back(new HartContext{this, h, l});
+			r->pre_read_callback = vp::mm::bind<&HartContext::read>(contexts.back().get());
+			r->post_write_callback = vp::mm::bind<&HartContext::write>(contexts.back().get());
 		}
 
-		register_ranges.push_back(r);
+		register_map.add(*r);
 		return r;
 	};
 
@@ -89,7 +89,7 @@ void FU540_PLIC::create_hart_regs(uint64_t addr, uint64_t inc, hartmap &map) {
 
 void FU540_PLIC::transport(tlm::tlm_generic_payload &trans, sc_core::sc_time &delay) {
 	delay += 4 * clock_cycle; /* copied from FE310_PLIC */
-	vp::mm::route("FU540_PLIC", register_ranges, trans, delay);
+	register_map.route(trans, delay);
 }
 
 void FU540_PLIC::gateway_trigger_interrupt(uint32_t irq) {
@@ -97,10 +97,11 @@ void FU540_PLIC::gateway_trigger_interrupt(uint32_t irq) {
 		throw std::invalid_argument("IRQ value is invalid");
 
 	pending_interrupts[GET_IDX(irq)] |= GET_OFF(irq);
+	update_prio_bucket(irq);
 	e_run.notify(clock_cycle);
 }
 
-bool FU540_PLIC::read_hartctx(RegisterRange::ReadInfo t, unsigned int hart, PrivilegeLevel level) {
+bool FU540_PLIC::read_hartctx(const RegisterRange::ReadInfo &t, unsigned int hart, PrivilegeLevel level) {
 	assert(t.addr % sizeof(uint32_t) == 0);
 	assert(t.size == sizeof(uint32_t));
 
@@ -131,7 +132,7 @@ bool FU540_PLIC::read_hartctx(RegisterRange::ReadInfo t, unsigned int hart, Priv
 	return true;
 }
 
-void FU540_PLIC::write_hartctx(RegisterRange::WriteInfo t, unsigned int hart, PrivilegeLevel level) {
+void FU540_PLIC::write_hartctx(const RegisterRange::WriteInfo &t, unsigned int hart, PrivilegeLevel level) {
 	assert(t.addr % sizeof(uint32_t) == 0);
 	assert(t.size == sizeof(uint32_t));
 
@@ -156,12 +157,23 @@ void FU540_PLIC::write_hartctx(RegisterRange::WriteInfo t, unsigned int hart, Pr
 	}
 }
 
-void FU540_PLIC::write_irq_prios(RegisterRange::WriteInfo t) {
+bool FU540_PLIC::ignore_write(const RegisterRange::WriteInfo &) {
+	return false;
+}
+
+void FU540_PLIC::write_irq_prios(const RegisterRange::WriteInfo &t) {
 	size_t idx = t.addr / sizeof(uint32_t);
 	assert(idx <= NUMIRQ);
 
 	auto &elem = interrupt_priorities[idx];
 	elem = std::min(elem, uint32_t(MAX_PRIO));
+
+	// move the irq out of the bucket of its previous priority
+	for (uint32_t p = 1; p <= MAX_PRIO; p++) {
+		if (p != elem)
+			remove_from_bucket(p, idx + 1);
+	}
+	update_prio_bucket(idx + 1);
 }
 
 void FU540_PLIC::run(void) {
@@ -182,23 +194,27 @@ unsigned int FU540_PLIC::next_pending_irq(unsigned int hart, PrivilegeLevel lvl,
 	assert(!(hart == 0 && lvl == SupervisorMode));
 
 	HartConfig *conf = enabled_irqs[hart];
-	unsigned int selirq = 0, maxpri = 0;
+	uint32_t prios = prio_summary;
 
-	for (unsigned irq = 1; irq <= NUMIRQ; irq++) {
-		if (!conf->is_enabled(irq, lvl) || !is_pending(irq))
-			continue;
+	if (!ignth) {
+		uint32_t thr = get_threshold(hart, lvl);
+		prios &= (thr >= MAX_PRIO) ? 0 : ~((2u << thr) - 1);
+	}
 
-		uint32_t prio = interrupt_priorities[irq - 1];
-		if (!ignth && prio <= get_threshold(hart, lvl))
-			continue;
+	/* within a priority the irq with the lowest ID wins */
+	while (prios) {
+		uint32_t prio = 31 - __builtin_clz(prios);
 
-		if (prio > maxpri) {
-			maxpri = prio;
-			selirq = irq;
+		for (unsigned idx = 0; idx < IRQ_WORDS; idx++) {
+			uint32_t irqs = prio_pending[prio][idx] & conf->get_enabled(idx, lvl);
+			if (irqs)
+				return idx * 32 + __builtin_ctz(irqs);
 		}
+
+		prios &= ~(1u << prio);
 	}
 
-	return selirq;
+	return 0;
 }
 
 bool FU540_PLIC::has_pending_irq(unsigned int hart, PrivilegeLevel *level) {
@@ -233,6 +249,37 @@ uint32_t FU540_PLIC::get_threshold(unsigned int hart, PrivilegeLevel level) {
 void FU540_PLIC::clear_pending(unsigned int irq) {
 	assert(irq > 0 && irq <= NUMIRQ);
 	pending_interrupts[GET_IDX(irq)] &= ~(GET_OFF(irq));
+	update_prio_bucket(irq);
+}
+
+void FU540_PLIC::update_prio_bucket(unsigned int irq) {
+	assert(irq > 0 && irq <= NUMIRQ);
+
+	uint32_t prio = interrupt_priorities[irq - 1];
+	if (prio == 0)
+		return;
+
+	if (is_pending(irq)) {
+		prio_pending[prio][GET_IDX(irq)] |= GET_OFF(irq);
+		prio_summary |= 1u << prio;
+	} else {
+		remove_from_bucket(prio, irq);
+	}
+}
+
+void FU540_PLIC::remove_from_bucket(uint32_t prio, unsigned int irq) {
+	unsigned int idx = GET_IDX(irq);
+	uint32_t off = GET_OFF(irq);
+
+	if (!(prio_pending[prio][idx] & off))
+		return;
+
+	prio_pending[prio][idx] &= ~off;
+	for (unsigned i = 0; i < IRQ_WORDS; i++) {
+		if (prio_pending[prio][i])
+			return;
+	}
+	prio_summary &= ~(1u << prio);
 }
 
 bool FU540_PLIC::is_pending(unsigned int irq) {
@@ -245,20 +292,17 @@ bool FU540_PLIC::is_claim_access(uint64_t addr) {
 	return (idx % 2) == 1;
 }
 
-bool FU540_PLIC::HartConfig::is_enabled(unsigned int irq, PrivilegeLevel level) {
-	assert(irq > 0 && irq <= NUMIRQ);
-
-	unsigned int idx = GET_IDX(irq);
-	unsigned int off = GET_OFF(irq);
+uint32_t FU540_PLIC::HartConfig::get_enabled(unsigned int idx, PrivilegeLevel level) {
+	assert(idx < IRQ_WORDS);
 
 	switch (level) {
 	case MachineMode:
-		return m_mode[idx] & off;
+		return m_mode[idx];
 	case SupervisorMode:
-		return s_mode[idx] & off;
+		return s_mode[idx];
 	default:
 		assert(0);
 	}
 
-	return false;
+	return 0;
 }
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <map>
+#include <memory>
 
 /**
  * This class implements a Platform-Level Interrupt Controller (PLIC) as
@@ -12,6 +13,7 @@ public:
 	static constexpr int      NUMIRQ   = 53;
 	static constexpr uint32_t MAX_THR  = 7;
 	static constexpr uint32_t MAX_PRIO = 7;
+	static constexpr unsigned IRQ_WORDS = NUMIRQ / 32 + 1;
 
 	static constexpr uint32_t ENABLE_BASE = 0x2000;
 	static constexpr uint32_t ENABLE_PER_HART = 0x80;
@@ -37,13 +39,29 @@ private:
 			return;
 		}
 
-		bool is_enabled(unsigned int, PrivilegeLevel);
+		uint32_t get_enabled(unsigned int, PrivilegeLevel);
 	};
 
 	sc_core::sc_event e_run;
 	sc_core::sc_time clock_cycle;
 
-	std::vector<RegisterRange*> register_ranges;
+	vp::mm::RegisterMap register_map{"FU540_PLIC"};
+
+	/* Binds the accesses to the context registers of a hart and privilege level to read_hartctx/write_hartctx */
+	struct HartContext {
+		FU540_PLIC *plic;
+		unsigned int hart;
+		PrivilegeLevel level;
+
+		bool read(const RegisterRange::ReadInfo &t) {
+			return plic->read_hartctx(t, hart, level);
+		}
+
+		void write(const RegisterRange::WriteInfo &t) {
+			plic->write_hartctx(t, hart, level);
+		}
+	};
+	std::vector<std::unique_ptr<HartContext>> contexts;
 
 	/* hart_id (0..4) → hart_config */
 	typedef std::map<unsigned int, HartConfig*> hartmap;
@@ -57,18 +75,28 @@ private:
 	/* See Section 10.4 */
 	RegisterRange regs_pending_interrupts{0x1000, sizeof(uint32_t) * 2};
 	ArrayView<uint32_t> pending_interrupts{regs_pending_interrupts};
-	
+
+	/* Pending interrupts bucketed by their priority, bucket 0 is unused
+	 * as priority 0 never interrupts. prio_summary has a bit set for each
+	 * non-empty bucket. Both are updated on pending and priority changes,
+	 * enables and thresholds are applied when looking up the next irq. */
+	uint32_t prio_pending[MAX_PRIO + 1][IRQ_WORDS] = {};
+	uint32_t prio_summary = 0;
+
 	void create_registers(void);
 	void create_hart_regs(uint64_t, uint64_t, hartmap&);
 	void transport(tlm::tlm_generic_payload&, sc_core::sc_time&);
-	bool read_hartctx(RegisterRange::ReadInfo, unsigned int, PrivilegeLevel);
-	void write_hartctx(RegisterRange::WriteInfo, unsigned int, PrivilegeLevel);
-	void write_irq_prios(RegisterRange::WriteInfo);
+	bool read_hartctx(const RegisterRange::ReadInfo &, unsigned int, PrivilegeLevel);
+	void write_hartctx(const RegisterRange::WriteInfo &, unsigned int, PrivilegeLevel);
+	bool ignore_write(const RegisterRange::WriteInfo &);
+	void write_irq_prios(const RegisterRange::WriteInfo &);
 	void run(void);
 	unsigned int next_pending_irq(unsigned int, PrivilegeLevel, bool);
 	bool has_pending_irq(unsigned int, PrivilegeLevel*);
 	uint32_t get_threshold(unsigned int, PrivilegeLevel);
 	void clear_pending(unsigned int);
+	void update_prio_bucket(unsigned int);
+	void remove_from_bucket(uint32_t, unsigned int);
 	bool is_pending(unsigned int);
 	bool is_claim_access(uint64_t addr);
 };
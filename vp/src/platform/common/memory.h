@@ -1,9 +1,13 @@
 #ifndef RISCV_ISA_MEMORY_H
 #define RISCV_ISA_MEMORY_H
 
+#include <errno.h>
 #include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <boost/iostreams/device/mapped_file.hpp>
 #include <iostream>
+#include <system_error>
 
 #include "bus.h"
 #include "load_if.h"
@@ -12,21 +16,54 @@
 #include <systemc>
 
 struct SimpleMemory : public sc_core::sc_module, public load_if {
+	//
+	// The memory is an anonymous private mapping, the host provides zero filled pages on first access. Hence pages the
+	// guest never touches cost neither startup time nor RSS, and the reservation does not count against the commit
+	// limit (MAP_NORESERVE). It is aligned to huge pages and marked for transparent huge page backing to reduce host
+	// TLB misses. *data* stays valid and fixed for the lifetime of the memory, it is handed out for DMI.
+	//
+	static constexpr uint64_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
 	tlm_utils::simple_target_socket<SimpleMemory> tsock;
 
 	uint8_t *data;
-	uint32_t size;
+	uint64_t size;
 	bool read_only;
 
-	SimpleMemory(sc_core::sc_module_name, uint32_t size, bool read_only = false)
-	    : data(new uint8_t[size]()), size(size), read_only(read_only) {
+	SimpleMemory(sc_core::sc_module_name, uint64_t size, bool read_only = false)
+	    : data(map_memory(size)), size(size), read_only(read_only) {
 		tsock.register_b_transport(this, &SimpleMemory::transport);
 		tsock.register_get_direct_mem_ptr(this, &SimpleMemory::get_direct_mem_ptr);
 		tsock.register_transport_dbg(this, &SimpleMemory::transport_dbg);
 	}
 
 	~SimpleMemory(void) {
-		delete[] data;
+		munmap(data, size);
+	}
+
+	static uint8_t *map_memory(uint64_t size) {
+		assert(size > 0);
+
+		// over-allocate by one huge page to align the start, the excess at both ends is unmapped again
+		uint64_t len = size + HUGE_PAGE_SIZE;
+		void *p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED)
+			throw std::system_error(errno, std::generic_category(),
+			                        "unable to map " + std::to_string(size) + " bytes of memory");
+
+		auto base = (uintptr_t)p;
+		auto start = (base + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+		auto page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+		auto end = (start + size + page_size - 1) & ~(page_size - 1);
+		if (start > base)
+			munmap(p, start - base);
+		if (base + len > end)
+			munmap((void *)end, base + len - end);
+
+#ifdef MADV_HUGEPAGE
+		madvise((void *)start, size, MADV_HUGEPAGE);  // only a hint, fails if transparent huge pages are disabled
+#endif
+		return (uint8_t *)start;
 	}
 
 	void load_data(const char *src, uint64_t dst_addr, size_t n) override {
@@ -39,19 +76,19 @@ struct SimpleMemory : public sc_core::sc_module, public load_if {
 		memset(&data[dst_addr], 0, n);
 	}
 
-	void load_binary_file(const std::string &filename, unsigned addr) {
+	void load_binary_file(const std::string &filename, uint64_t addr) {
 		boost::iostreams::mapped_file_source f(filename);
 		assert(f.is_open());
 		write_data(addr, (const uint8_t *)f.data(), f.size());
 	}
 
-	void write_data(unsigned addr, const uint8_t *src, unsigned num_bytes) {
+	void write_data(uint64_t addr, const uint8_t *src, uint64_t num_bytes) {
 		assert(addr + num_bytes <= size);
 
 		memcpy(data + addr, src, num_bytes);
 	}
 
-	void read_data(unsigned addr, uint8_t *dst, unsigned num_bytes) {
+	void read_data(uint64_t addr, uint8_t *dst, uint64_t num_bytes) {
 		assert(addr + num_bytes <= size);
 
 		memcpy(dst, data + addr, num_bytes);
@@ -64,7 +101,7 @@ struct SimpleMemory : public sc_core::sc_module, public load_if {
 
 	unsigned transport_dbg(tlm::tlm_generic_payload &trans) {
 		tlm::tlm_command cmd = trans.get_command();
-		unsigned addr = trans.get_address();
+		uint64_t addr = trans.get_address();
 		auto *ptr = trans.get_data_ptr();
 		auto len = trans.get_data_length();
 
@@ -84,7 +121,7 @@ struct SimpleMemory : public sc_core::sc_module, public load_if {
 	bool get_direct_mem_ptr(tlm::tlm_generic_payload &trans, tlm::tlm_dmi &dmi) {
 		(void)trans;
 		dmi.set_start_address(0);
-		dmi.set_end_address(size);
+		dmi.set_end_address(size - 1);
 		dmi.set_dmi_ptr(data);
 		if (read_only)
 			dmi.allow_read();
@@ -21,7 +21,8 @@ Options::Options(void) {
 		("use-dmi", po::bool_switch(), "use instr and data dmi")
 		("input-file", po::value<std::string>(&input_program)->required(), "input file to use for execution")
 		("spmp", po::bool_switch(&use_spmp), "use SPMP for memory protection")
-		("smpu", po::bool_switch(&use_smpu), "use SMPU for memory protection");
+		("smpu", po::bool_switch(&use_smpu), "use SMPU for memory protection")
+		("no-page-walk-cache", po::bool_switch(&no_page_walk_cache), "do not cache non-leaf page table entries in the MMU (e.g. to compare the number of PTE loads)");
 	// clang-format on
 
 	pos.add("input-file", 1);
@@ -29,6 +30,14 @@ Options::Options(void) {
 
 Options::~Options(){}
 
+void Options::add_exec_engine_options(void) {
+	// clang-format off
+	add_options()
+		("exec-engine", po::value<std::string>(&exec_engine), "select the ISS execution engine: step (default), blocks (basic block engine) or jit (basic block engine with translation of hot blocks to x86-64 host code)")
+		("jit-check", po::bool_switch(&jit_check), "execute all translated code also in the interpreter and abort on any difference");
+	// clang-format on
+}
+
 void Options::parse(int argc, char **argv) {
 	try {
 		auto parser = po::command_line_parser(argc, argv);
@@ -46,6 +55,13 @@ void Options::parse(int argc, char **argv) {
 			use_data_dmi = true;
 			use_instr_dmi = true;
 		}
+		if (exec_engine != "step" && exec_engine != "blocks" && exec_engine != "jit")
+			throw po::validation_error(po::validation_error::invalid_option_value, "exec-engine", exec_engine);
+#if !defined(__x86_64__)
+		// the block translator only emits x86-64 code
+		if (exec_engine == "jit")
+			throw po::validation_error(po::validation_error::invalid_option_value, "exec-engine", exec_engine);
+#endif
 		if (vm["intercept-syscalls"].as<bool>() && vm.count("error-on-zero-traphandler") == 0) {
 			// intercept syscalls active, but no overriding error-on-zero-traphandler switch
 			std::cerr << "[Options] Info: switch 'intercept-syscalls' also activates 'error-on-zero-traphandler' if unset." << std::endl;
@@ -74,4 +90,7 @@ void Options::printValues(std::ostream& os) const {
 	os << "use_data_dmi: " << use_data_dmi << std::endl;
 	os << "use spmp: " << use_spmp << std::endl;
 	os << "use smpu: " << use_smpu << std::endl;
+	os << "exec engine: " << exec_engine << std::endl;
+	os << "jit check: " << jit_check << std::endl;
+	os << "no page walk cache: " << no_page_walk_cache << std::endl;
 }
@@ -22,9 +22,16 @@ public:
 	bool use_data_dmi = false;
 	bool use_spmp = false;
 	bool use_smpu = false;
+	std::string exec_engine = "step";
+	bool jit_check = false;
+	bool no_page_walk_cache = false;
 
 	virtual void printValues(std::ostream& os = std::cout) const;
 
+protected:
+	// only for platforms whose ISS has the basic block engine
+	void add_exec_engine_options(void);
+
 private:
 
 	boost::program_options::positional_options_description pos;
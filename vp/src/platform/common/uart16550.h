@@ -38,8 +38,8 @@ struct UART16550 : public sc_core::sc_module {
 		raw.c_lflag &= ~(ICANON);  // Bytewise read
 		tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
 
-		mm_regs.pre_read_callback = std::bind(&UART16550::pre_read_regs, this, std::placeholders::_1);
-		mm_regs.post_write_callback = std::bind(&UART16550::post_write_regs, this, std::placeholders::_1);
+		mm_regs.pre_read_callback = vp::mm::bind<&UART16550::pre_read_regs>(this);
+		mm_regs.post_write_callback = vp::mm::bind<&UART16550::post_write_regs>(this);
 	}
 
 	~UART16550() {
@@ -65,7 +65,7 @@ struct UART16550 : public sc_core::sc_module {
 		return ans;
 	}
 
-	bool pre_read_regs(RegisterRange::ReadInfo t) {
+	bool pre_read_regs(const RegisterRange::ReadInfo &t) {
 		if (t.addr == LINESTAT_ADDR) {
 			regs[LINESTAT_ADDR] = 0;
 			regs[LINESTAT_ADDR] |= STATUS_TX;
@@ -79,7 +79,7 @@ struct UART16550 : public sc_core::sc_module {
 		return true;
 	}
 
-	void post_write_regs(RegisterRange::WriteInfo t) {
+	void post_write_regs(const RegisterRange::WriteInfo &t) {
 		if (t.addr == QUEUE_ADDR) {
 			uint8_t data = *t.trans.get_data_ptr();
 			if (!initialized) {
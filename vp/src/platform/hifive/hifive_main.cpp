@@ -47,6 +47,8 @@
 using namespace rv32;
 namespace po = boost::program_options;
 
+typedef PlatformIsaConfig<Rv32DefaultConfig> IsaConfig;
+
 class HifiveOptions : public Options {
 public:
 	typedef unsigned int addr_t;
@@ -120,11 +122,12 @@ int sc_main(int argc, char **argv) {
 	tlm::tlm_global_quantum::instance().set(sc_core::sc_time(opt.tlm_global_quantum, sc_core::SC_NS));
 
 	ISS core(0);
+	core.specialize<IsaConfig>();
 	SimpleMemory dram("DRAM", opt.dram_size);
 	SimpleMemory flash("Flash", opt.flash_size);
 	ELFLoader loader(opt.input_program.c_str());
 	SimpleBus<2, 14> bus("SimpleBus");
-	CombinedMemoryInterface iss_mem_if("MemoryInterface", core);
+	CombinedMemoryInterfaceT<IsaConfig> iss_mem_if("MemoryInterface", core);
 	SyscallHandler sys("SyscallHandler");
 
 	FE310_PLIC<1, 53, 64, 7> plic("PLIC");
@@ -179,9 +182,7 @@ int sc_main(int argc, char **argv) {
 	MaskROM maskROM("MASKROM");
 	DebugMemoryInterface dbg_if("DebugMemoryInterface");
 
-	MemoryDMI dram_dmi = MemoryDMI::create_start_size_mapping(dram.data, opt.dram_start_addr, dram.size);
-	MemoryDMI flash_dmi = MemoryDMI::create_start_size_mapping(flash.data, opt.flash_start_addr, flash.size);
-	InstrMemoryProxy instr_mem(flash_dmi, core);
+	InstrMemoryProxy instr_mem(iss_mem_if, core);
 
 	std::shared_ptr<BusLock> bus_lock = std::make_shared<BusLock>();
 	iss_mem_if.bus_lock = bus_lock;
@@ -191,7 +192,7 @@ int sc_main(int argc, char **argv) {
 	if (opt.use_instr_dmi)
 		instr_mem_if = &instr_mem;
 	if (opt.use_data_dmi)
-		iss_mem_if.dmi_ranges.emplace_back(dram_dmi);
+		iss_mem_if.lazy_dmi = true;
 
 	bus.ports[ 0] = new PortMapping(opt.flash_start_addr,  opt.flash_end_addr);
 	bus.ports[ 1] = new PortMapping(opt.dram_start_addr,   opt.dram_end_addr);
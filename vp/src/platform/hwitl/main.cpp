@@ -29,6 +29,8 @@
 using namespace rv32;
 namespace po = boost::program_options;
 
+typedef PlatformIsaConfig<Rv32DefaultConfig> IsaConfig;
+
 class HwitlOptions : public Options {
 public:
 	typedef unsigned int addr_t;
@@ -91,11 +93,12 @@ int sc_main(int argc, char **argv) {
 	tlm::tlm_global_quantum::instance().set(sc_core::sc_time(opt.tlm_global_quantum, sc_core::SC_NS));
 
 	ISS core(0);
+	core.specialize<IsaConfig>();
 	SimpleMemory mem("SimpleMemory", opt.mem_size);
 	SimpleTerminal term("SimpleTerminal");
 	ELFLoader loader(opt.input_program.c_str());
 	SimpleBus<2, 6> bus("SimpleBus");
-	CombinedMemoryInterface iss_mem_if("MemoryInterface", core);
+	CombinedMemoryInterfaceT<IsaConfig> iss_mem_if("MemoryInterface", core);
 	SyscallHandler sys("SyscallHandler");
 	FE310_PLIC<1, 64, 96, 32> plic("PLIC");
 	DebugMemoryInterface dbg_if("DebugMemoryInterface");
@@ -131,8 +134,7 @@ int sc_main(int argc, char **argv) {
 	VirtualBusMember virtual_bus_member("virtual_bus_member", virtual_bus_connector, opt.virtual_bus_start_addr);
 	virtual_bus_member.setInterruptRoutine([&plic](){plic.gateway_trigger_interrupt(2);});
 
-	MemoryDMI dmi = MemoryDMI::create_start_size_mapping(mem.data, opt.mem_start_addr, mem.size);
-	InstrMemoryProxy instr_mem(dmi, core);
+	InstrMemoryProxy instr_mem(iss_mem_if, core);
 
 	std::shared_ptr<BusLock> bus_lock = std::make_shared<BusLock>();
 	iss_mem_if.bus_lock = bus_lock;
@@ -142,7 +144,7 @@ int sc_main(int argc, char **argv) {
 	if (opt.use_instr_dmi)
 		instr_mem_if = &instr_mem;
 	if (opt.use_data_dmi) {
-		iss_mem_if.dmi_ranges.emplace_back(dmi);
+		iss_mem_if.lazy_dmi = true;
 	}
 
 	uint64_t entry_point = loader.get_entrypoint();
@@ -37,7 +37,7 @@ namespace po = boost::program_options;
 
 struct LinuxOptions : public Options {
 public:
-	typedef unsigned int addr_t;
+	typedef uint64_t addr_t;
 
 	addr_t mem_size = 1024u * 1024u * 2048u;  // 2048 MB ram
 	addr_t mem_start_addr = 0x80000000;
@@ -65,8 +65,8 @@ public:
 	LinuxOptions(void) {
         	// clang-format off
 		add_options()
-			("memory-start", po::value<unsigned int>(&mem_start_addr),"set memory start address")
-			("memory-size", po::value<unsigned int>(&mem_size), "set memory size")
+			("memory-start", po::value<addr_t>(&mem_start_addr),"set memory start address")
+			("memory-size", po::value<addr_t>(&mem_size), "set memory size")
 			("entry-point", po::value<std::string>(&entry_point.option),"set entry point address (ISS program counter)")
 			("dtb-file", po::value<std::string>(&dtb_file)->required(), "dtb file for boot loading")
 			("tun-device", po::value<std::string>(&tun_device), "tun device used by SLIP");
@@ -138,6 +138,7 @@ int sc_main(int argc, char **argv) {
 	for (size_t i = 0; i < NUM_CORES; i++) {
 		cores[i]->memif.bus_lock = bus_lock;
 		cores[i]->mmu.mem = &cores[i]->memif;
+		cores[i]->mmu.use_pwc = !opt.no_page_walk_cache;
 	}
 
 	uint64_t entry_point = loader.get_entrypoint();
@@ -231,6 +232,7 @@ int sc_main(int argc, char **argv) {
 	sc_core::sc_start();
 	for (size_t i = 0; i < NUM_CORES; i++) {
 		cores[i]->iss.show();
+		cores[i]->mmu.show();
 	}
 
 	return 0;
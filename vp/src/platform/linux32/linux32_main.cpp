@@ -35,6 +35,8 @@ enum {
 using namespace rv32;
 namespace po = boost::program_options;
 
+typedef PlatformIsaConfig<Rv32LinuxConfig> IsaConfig;
+
 struct LinuxOptions : public Options {
 public:
 	typedef unsigned int addr_t;
@@ -71,6 +73,7 @@ public:
 			("dtb-file", po::value<std::string>(&dtb_file)->required(), "dtb file for boot loading")
 			("tun-device", po::value<std::string>(&tun_device), "tun device used by SLIP");
         	// clang-format on
+		add_exec_engine_options();
 	}
 
 	void parse(int argc, char **argv) override {
@@ -84,17 +87,17 @@ class Core {
    public:
 	ISS iss;
 	MMU mmu;
-	CombinedMemoryInterface memif;
+	CombinedMemoryInterfaceT<IsaConfig> memif;
 	InstrMemoryProxy imemif;
 
-	Core(unsigned int id, MemoryDMI dmi)
-	    : iss(id), mmu(iss), memif(("MemoryInterface" + std::to_string(id)).c_str(), iss, &mmu), imemif(dmi, iss) {
-		return;
+	Core(unsigned int id)
+	    : iss(id), mmu(iss), memif(("MemoryInterface" + std::to_string(id)).c_str(), iss, &mmu), imemif(memif, iss) {
+		iss.specialize<IsaConfig>();
 	}
 
 	void init(bool use_data_dmi, bool use_instr_dmi, clint_if *clint, uint64_t entry, uint64_t addr) {
 		if (use_data_dmi)
-			memif.dmi_ranges.emplace_back(imemif.dmi);
+			memif.lazy_dmi = true;
 
 		iss.init(get_instr_memory_if(use_instr_dmi), &memif, clint, entry, addr);
 	}
@@ -127,17 +130,17 @@ int sc_main(int argc, char **argv) {
 	UART uart0("UART0", 3);
 	SLIP slip("SLIP", 4, opt.tun_device);
 	DebugMemoryInterface dbg_if("DebugMemoryInterface");
-	MemoryDMI dmi = MemoryDMI::create_start_size_mapping(mem.data, opt.mem_start_addr, mem.size);
 
 	Core *cores[NUM_CORES];
 	for (unsigned i = 0; i < NUM_CORES; i++) {
-		cores[i] = new Core(i, dmi);
+		cores[i] = new Core(i);
 	}
 
 	std::shared_ptr<BusLock> bus_lock = std::make_shared<BusLock>();
 	for (size_t i = 0; i < NUM_CORES; i++) {
 		cores[i]->memif.bus_lock = bus_lock;
 		cores[i]->mmu.mem = &cores[i]->memif;
+		cores[i]->mmu.use_pwc = !opt.no_page_walk_cache;
 	}
 
 	uint64_t entry_point = loader.get_entrypoint();
@@ -189,6 +192,9 @@ int sc_main(int argc, char **argv) {
 	for (size_t i = 0; i < NUM_CORES; i++) {
 		// switch for printing instructions
 		cores[i]->iss.trace = opt.trace_mode;
+		cores[i]->iss.use_block_engine = (opt.exec_engine != "step");
+		cores[i]->iss.jit.enabled = (opt.exec_engine == "jit");
+		cores[i]->iss.jit.check = opt.jit_check;
 
 		// ignore WFI instructions (handle them as a NOP, which is ok according to the RISC-V ISA) to avoid running too
 		// fast ahead with simulation time when the CPU is idle
@@ -235,6 +241,7 @@ int sc_main(int argc, char **argv) {
 	sc_core::sc_start();
 	for (size_t i = 0; i < NUM_CORES; i++) {
 		cores[i]->iss.show();
+		cores[i]->mmu.show();
 	}
 
 	return 0;
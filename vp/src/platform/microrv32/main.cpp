@@ -25,6 +25,8 @@
 using namespace rv32;
 namespace po = boost::program_options;
 
+typedef PlatformIsaConfig<Rv32DefaultConfig> IsaConfig;
+
 class BasicOptions : public Options {
 public:
 	typedef unsigned int addr_t;
@@ -72,10 +74,11 @@ int sc_main(int argc, char **argv) {
 	tlm::tlm_global_quantum::instance().set(sc_core::sc_time(opt.tlm_global_quantum, sc_core::SC_NS));
 
 	ISS core(0, opt.use_E_base_isa);
+	core.specialize<IsaConfig>();
 	SimpleMemory mem("SimpleMemory", opt.mem_size);
 	ELFLoader loader(opt.input_program.c_str());
 	SimpleBus<2, 6> bus("SimpleBus");
-	CombinedMemoryInterface iss_mem_if("MemoryInterface", core);
+	CombinedMemoryInterfaceT<IsaConfig> iss_mem_if("MemoryInterface", core);
 	SyscallHandler sys("SyscallHandler");
 	CLINT<1> clint("CLINT");
 	DebugMemoryInterface dbg_if("DebugMemoryInterface");
@@ -83,8 +86,7 @@ int sc_main(int argc, char **argv) {
 	MicroRV32LED led("MicroRV32LED");
 	MicroRV32GPIO gpio_a("MicroRV32GPIO");
 
-	MemoryDMI dmi = MemoryDMI::create_start_size_mapping(mem.data, opt.mem_start_addr, mem.size);
-	InstrMemoryProxy instr_mem(dmi, core);
+	InstrMemoryProxy instr_mem(iss_mem_if, core);
 
 	std::shared_ptr<BusLock> bus_lock = std::make_shared<BusLock>();
 	iss_mem_if.bus_lock = bus_lock;
@@ -94,7 +96,7 @@ int sc_main(int argc, char **argv) {
 	if (opt.use_instr_dmi)
 		instr_mem_if = &instr_mem;
 	if (opt.use_data_dmi) {
-		iss_mem_if.dmi_ranges.emplace_back(dmi);
+		iss_mem_if.lazy_dmi = true;
 	}
 
 	uint64_t entry_point = loader.get_entrypoint();
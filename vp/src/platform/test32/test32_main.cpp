@@ -24,6 +24,9 @@
 using namespace rv32;
 namespace po = boost::program_options;
 
+// the ISA is selected at run time (--isa option)
+typedef DynamicIsaConfig IsaConfig;
+
 class TestOptions : public Options {
 public:
     typedef unsigned int addr_t;
@@ -100,8 +103,9 @@ int sc_main(int argc, char **argv) {
     tlm::tlm_global_quantum::instance().set(sc_core::sc_time(opt.tlm_global_quantum, sc_core::SC_NS));
 
     ISS core(0, opt.use_E_base_isa);
+    core.specialize<IsaConfig>();
     MMU mmu(core);
-    CombinedMemoryInterface core_mem_if("MemoryInterface0", core, &mmu);
+    CombinedMemoryInterfaceT<IsaConfig> core_mem_if("MemoryInterface0", core, &mmu);
     SimpleMemory mem("SimpleMemory", opt.mem_size);
     ELFLoader loader(opt.input_program.c_str());
     SimpleBus<2, 3> bus("SimpleBus");
@@ -109,8 +113,7 @@ int sc_main(int argc, char **argv) {
     CLINT<1> clint("CLINT");
     DebugMemoryInterface dbg_if("DebugMemoryInterface");
 
-    MemoryDMI dmi = MemoryDMI::create_start_size_mapping(mem.data, opt.mem_start_addr, mem.size);
-    InstrMemoryProxy instr_mem(dmi, core);
+    InstrMemoryProxy instr_mem(core_mem_if, core);
 
     std::shared_ptr<BusLock> bus_lock = std::make_shared<BusLock>();
     core_mem_if.bus_lock = bus_lock;
@@ -120,7 +123,7 @@ int sc_main(int argc, char **argv) {
     if (opt.use_instr_dmi)
         instr_mem_if = &instr_mem;
     if (opt.use_data_dmi) {
-        core_mem_if.dmi_ranges.emplace_back(dmi);
+        core_mem_if.lazy_dmi = true;
     }
 
     loader.load_executable_image(mem, mem.size, opt.mem_start_addr);
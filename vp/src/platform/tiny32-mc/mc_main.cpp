@@ -20,6 +20,8 @@
 using namespace rv32;
 namespace po = boost::program_options;
 
+typedef PlatformIsaConfig<Rv32DefaultConfig> IsaConfig;
+
 struct TinyOptions : public Options {
 public:
 	typedef unsigned int addr_t;
@@ -62,8 +64,10 @@ int sc_main(int argc, char **argv) {
 
 	ISS core0(0);
 	ISS core1(1);
-	CombinedMemoryInterface core0_mem_if("MemoryInterface0", core0);
-	CombinedMemoryInterface core1_mem_if("MemoryInterface1", core1);
+	core0.specialize<IsaConfig>();
+	core1.specialize<IsaConfig>();
+	CombinedMemoryInterfaceT<IsaConfig> core0_mem_if("MemoryInterface0", core0);
+	CombinedMemoryInterfaceT<IsaConfig> core1_mem_if("MemoryInterface1", core1);
 
 	SimpleMemory mem("SimpleMemory", opt.mem_size);
 	ELFLoader loader(opt.input_program.c_str());
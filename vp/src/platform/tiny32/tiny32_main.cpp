@@ -21,6 +21,8 @@
 using namespace rv32;
 namespace po = boost::program_options;
 
+typedef PlatformIsaConfig<Rv32DefaultMmuConfig> IsaConfig;
+
 struct TinyOptions : public Options {
 public:
 	typedef unsigned int addr_t;
@@ -62,8 +64,9 @@ int sc_main(int argc, char **argv) {
 	tlm::tlm_global_quantum::instance().set(sc_core::sc_time(opt.tlm_global_quantum, sc_core::SC_NS));
 
 	ISS core(0, opt.use_E_base_isa);
+	core.specialize<IsaConfig>();
     MMU mmu(core);
-	CombinedMemoryInterface core_mem_if("MemoryInterface0", core, &mmu);
+	CombinedMemoryInterfaceT<IsaConfig> core_mem_if("MemoryInterface0", core, &mmu);
 	SimpleMemory mem("SimpleMemory", opt.mem_size);
 	ELFLoader loader(opt.input_program.c_str());
 	SimpleBus<2, 3> bus("SimpleBus");
@@ -73,8 +76,7 @@ int sc_main(int argc, char **argv) {
 	std::vector<clint_interrupt_target*> clint_targets {&core};
 	RealCLINT clint("CLINT", clint_targets);
 
-	MemoryDMI dmi = MemoryDMI::create_start_size_mapping(mem.data, opt.mem_start_addr, mem.size);
-	InstrMemoryProxy instr_mem(dmi, core);
+	InstrMemoryProxy instr_mem(core_mem_if, core);
 
 	std::shared_ptr<BusLock> bus_lock = std::make_shared<BusLock>();
 	core_mem_if.bus_lock = bus_lock;
@@ -84,7 +86,7 @@ int sc_main(int argc, char **argv) {
 	if (opt.use_instr_dmi)
 		instr_mem_if = &instr_mem;
 	if (opt.use_data_dmi) {
-		core_mem_if.dmi_ranges.emplace_back(dmi);
+		core_mem_if.lazy_dmi = true;
 	}
 
 	loader.load_executable_image(mem, mem.size, opt.mem_start_addr);
@@ -110,6 +112,7 @@ int sc_main(int argc, char **argv) {
 
 	// switch for printing instructions
 	core.trace = opt.trace_mode;
+	mmu.use_pwc = !opt.no_page_walk_cache;
 
 	std::vector<debug_target_if *> threads;
 	threads.push_back(&core);
@@ -127,6 +130,7 @@ int sc_main(int argc, char **argv) {
 	sc_core::sc_start();
 	if (!opt.quiet) {
 		core.show();
+		mmu.show();
 	}
 
 	return 0;
@@ -111,6 +111,7 @@ int sc_main(int argc, char **argv) {
 
 	// switch for printing instructions
 	core.trace = opt.trace_mode;
+	mmu.use_pwc = !opt.no_page_walk_cache;
 
 	std::vector<debug_target_if *> threads;
 	threads.push_back(&core);
@@ -128,6 +129,7 @@ int sc_main(int argc, char **argv) {
 	sc_core::sc_start();
 	if (!opt.quiet) {
 		core.show();
+		mmu.show();
 	}
 
 	return 0;
@@ -0,0 +1,157 @@
+/* Checks the table driven instruction decoder exhaustively against the switch based reference decoder and compares
+ * the decode throughput of both. With --sampled, 32 bit instructions are only checked for all combinations of the
+ * fields that select the instruction (quick enough for ctest). */
+#include <instr.h>
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const char *arch_name(Architecture arch) {
+	return arch == RV32 ? "RV32" : "RV64";
+}
+
+static bool check_normal_word(Architecture arch, uint32_t x, uint64_t &mismatches) {
+	Instruction a(x);
+	Instruction b(x);
+	auto op_a = a.decode_normal_reference(arch);
+	auto op_b = b.decode_normal(arch);
+	if (op_a != op_b || a.data() != b.data()) {
+		if (++mismatches <= 10)
+			cout << arch_name(arch) << ": mismatch for " << hex << x << dec << ": " << Opcode::mappingStr[op_a]
+			     << " != " << Opcode::mappingStr[op_b] << endl;
+		return false;
+	}
+	return true;
+}
+
+static bool check_normal(Architecture arch, bool sampled) {
+	uint64_t mismatches = 0;
+
+	if (sampled) {
+		// all opcode, funct3, rs2 and funct7 values (bits 2-6, 12-14 and 20-31), combined with some rd and rs1
+		// values (bits 7-11 and 15-19)
+		mt19937 rng(1);
+		for (uint32_t n = 0; n < (1 << 20); ++n) {
+			uint32_t fields = ((n & 0x1f) << 2) | (((n >> 5) & 0x7) << 12) | ((n >> 8) << 20) | 0b11;
+			for (uint32_t regs : {0u, 0x3ffu, 0x021u, uint32_t(rng()) & 0x3ff}) {
+				uint32_t x = fields | ((regs & 0x1f) << 7) | ((regs >> 5) << 15);
+				check_normal_word(arch, x, mismatches);
+			}
+		}
+	} else {
+		// all 32 bit encodings, i.e. the lowest two bits set
+		for (uint64_t n = 0; n < (uint64_t(1) << 30); ++n)
+			check_normal_word(arch, (uint32_t(n) << 2) | 0b11, mismatches);
+	}
+
+	cout << arch_name(arch) << ": 32 bit instructions " << (mismatches ? "FAILED" : "OK") << endl;
+	return mismatches == 0;
+}
+
+static bool check_compressed(Architecture arch) {
+	uint64_t mismatches = 0;
+
+	// the upper half (e.g. the next instruction) must not affect the decoding
+	for (uint32_t upper : {0x0000u, 0xffffu, 0x5a5au, 0xa5a5u}) {
+		for (uint32_t n = 0; n < (1 << 16); ++n) {
+			uint32_t x = (upper << 16) | n;
+			Instruction a(x);
+			Instruction b(x);
+			if (!a.is_compressed())
+				continue;
+			auto op_a = a.decode_and_expand_compressed_reference(arch);
+			auto op_b = b.decode_and_expand_compressed(arch);
+			if (op_a != op_b || a.data() != b.data()) {
+				if (++mismatches <= 10)
+					cout << arch_name(arch) << ": mismatch for " << hex << x << ": " << Opcode::mappingStr[op_a]
+					     << " " << a.data() << " != " << Opcode::mappingStr[op_b] << " " << b.data() << dec << endl;
+			}
+		}
+	}
+
+	cout << arch_name(arch) << ": compressed instructions " << (mismatches ? "FAILED" : "OK") << endl;
+	return mismatches == 0;
+}
+
+template <typename F>
+static double measure(const vector<uint32_t> &words, unsigned rounds, F decode) {
+	uint64_t sum = 0;
+	auto start = chrono::steady_clock::now();
+	for (unsigned r = 0; r < rounds; ++r) {
+		for (uint32_t x : words) {
+			Instruction instr(x);
+			sum += decode(instr);
+		}
+	}
+	auto end = chrono::steady_clock::now();
+	// keep the decoding alive
+	if (sum == 1)
+		cout << "";
+	return chrono::duration<double, nano>(end - start).count() / (double(words.size()) * rounds);
+}
+
+static void bench(Architecture arch) {
+	constexpr unsigned NUM_WORDS = 1 << 20;
+	constexpr unsigned ROUNDS = 20;
+
+	// random valid instructions, every fourth one compressed
+	mt19937 rng(42);
+	vector<uint32_t> words;
+	while (words.size() < NUM_WORDS) {
+		uint32_t x = rng();
+		if (words.size() % 4 == 0)
+			x &= ~uint32_t(0b11) | (rng() % 3);
+		else
+			x |= 0b11;
+		Instruction instr(x);
+		auto op = instr.is_compressed() ? instr.decode_and_expand_compressed_reference(arch)
+		                                : instr.decode_normal_reference(arch);
+		if (op != Opcode::UNDEF)
+			words.push_back(x);
+	}
+
+	double ref = measure(words, ROUNDS, [arch](Instruction &instr) {
+		return instr.is_compressed() ? instr.decode_and_expand_compressed_reference(arch)
+		                             : instr.decode_normal_reference(arch);
+	});
+	double table = measure(words, ROUNDS, [arch](Instruction &instr) {
+		return instr.is_compressed() ? instr.decode_and_expand_compressed(arch) : instr.decode_normal(arch);
+	});
+	cout << arch_name(arch) << ": reference " << ref << " ns/instr, table " << table << " ns/instr" << endl;
+}
+
+int main(int argc, const char *argv[]) {
+	bool check = true;
+	bool benchmark = true;
+	bool sampled = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (argv[i] == string{"--no-check"})
+			check = false;
+		else if (argv[i] == string{"--no-bench"})
+			benchmark = false;
+		else if (argv[i] == string{"--sampled"})
+			sampled = true;
+		else {
+			cout << argv[0] << " [--no-check] [--no-bench] [--sampled]" << endl;
+			return 0;
+		}
+	}
+
+	bool ok = true;
+	for (Architecture arch : {RV32, RV64}) {
+		if (check) {
+			ok &= check_compressed(arch);
+			ok &= check_normal(arch, sampled);
+		}
+		if (benchmark)
+			bench(arch);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -1,9 +1,66 @@
 #pragma once
 
-#include <functional>
+#include <algorithm>
+#include <initializer_list>
+#include <string>
 #include <vector>
 #include "common.h"
 
+namespace vp {
+namespace mm {
+
+template <typename Signature>
+class Delegate;
+
+/* Callback bound to a member function without allocating: the member function is a template argument, only the
+ * object is stored. Create with *vp::mm::bind*. */
+template <typename R, typename... Args>
+class Delegate<R(Args...)> {
+	void *obj = nullptr;
+	R (*fn)(void *, Args...) = nullptr;
+
+	template <auto Method, typename T>
+	static R invoke(void *obj, Args... args) {
+		return (static_cast<T *>(obj)->*Method)(args...);
+	}
+
+   public:
+	template <auto Method, typename T>
+	static Delegate bind(T *obj) {
+		Delegate d;
+		d.obj = obj;
+		d.fn = &invoke<Method, T>;
+		return d;
+	}
+
+	explicit operator bool() const {
+		return fn != nullptr;
+	}
+
+	R operator()(Args... args) const {
+		return fn(obj, args...);
+	}
+};
+
+template <auto Method, typename T>
+struct BoundMember {
+	T *obj;
+
+	template <typename R, typename... Args>
+	operator Delegate<R(Args...)>() const {
+		return Delegate<R(Args...)>::template bind<Method>(obj);
+	}
+};
+
+/* Usage: range.post_write_callback = vp::mm::bind<&Module::post_write_regs>(this); */
+template <auto Method, typename T>
+BoundMember<Method, T> bind(T *obj) {
+	return {obj};
+}
+
+}  // namespace mm
+}  // namespace vp
+
 struct RegisterRange {
 	struct WriteInfo {
 		uint64_t addr;
@@ -21,10 +78,10 @@ struct RegisterRange {
 		sc_core::sc_time &delay;
 	};
 
-	typedef std::function<bool(WriteInfo)> PreWriteCallback;
-	typedef std::function<void(WriteInfo)> PostWriteCallback;
-	typedef std::function<bool(ReadInfo)> PreReadCallback;
-	typedef std::function<void(ReadInfo)> PostReadCallback;
+	typedef vp::mm::Delegate<bool(const WriteInfo &)> PreWriteCallback;
+	typedef vp::mm::Delegate<void(const WriteInfo &)> PostWriteCallback;
+	typedef vp::mm::Delegate<bool(const ReadInfo &)> PreReadCallback;
+	typedef vp::mm::Delegate<void(const ReadInfo &)> PostReadCallback;
 
 	uint64_t start;
 	uint64_t end;
@@ -79,14 +136,15 @@ struct RegisterRange {
 		auto local_addr = to_local(addr);
 		assert(local_addr + len <= mem.size());
 
+		WriteInfo info{local_addr, mem.data() + local_addr, len, trans, delay};
 		if (pre_write_callback)
-			if (!pre_write_callback({local_addr, mem.data() + local_addr, len, trans, delay}))
+			if (!pre_write_callback(info))
 				return;
 
 		memcpy(mem.data() + local_addr, src, len);
 
 		if (post_write_callback)
-			post_write_callback({local_addr, mem.data() + local_addr, len, trans, delay});
+			post_write_callback(info);
 	}
 
 	void read(uint64_t addr, uint8_t *dst, size_t len, tlm::tlm_generic_payload &trans, sc_core::sc_time &delay) {
@@ -95,14 +153,15 @@ struct RegisterRange {
 		auto local_addr = to_local(addr);
 		assert(local_addr + len <= mem.size());
 
+		ReadInfo info{local_addr, mem.data() + local_addr, len, trans, delay};
 		if (pre_read_callback)
-			if (!pre_read_callback({local_addr, mem.data() + local_addr, len, trans, delay}))
+			if (!pre_read_callback(info))
 				return;
 
 		memcpy(dst, mem.data() + local_addr, len);
 
 		if (post_read_callback)
-			post_read_callback({local_addr, mem.data() + local_addr, len, trans, delay});
+			post_read_callback(info);
 	}
 
 	bool match(tlm::tlm_generic_payload &trans) {
@@ -219,5 +278,116 @@ void route(const char *name, Iter &iterable_mm, tlm::tlm_generic_payload &trans,
 	throw std::runtime_error(std::string(name) + " unable to route address " + std::to_string(trans.get_address()));
 }
 
+/*
+ * Register layout of a peripheral, compiled once by *build* (after all ranges are added, usually at the end of the
+ * constructor) into a table with the range of every offset, replacing the linear search of *route*. The table has
+ * one entry per page. Only pages shared by several ranges are split into granules (of the finest alignment of all
+ * range boundaries) with an entry each. An array is a single range and its element is derived from the offset, so
+ * large arrays (e.g. the APLIC target registers) do not add any entries of their own.
+ */
+class RegisterMap {
+	static constexpr unsigned PAGE_SHIFT = 12;
+	static constexpr uint64_t PAGE_MASK = (uint64_t(1) << PAGE_SHIFT) - 1;
+	static constexpr uint16_t UNMAPPED = 0xffff;
+	static constexpr uint16_t SPLIT = 0x8000;  // index of the granule table of a page shared by several ranges
+
+	const char *name;
+	std::vector<RegisterRange *> ranges;
+	std::vector<uint16_t> pages;
+	std::vector<uint16_t> granules;
+	unsigned granule_shift = PAGE_SHIFT;
+
+   public:
+	RegisterMap(const char *name) : name(name) {}
+
+	void add(RegisterRange &r) {
+		assert(pages.empty() && "ranges must be added before the map is built");
+		ranges.push_back(&r);
+	}
+
+	void add(std::initializer_list<RegisterRange *> list) {
+		for (auto r : list)
+			add(*r);
+	}
+
+	const std::vector<RegisterRange *> &get_ranges() const {
+		return ranges;
+	}
+
+	void build() {
+		assert(ranges.size() < SPLIT);
+
+		uint64_t end = 0;
+		for (auto r : ranges) {
+			end = std::max(end, r->end);
+			granule_shift = std::min<unsigned>(granule_shift, __builtin_ctzll(r->start | (r->end + 1) | (1 << PAGE_SHIFT)));
+		}
+
+		pages.assign((end >> PAGE_SHIFT) + 1, UNMAPPED);
+		granules.clear();
+		const uint64_t granules_per_page = uint64_t(1) << (PAGE_SHIFT - granule_shift);
+
+		for (uint16_t id = 0; id < ranges.size(); ++id) {
+			auto r = ranges[id];
+			for (uint64_t page = r->start >> PAGE_SHIFT; page <= (r->end >> PAGE_SHIFT); ++page) {
+				uint16_t &e = pages[page];
+				if (e == UNMAPPED) {
+					e = id;
+					continue;
+				}
+
+				if (!(e & SPLIT)) {
+					// the page is shared now, move its first range into a new granule table
+					uint16_t first = e;
+					e = SPLIT | (granules.size() / granules_per_page);
+					granules.resize(granules.size() + granules_per_page, UNMAPPED);
+					fill_granules(page, e & ~SPLIT, first);
+				}
+				fill_granules(page, e & ~SPLIT, id);
+			}
+		}
+	}
+
+	/* The range containing *addr*, nullptr if there is none. */
+	RegisterRange *find(uint64_t addr) {
+		assert(!ranges.empty() && !pages.empty() && "register map not built");
+
+		uint64_t page = addr >> PAGE_SHIFT;
+		if (page >= pages.size())
+			return nullptr;
+
+		uint16_t e = pages[page];
+		if (e != UNMAPPED && (e & SPLIT))
+			e = granules[(uint64_t(e & ~SPLIT) << (PAGE_SHIFT - granule_shift)) + ((addr & PAGE_MASK) >> granule_shift)];
+		if (e == UNMAPPED)
+			return nullptr;
+
+		auto r = ranges[e];
+		return r->contains(addr) ? r : nullptr;
+	}
+
+	void route(tlm::tlm_generic_payload &trans, sc_core::sc_time &delay) {
+		auto r = find(trans.get_address());
+		if (!r)
+			throw std::runtime_error(std::string(name) + " unable to route address " +
+			                         std::to_string(trans.get_address()));
+		r->process(trans, delay);
+	}
+
+   private:
+	void fill_granules(uint64_t page, uint16_t table, uint16_t id) {
+		auto r = ranges[id];
+		uint64_t page_start = page << PAGE_SHIFT;
+		uint64_t first = std::max(r->start, page_start) - page_start;
+		uint64_t last = std::min(r->end, page_start | PAGE_MASK) - page_start;
+		uint64_t base = uint64_t(table) << (PAGE_SHIFT - granule_shift);
+
+		for (uint64_t g = first >> granule_shift; g <= (last >> granule_shift); ++g) {
+			assert(granules[base + g] == UNMAPPED && "overlapping register ranges");
+			granules[base + g] = id;
+		}
+	}
+};
+
 }  // namespace mm
 }  // namespace vp
@@ -0,0 +1,218 @@
+/*
+ * Unit test of the register dispatch of memory_map.h: routing through vp::mm::RegisterMap into several (also page
+ * sharing) ranges, misses, the access checks of RegisterRange and the callbacks bound with vp::mm::bind.
+ */
+
+#include <tlm>
+#include <systemc>
+
+#include <iostream>
+#include <stdexcept>
+
+#include "util/memory_map.h"
+
+static unsigned failures = 0;
+
+#define CHECK(cond)                                                                          \
+	do {                                                                                     \
+		if (!(cond)) {                                                                       \
+			std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #cond << std::endl; \
+			++failures;                                                                      \
+		}                                                                                    \
+	} while (0)
+
+#define CHECK_THROWS(expr)                   \
+	do {                                     \
+		bool thrown = false;                 \
+		try {                                \
+			expr;                            \
+		} catch (std::runtime_error &) {     \
+			thrown = true;                   \
+		}                                    \
+		CHECK(thrown && "expected: " #expr); \
+	} while (0)
+
+struct Peripheral {
+	// page 0 is shared by three ranges, the array covers page 1 on its own
+	RegisterRange regs_id{0x0, 4};
+	RegisterRange regs_ctrl{0x4, 4};
+	RegisterRange regs_status{0x10, 8};
+	RegisterRange regs_array{0x1000, sizeof(uint32_t) * 1024};
+	RegisterRange regs_far{0x20008, 8};
+
+	IntegerView<uint32_t> id{regs_id};
+	IntegerView<uint32_t> ctrl{regs_ctrl};
+	ArrayView<uint32_t> status{regs_status};
+	ArrayView<uint32_t> array{regs_array};
+
+	vp::mm::RegisterMap register_map{"Peripheral"};
+
+	unsigned num_ctrl_writes = 0;
+	uint64_t last_write_addr = -1;
+	size_t last_write_size = 0;
+	unsigned num_status_reads = 0;
+	bool block_status_reads = false;
+
+	Peripheral() {
+		regs_id.readonly = true;
+		regs_ctrl.alignment = 4;
+
+		regs_ctrl.post_write_callback = vp::mm::bind<&Peripheral::post_write_ctrl>(this);
+		regs_status.pre_read_callback = vp::mm::bind<&Peripheral::pre_read_status>(this);
+
+		register_map.add({&regs_id, &regs_ctrl, &regs_status, &regs_array, &regs_far});
+		register_map.build();
+
+		id = 0x1234;
+	}
+
+	void post_write_ctrl(const RegisterRange::WriteInfo &t) {
+		++num_ctrl_writes;
+		last_write_addr = t.addr;
+		last_write_size = t.size;
+		// the value is already stored, e.g. a self clearing start bit
+		ctrl = ctrl & ~uint32_t(1);
+	}
+
+	bool pre_read_status(const RegisterRange::ReadInfo &t) {
+		++num_status_reads;
+		status[t.addr / 4] = 0x100 + num_status_reads;
+		return !block_status_reads;
+	}
+};
+
+static void access(Peripheral &p, tlm::tlm_command cmd, uint64_t addr, uint8_t *data, unsigned len) {
+	tlm::tlm_generic_payload trans;
+	sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+
+	trans.set_command(cmd);
+	trans.set_address(addr);
+	trans.set_data_ptr(data);
+	trans.set_data_length(len);
+	trans.set_streaming_width(len);
+	p.register_map.route(trans, delay);
+}
+
+static void write32(Peripheral &p, uint64_t addr, uint32_t value) {
+	access(p, tlm::TLM_WRITE_COMMAND, addr, reinterpret_cast<uint8_t *>(&value), sizeof(value));
+}
+
+static uint32_t read32(Peripheral &p, uint64_t addr) {
+	uint32_t value = 0xdeadbeef;
+	access(p, tlm::TLM_READ_COMMAND, addr, reinterpret_cast<uint8_t *>(&value), sizeof(value));
+	return value;
+}
+
+static void test_find() {
+	Peripheral p;
+	auto &m = p.register_map;
+
+	CHECK(m.get_ranges().size() == 5);
+	CHECK(m.find(0x0) == &p.regs_id);
+	CHECK(m.find(0x3) == &p.regs_id);
+	CHECK(m.find(0x4) == &p.regs_ctrl);
+	CHECK(m.find(0x7) == &p.regs_ctrl);
+	CHECK(m.find(0x10) == &p.regs_status);
+	CHECK(m.find(0x17) == &p.regs_status);
+	CHECK(m.find(0x1000) == &p.regs_array);
+	CHECK(m.find(0x1ffc) == &p.regs_array);
+	CHECK(m.find(0x20008) == &p.regs_far);
+	CHECK(m.find(0x2000f) == &p.regs_far);
+
+	// gaps within a shared page, in unmapped pages, within the page of a range and beyond the last range
+	CHECK(m.find(0x8) == nullptr);
+	CHECK(m.find(0x18) == nullptr);
+	CHECK(m.find(0xfff) == nullptr);
+	CHECK(m.find(0x2000) == nullptr);
+	CHECK(m.find(0x20000) == nullptr);
+	CHECK(m.find(0x20010) == nullptr);
+	CHECK(m.find(uint64_t(1) << 40) == nullptr);
+}
+
+static void test_route() {
+	Peripheral p;
+
+	CHECK(read32(p, 0x0) == 0x1234);
+
+	write32(p, 0x10, 0x11);
+	write32(p, 0x1000, 0xa0);
+	write32(p, 0x1ffc, 0xa1);
+	write32(p, 0x2000c, 0xf0);
+	CHECK(p.status[0] == 0x11);
+	CHECK(p.array[0] == 0xa0);
+	CHECK(p.array[1023] == 0xa1);
+	CHECK(p.regs_far.mem[4] == 0xf0);
+	CHECK(read32(p, 0x1ffc) == 0xa1);
+	CHECK(read32(p, 0x2000c) == 0xf0);
+
+	// byte accesses to a range without alignment requirement
+	uint8_t b = 0x5a;
+	access(p, tlm::TLM_WRITE_COMMAND, 0x1001, &b, 1);
+	CHECK(p.array[0] == 0x5aa0);
+
+	CHECK_THROWS(read32(p, 0x8));
+	CHECK_THROWS(write32(p, 0x2000, 1));
+	CHECK_THROWS(read32(p, 0x30000));
+}
+
+static void test_access_checks() {
+	Peripheral p;
+
+	// readonly
+	CHECK_THROWS(write32(p, 0x0, 0));
+	CHECK(p.id == 0x1234);
+
+	// unaligned address and size
+	uint16_t h = 0;
+	CHECK_THROWS(write32(p, 0x5, 1));
+	CHECK_THROWS(access(p, tlm::TLM_WRITE_COMMAND, 0x4, reinterpret_cast<uint8_t *>(&h), sizeof(h)));
+	CHECK_THROWS(access(p, tlm::TLM_READ_COMMAND, 0x6, reinterpret_cast<uint8_t *>(&h), sizeof(h)));
+	CHECK(p.num_ctrl_writes == 0);
+}
+
+static void test_callbacks() {
+	Peripheral p;
+
+	write32(p, 0x4, 0x31);
+	CHECK(p.num_ctrl_writes == 1);
+	CHECK(p.last_write_addr == 0);
+	CHECK(p.last_write_size == 4);
+	CHECK(p.ctrl == 0x30);
+	CHECK(read32(p, 0x4) == 0x30);
+
+	// the pre read callback updates the register before it is read
+	CHECK(read32(p, 0x14) == 0x101);
+	CHECK(p.status[1] == 0x101);
+	CHECK(p.num_status_reads == 1);
+
+	// and can reject the read, which leaves the data untouched
+	p.block_status_reads = true;
+	CHECK(read32(p, 0x10) == 0xdeadbeef);
+	CHECK(p.num_status_reads == 2);
+
+	// callbacks are bound to their own object
+	Peripheral q;
+	write32(q, 0x4, 0x2);
+	CHECK(q.num_ctrl_writes == 1);
+	CHECK(p.num_ctrl_writes == 1);
+
+	// no callback bound
+	CHECK(!p.regs_id.pre_read_callback);
+	CHECK(!p.regs_id.post_write_callback);
+	CHECK(p.regs_ctrl.post_write_callback);
+}
+
+int sc_main(int, char **) {
+	test_find();
+	test_route();
+	test_access_checks();
+	test_callbacks();
+
+	if (failures) {
+		std::cerr << failures << " check(s) failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "all checks passed" << std::endl;
+	return 0;
+}